@@ -20,18 +20,6 @@ _Static_assert(((SLICE_COUNT)&3)==0, "slice count must be a multiple of 4");
 _Static_assert((1<<(sizeof(((slice_polar_t*)0)->slice )*8)) >= SLICE_COUNT, "slice precision overflow");
 _Static_assert((1<<(sizeof(((slice_polar_t*)0)->column)*8)) >= PANEL_WIDTH, "matrix width overflow");
 
-#ifndef PANEL_0_ECCENTRICITY
-#define ECCENTRICITY_0 0
-#else
-#define ECCENTRICITY_0 PANEL_0_ECCENTRICITY
-#endif
-
-#ifndef PANEL_1_ECCENTRICITY
-#define ECCENTRICITY_1 0
-#else
-#define ECCENTRICITY_1 PANEL_1_ECCENTRICITY
-#endif
-
 float eccentricity[2] = {ECCENTRICITY_0, ECCENTRICITY_1}; // each panel's offset from the axis, in units of led pitch
 
 
@@ -90,11 +78,6 @@ void slicemap_init(slice_brightness_t brightness) {
                 float angle = (float)a * M_PI * 2.0f / SLICE_COUNT;
                 vec2_t slope = {.x = cosf(angle), .y = sinf(angle)};
 
-                vec2_t eccoff[2]= {
-                    {.x =  slope.y * eccentricity[0], .y = -slope.x * eccentricity[0]},
-                    {.x = -slope.y * eccentricity[1], .y =  slope.x * eccentricity[1]}
-                };
-
                 for (int column = 0; column < PANEL_WIDTH; ++column) {
                     float coff = (float)column - ((float)(PANEL_WIDTH - 1) * 0.5f);
                     int side = coff > 0;
@@ -108,10 +91,9 @@ void slicemap_init(slice_brightness_t brightness) {
                         }
 #endif
                         if (slice_map[a][column][panel].x >= VOXELS_X) {
-                            vec2_t voxel_actual = {
-                                .x = vox_centre.x + (eccoff[panel].x + slope.x * coff) * (1 - panel * 2),
-                                .y = vox_centre.y + (eccoff[panel].y + slope.y * coff) * (1 - panel * 2),
-                            };
+                            vec2_t voxel_actual;
+                            slicemap_column_offset(voxel_actual.v, slope.x, slope.y, panel, eccentricity[panel], coff);
+                            vec2_add(voxel_actual.v, voxel_actual.v, vox_centre.v);
                             vec2i_t voxel_virtual = {
                                 .x = (int)roundf(voxel_actual.x),
                                 .y = (int)roundf(voxel_actual.y),
@@ -4,14 +4,16 @@
 #include "voxel.h"
 
 
-#define SLICE_COUNT 360
-#define SLICE_QUADRANT (SLICE_COUNT / 4)
-#define SLICE_WRAP(slice) ((slice) % (SLICE_COUNT))
+#ifndef PANEL_0_ECCENTRICITY
+#define ECCENTRICITY_0 0
+#else
+#define ECCENTRICITY_0 PANEL_0_ECCENTRICITY
+#endif
 
-#if SLICE_COUNT <= 256
-    typedef uint8_t slice_index_t;
+#ifndef PANEL_1_ECCENTRICITY
+#define ECCENTRICITY_1 0
 #else
-    typedef uint16_t slice_index_t;
+#define ECCENTRICITY_1 PANEL_1_ECCENTRICITY
 #endif
 
 
@@ -34,6 +36,18 @@ typedef enum {
 extern voxel_2D_t slice_map[SLICE_COUNT][PANEL_WIDTH][PANEL_COUNT];
 extern float eccentricity[2];
 
+// panel 1 is mounted facing the other way, so its columns run backwards
+#define PANEL_FACING(panel) (1 - (panel) * 2)
+
+// where a column passes at a slice whose angle has the given cosine and sine, from the axis in voxels. each panel
+// sits its eccentricity off the axis along the slice's normal, and along is the column's distance from the
+// panel's centre. the slice map, polar layers and the simulator's emulation all place columns with this
+static inline void slicemap_column_offset(float* offset, float cosine, float sine, int panel, float eccentricity, float along) {
+    along *= PANEL_FACING(panel);
+    offset[0] = sine * eccentricity + cosine * along;
+    offset[1] = -cosine * eccentricity + sine * along;
+}
+
 void slicemap_ebr(int* a, int n);
 void slicemap_init(slice_brightness_t brightness);
 
@@ -0,0 +1,52 @@
+#include <string.h>
+
+#include "slicer.h"
+
+#include "rammel.h"
+#include "slicemap.h"
+
+void slicer_gather(slice_rows_t rows, bool* polar_drawn, const pixel_t* content, const voxel_polar_t* polar, slice_index_t sliceidx) {
+    const uint32_t polar_mode = polar->mode;
+
+    if (polar_mode != VOXEL_POLAR_OFF || *polar_drawn) {
+        // polar voxels can land in columns the slice map leaves alone, so they'd never be overwritten
+        memset(rows, 0, sizeof(slice_rows_t));
+    }
+    *polar_drawn = (polar_mode != VOXEL_POLAR_OFF);
+
+    if (polar_mode != VOXEL_POLAR_ONLY) {
+        voxel_2D_t* v2d;
+        for (int c = 0; c < PANEL_WIDTH; ++c) {
+            for (int p = 0; p < PANEL_COUNT; ++p) {
+                if (v2d = &slice_map[sliceidx][c][p], v2d->x < VOXELS_X) {
+                    for (int r = 0; r < PANEL_FIELD_HEIGHT; ++r) {
+                        rows[r][p][0][c] = content[VOXEL_INDEX(v2d->x, v2d->y, (VOXELS_Z-1) - r)];
+                        rows[r][p][1][c] = content[VOXEL_INDEX(v2d->x, v2d->y, (VOXELS_Z-1) - r - PANEL_FIELD_HEIGHT)];
+                    }
+                }
+            }
+        }
+    }
+
+    if (polar_mode != VOXEL_POLAR_OFF) {
+        // already in slice space, the voxels are copied straight in. the layer comes from a client, so is checked
+        uint32_t end = min(polar->slices[sliceidx + 1], (uint32_t)VOXEL_POLAR_CAPACITY);
+        for (uint32_t i = polar->slices[sliceidx]; i < end; ++i) {
+            const polar_voxel_t* voxel = &polar->voxels[i];
+            if (voxel->column < PANEL_WIDTH && voxel->panel < PANEL_COUNT && voxel->z < VOXELS_Z) {
+                int row = (VOXELS_Z-1) - voxel->z;
+                rows[row % PANEL_FIELD_HEIGHT][voxel->panel][row / PANEL_FIELD_HEIGHT][voxel->column] = voxel->colour;
+            }
+        }
+    }
+}
+
+void slicer_unblank(int bpc, int unblank[BPC_MAX]) {
+    const int gamma[BPC_MAX] = {PANEL_WIDTH-60, PANEL_WIDTH-30, PANEL_WIDTH-15};
+    for (int b = 0; b < BPC_MAX; ++b) {
+        unblank[b] = 0;
+    }
+    for (int b = 0; b < bpc; ++b) {
+        unblank[(b+1)%bpc] = gamma[b];
+    }
+}
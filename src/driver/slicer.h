@@ -0,0 +1,21 @@
+#ifndef _SLICER_H_
+#define _SLICER_H_
+
+#include <stdbool.h>
+
+#include "voxel.h"
+
+#define BPC_MAX 3
+
+// one slice as the panels scan it out, a row at a time
+typedef pixel_t slice_rows_t[PANEL_FIELD_HEIGHT][PANEL_COUNT][PANEL_MULTIPLEX][PANEL_WIDTH];
+
+// gathers a slice from the volume through the slice map, then draws the polar layer's voxels for it over the top.
+// polar_drawn says whether the buffer still holds polar voxels from its last use, and is updated
+void slicer_gather(slice_rows_t rows, bool* polar_drawn, const pixel_t* content, const voxel_polar_t* polar, slice_index_t sliceidx);
+
+// the previous row is unblanked while the next is shifted in, and how late in the shift that happens gives each
+// bit its weight. bit b of a row is lit from column unblank[(b+1)%bpc] until the end of the next shift
+void slicer_unblank(int bpc, int unblank[BPC_MAX]);
+
+#endif
@@ -19,6 +19,7 @@
 #include "gadget.h"
 #include "rotation.h"
 #include "slicemap.h"
+#include "slicer.h"
 #include "gpio.h"
 #include "input.h"
 
@@ -32,7 +33,6 @@
 #endif
 
 
-#define BPC_MAX 3
 #define DEVELOPMENT_FEATURES
 
 #ifdef DEVELOPMENT_FEATURES
@@ -54,9 +54,12 @@ static DEVELOPMENT_ONLY uint32_t stop_axis = 1;
 #define SLICE_BUFFER_SLICES SLICE_COUNT
 #endif
 
-static pixel_t slice_buffer[SLICE_BUFFER_SLICES][PANEL_FIELD_HEIGHT][PANEL_COUNT][PANEL_MULTIPLEX][PANEL_WIDTH] = {};
+static slice_rows_t slice_buffer[SLICE_BUFFER_SLICES] = {};
 #define SLICE_BUFFER_WRAP(slice) ((slice) % (count_of(slice_buffer)))
 
+// slices holding polar voxels, which need clearing before the volume is next gathered into them
+static bool polar_drawn[SLICE_BUFFER_SLICES] = {};
+
 static DEVELOPMENT_ONLY uint non_uniformity = (uint)SLICE_BRIGHTNESS_BOOSTED;
 
 static void reset_slicemap() {
@@ -260,18 +263,8 @@ void* slicer_worker(void *vargp) {
             sliceidx = SLICE_WRAP(sliceidx + 1);
             bufferidx = SLICE_BUFFER_WRAP(sliceidx);
 
-            voxel_2D_t* v2d;
-            for (int c = 0; c < PANEL_WIDTH; ++c) {
-                pixel_t* content = volume_buffer->volume[volume_buffer->page != 0];
-                for (int p = 0; p < PANEL_COUNT; ++p) {
-                    if (v2d = &slice_map[sliceidx][c][p], v2d->x < VOXELS_X) {
-                        for (int r = 0; r < PANEL_FIELD_HEIGHT; ++r) {
-                            slice_buffer[bufferidx][r][p][0][c] = content[VOXEL_INDEX(v2d->x, v2d->y, (VOXELS_Z-1) - r)];
-                            slice_buffer[bufferidx][r][p][1][c] = content[VOXEL_INDEX(v2d->x, v2d->y, (VOXELS_Z-1) - r - PANEL_FIELD_HEIGHT)];
-                        }
-                    }
-                }
-            }
+            const int page = volume_buffer->page != 0;
+            slicer_gather(slice_buffer[bufferidx], &polar_drawn[bufferidx], volume_buffer->volume[page], &volume_buffer->polar[page], sliceidx);
 
 #ifdef SLICER_PROFILE
             uint32_t elapsed = *timer_uS - work_start;
@@ -537,11 +530,8 @@ int main(int argc, char** argv) {
         // we unblank the previous row while we're shifting in the new row. This lookup defines
         // how late that unblank happens to vary the brightness for BCM
         const int bpc = min(max(1, buffer->bits_per_channel), BPC_MAX);
-        const int gamma[BPC_MAX] = {PANEL_WIDTH-60, PANEL_WIDTH-30, PANEL_WIDTH-15};
-        int unblank[3] = {};
-        for (int b = 0; b < bpc; ++b) {
-            unblank[(b+1)%bpc] = gamma[b];
-        }
+        int unblank[BPC_MAX];
+        slicer_unblank(bpc, unblank);
         
 #ifdef VERTICAL_SCAN
         for (uint ci = 0; ci < count_of(colscatter); ci++) {
@@ -16,6 +16,9 @@
 #include "array.h"
 
 
+// carts either side of the front whose voxel shots are loaded ahead of them coming round
+#define SHOT_PREFETCH 2
+
 static array_t carts = {sizeof(cart_t)};
 
 
@@ -65,6 +68,23 @@ void carousel_init() {
     load_carts(directory);
 }
 
+// the cart at the front first, then alternately those ahead of the carousel's turn and behind it
+static void request_voxshots(void) {
+    cart_t* nearby[SHOT_PREFETCH * 2 + 1];
+    int nearby_count = 0;
+
+    int front = (int)lroundf(selection_current);
+    int ahead = (selection_target < selection_current) ? -1 : 1;
+    for (int n = 0; n <= SHOT_PREFETCH * 2; ++n) {
+        int i = front + ((n & 1) ? (n + 1) / 2 : -n / 2) * ahead;
+        if (i >= 0 && i < carts.count) {
+            nearby[nearby_count++] = array_get(&carts, i);
+        }
+    }
+
+    cart_request_voxshots(nearby, nearby_count);
+}
+
 void carousel_update(float dt) {
     const float speed = 3.0f;
 
@@ -82,6 +102,8 @@ void carousel_update(float dt) {
         selection_current = max(target, selection_current - dt * speed);
     }
 
+    request_voxshots();
+
     if (input_get_button(0, BUTTON_VIEW, BUTTON_PRESSED)) {
         cart_action_t action = multivox_cart_resume();
         (void)action;
@@ -4,6 +4,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <linux/limits.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -60,64 +62,57 @@ static float slot_height(float a) {
     return powf(0.5f * (1 + cosf(a)), 80) * 24 - 12;
 }
 
-void cart_grab_voxshot(cart_t* cart, const pixel_t* volume) {
-    if (!cart->voxel_shot[0]) {
-        cart->voxel_shot[0] = malloc(VOXELS_COUNT * sizeof(pixel_t));
-        memset(cart->voxel_shot[0], 0, VOXELS_COUNT * sizeof(pixel_t));
+// voxel shots load on a thread of their own, so that starting up only reads the .mct files. only the mips
+// are loaded, as the full size shot isn't drawn and is grabbed afresh before it's saved
+#define SHOT_FIRST_LEVEL 1
+#define SHOT_WANTED_MAX 8
+
+static cart_t* shot_wanted[SHOT_WANTED_MAX];
+static int shot_wanted_count = 0;
+
+static bool shot_loader_started = false;
+static pthread_t shot_loader_thread;
+static pthread_mutex_t shot_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t shot_wake = PTHREAD_COND_INITIALIZER;
+
+static bool shot_filename(char* shotname, const char* cartpath, const char* extension) {
+    size_t namelen = strlen(cartpath);
+    if (namelen <= 4 || cartpath[namelen-4] != '.') {
+        return false;
     }
+    int length = snprintf(shotname, PATH_MAX, "%.*s%s", (int)(namelen - 4), cartpath, extension);
+    return length > 0 && length < PATH_MAX;
+}
 
-    // grab the cylinder of visible voxels currently in the display buffer
+// the cylinder of visible voxels in the display buffer
+static void grab_cylinder(pixel_t* shot, const pixel_t* volume) {
     for (int y = 0; y < VOXELS_Y; ++y) {
         for (int x = 0; x < VOXELS_X; ++x) {
             if (voxel_in_cylinder(x, y)) {
                 for (int z = 0; z < VOXELS_Z; ++z) {
-                    cart->voxel_shot[0][x * VOXELS_Z + y * VOXELS_X * VOXELS_Z + z] = volume[VOXEL_INDEX(x, y, z)];
+                    shot[x * VOXELS_Z + y * VOXELS_X * VOXELS_Z + z] = volume[VOXEL_INDEX(x, y, z)];
                 }
             }
         }
     }
+}
 
-    // generate a few vipvap levels
-    int count[3] = {VOXELS_X, VOXELS_Y, VOXELS_Z};
-    for (int m = 1; m < count_of(cart->voxel_shot); ++m) {
-        count[0] /= 2;
-        count[1] /= 2;
-        count[2] /= 2;
-
-        if (!cart->voxel_shot[m]) {
-            cart->voxel_shot[m] = malloc(count[0] * count[1] * count[2] * sizeof(pixel_t));
-            memset(cart->voxel_shot[m], 0, count[0] * count[1] * count[2] * sizeof(pixel_t));
-        }
-
-        for (int y = 0; y < count[1]; ++y) {
-            for (int x = 0; x < count[0]; ++x) {
-                for (int z = 0; z < count[2]; ++z) {
-
-                    int rgb[3] = {0,0,0};
-                    for (int j = 0; j < 2; ++j) {
-                        for (int i = 0; i < 2; ++i) {
-                            for (int k = 0; k < 2; ++k) {
-                                pixel_t colour = cart->voxel_shot[m - 1][((x*2+i) * count[2]*2) + ((y*2+j) * count[0]*count[2]*4) + (z*2+k)];
-                                rgb[0] += R_PIX(colour);
-                                rgb[1] += G_PIX(colour);
-                                rgb[2] += B_PIX(colour);
-                            }
-                        }
-                    }
-
-                    rgb[0] = min(255, rgb[0] / 3);
-                    rgb[1] = min(255, rgb[1] / 3);
-                    rgb[2] = min(255, rgb[2] / 3);
+void cart_grab_voxshot(cart_t* cart, const pixel_t* volume) {
+    // newer than anything the loader might be reading
+    pthread_mutex_lock(&shot_lock);
+    cart->shot_state = CART_SHOT_READY;
+    pthread_mutex_unlock(&shot_lock);
 
-                    cart->voxel_shot[m][(x * count[2]) + (y * count[0]*count[2]) + (z)] = RGBPIX(rgb[0], rgb[1], rgb[2]);
-                }
-            }
-        }
+    if (!cart->voxel_shot[0]) {
+        cart->voxel_shot[0] = calloc(voxshot_level_size(0), sizeof(pixel_t));
     }
 
+    grab_cylinder(cart->voxel_shot[0], volume);
+    voxshot_build_mips(cart->voxel_shot);
 }
 
-static bool try_load_voxshot(cart_t* cart, char* filename) {
+// carts saved before .cvx files have a dump of the whole volume, which is converted the first time it's seen
+static bool load_raw_voxshot(const char* filename, pixel_t* levels[VOXSHOT_LEVELS]) {
     int fd = open(filename, O_RDONLY);
     if (fd == -1) {
         return false;
@@ -143,7 +138,9 @@ static bool try_load_voxshot(cart_t* cart, char* filename) {
         return false;
     }
 
-    cart_grab_voxshot(cart, mapped);
+    levels[0] = calloc(voxshot_level_size(0), sizeof(pixel_t));
+    grab_cylinder(levels[0], mapped);
+    voxshot_build_mips(levels);
 
     munmap(mapped, size);
     close(fd);
@@ -151,24 +148,90 @@ static bool try_load_voxshot(cart_t* cart, char* filename) {
     return true;
 }
 
-void cart_save_voxshot(cart_t* cart) {
-    if (!cart->cartpath || !cart->voxel_shot[0]) {
-        return;
+static bool load_voxshot(const char* cartpath, pixel_t* levels[VOXSHOT_LEVELS]) {
+    char shotname[PATH_MAX];
+    if (!shot_filename(shotname, cartpath, ".cvx")) {
+        return false;
     }
+    if (voxshot_load(shotname, levels, SHOT_FIRST_LEVEL)) {
+        return true;
+    }
+
+    char rawname[PATH_MAX];
+    if (!shot_filename(rawname, cartpath, ".rvx") || !load_raw_voxshot(rawname, levels)) {
+        return false;
+    }
+    voxshot_save(shotname, levels);
 
-    size_t namelen = strlen(cart->cartpath);
-    if (namelen > 4 && cart->cartpath[namelen-4] == '.') {
-        char shotname[namelen+1];
-        memcpy(shotname, cart->cartpath, namelen - 4);
-        memcpy(shotname + namelen - 4, ".rvx", 5);
+    for (int l = 0; l < SHOT_FIRST_LEVEL; ++l) {
+        free(levels[l]);
+        levels[l] = NULL;
+    }
+    return true;
+}
 
-        FILE* fd = fopen(shotname, "wb");
-        if (!fd) {
-            perror("save");
+static void* shot_loader(void* vargp) {
+    pthread_mutex_lock(&shot_lock);
+    while (true) {
+        cart_t* cart = NULL;
+        for (int i = 0; i < shot_wanted_count && !cart; ++i) {
+            if (shot_wanted[i]->shot_state == CART_SHOT_NONE) {
+                cart = shot_wanted[i];
+            }
+        }
+
+        if (!cart) {
+            pthread_cond_wait(&shot_wake, &shot_lock);
+            continue;
         }
 
-        fwrite(cart->voxel_shot[0], sizeof(pixel_t), VOXELS_COUNT, fd);
-        fclose(fd);
+        cart->shot_state = CART_SHOT_LOADING;
+        pthread_mutex_unlock(&shot_lock);
+        pixel_t* levels[VOXSHOT_LEVELS] = {NULL};
+        bool loaded = load_voxshot(cart->cartpath, levels);
+        pthread_mutex_lock(&shot_lock);
+
+        // the cart may have been run and grabbed while it loaded
+        if (cart->shot_state == CART_SHOT_LOADING) {
+            memcpy(cart->voxel_shot, levels, sizeof(levels));
+            cart->shot_state = loaded ? CART_SHOT_READY : CART_SHOT_MISSING;
+        } else {
+            for (int l = 0; l < VOXSHOT_LEVELS; ++l) {
+                free(levels[l]);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+void cart_request_voxshots(cart_t* const* carts, int count) {
+    pthread_mutex_lock(&shot_lock);
+
+    shot_wanted_count = min(count, SHOT_WANTED_MAX);
+    memcpy(shot_wanted, carts, shot_wanted_count * sizeof(cart_t*));
+
+    if (!shot_loader_started) {
+        shot_loader_started = pthread_create(&shot_loader_thread, NULL, shot_loader, NULL) == 0;
+    }
+
+    pthread_cond_signal(&shot_wake);
+    pthread_mutex_unlock(&shot_lock);
+}
+
+void cart_save_voxshot(cart_t* cart) {
+    if (!cart->cartpath) {
+        return;
+    }
+    for (int l = 0; l < VOXSHOT_LEVELS; ++l) {
+        if (!cart->voxel_shot[l]) {
+            return;
+        }
+    }
+
+    char shotname[PATH_MAX];
+    if (shot_filename(shotname, cart->cartpath, ".cvx")) {
+        voxshot_save(shotname, cart->voxel_shot);
     }
 }
 
@@ -209,15 +272,6 @@ bool cart_load(cart_t* cart, char* filename) {
 
     fclose(file);
 
-    if (namelen > 4 && filename[namelen-4] == '.') {
-        char shotname[namelen+1];
-        memcpy(shotname, filename, namelen - 4);
-        memcpy(shotname + namelen - 4, ".rvx", 5);
-        
-        try_load_voxshot(cart, shotname);
-    }
-
-    
     return true;
 }
 
@@ -232,9 +286,13 @@ void cart_draw(cart_t* cart, pixel_t* volume, float slot_angle) {
     cart_model.surfaces[0].colour = cart->colour;
     model_draw(volume, &cart_model, matrix);
 
+    pthread_mutex_lock(&shot_lock);
+    bool shot_ready = cart->shot_state == CART_SHOT_READY;
+    pthread_mutex_unlock(&shot_lock);
+
     int z0 = slot_angle * slot_angle * 320;
     const int m = 1;
-    if (cart->voxel_shot[m]) {
+    if (shot_ready && cart->voxel_shot[m]) {
         for (int y = 0; y < VOXELS_Y>>m; ++y) {
             int vy = y+(VOXELS_Y/2)-(VOXELS_Y>>(m+1));
             for (int x = 0; x < VOXELS_X>>m; ++x) {
@@ -2,6 +2,14 @@
 #define _CART_H_
 
 #include "voxel.h"
+#include "voxshot.h"
+
+typedef enum {
+    CART_SHOT_NONE,             // not looked for yet
+    CART_SHOT_LOADING,
+    CART_SHOT_READY,            // loaded, or grabbed from the cart itself
+    CART_SHOT_MISSING
+} cart_shot_state_t;
 
 typedef struct {
     const char* command;
@@ -12,7 +20,8 @@ typedef struct {
     pixel_t colour;
 
     const char* cartpath;
-    pixel_t * voxel_shot[4];
+    pixel_t * voxel_shot[VOXSHOT_LEVELS];
+    cart_shot_state_t shot_state;
 } cart_t;
 
 typedef enum {
@@ -24,6 +33,11 @@ typedef enum {
 
 void cart_grab_voxshot(cart_t* cart, const pixel_t* volume);
 void cart_save_voxshot(cart_t* cart);
+
+// voxel shots load in the background, and only for carts that have been asked for. carts is in order of
+// preference, and replaces whatever was asked for before
+void cart_request_voxshots(cart_t* const* carts, int count);
+
 bool cart_load(cart_t* cart, char* filename);
 void cart_draw(cart_t* cart, pixel_t* volume, float slot_angle);
 
@@ -0,0 +1,251 @@
+#include "voxshot.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "rammel.h"
+#include "cachefile.h"
+
+#define VOXSHOT_MAGIC 0x3153564d   // "MVS1"
+#define VOXSHOT_VERSION 1
+
+// pixel_t differs with HIGH_COLOUR, and the colour packing with it
+#define VOXSHOT_LAYOUT ((sizeof(pixel_t) << 16) | (uint32_t)HEXPIX(200000))
+
+// runs of empty voxels shorter than this are cheaper left in with the voxels around them
+#define VOXSHOT_MIN_SKIP 3
+
+typedef struct {
+    uint64_t offset;            // from the start of the file
+    uint64_t length;
+} voxshot_level_t;
+
+// each level is a run of empty voxels, a run of voxels as they are, then the next pair, until the level is
+// full. each run starts with its length, seven bits at a time, low first
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t layout;
+    uint16_t voxels[3];
+    uint16_t level_count;
+    uint32_t reserved;
+    uint64_t size;
+    voxshot_level_t levels[VOXSHOT_LEVELS];
+} voxshot_header_t;
+
+_Static_assert(sizeof(voxshot_header_t) == 32 + sizeof(voxshot_level_t) * VOXSHOT_LEVELS, "voxshot header has padding");
+
+size_t voxshot_level_size(int level) {
+    return (size_t)(VOXELS_X >> level) * (VOXELS_Y >> level) * (VOXELS_Z >> level);
+}
+
+void voxshot_build_mips(pixel_t* levels[VOXSHOT_LEVELS]) {
+    int count[3] = {VOXELS_X, VOXELS_Y, VOXELS_Z};
+    for (int m = 1; m < VOXSHOT_LEVELS; ++m) {
+        count[0] /= 2;
+        count[1] /= 2;
+        count[2] /= 2;
+
+        if (!levels[m]) {
+            levels[m] = malloc(voxshot_level_size(m) * sizeof(pixel_t));
+        }
+
+        for (int y = 0; y < count[1]; ++y) {
+            for (int x = 0; x < count[0]; ++x) {
+                for (int z = 0; z < count[2]; ++z) {
+
+                    int rgb[3] = {0,0,0};
+                    for (int j = 0; j < 2; ++j) {
+                        for (int i = 0; i < 2; ++i) {
+                            for (int k = 0; k < 2; ++k) {
+                                pixel_t colour = levels[m - 1][((x*2+i) * count[2]*2) + ((y*2+j) * count[0]*count[2]*4) + (z*2+k)];
+                                rgb[0] += R_PIX(colour);
+                                rgb[1] += G_PIX(colour);
+                                rgb[2] += B_PIX(colour);
+                            }
+                        }
+                    }
+
+                    rgb[0] = min(255, rgb[0] / 3);
+                    rgb[1] = min(255, rgb[1] / 3);
+                    rgb[2] = min(255, rgb[2] / 3);
+
+                    levels[m][(x * count[2]) + (y * count[0]*count[2]) + (z)] = RGBPIX(rgb[0], rgb[1], rgb[2]);
+                }
+            }
+        }
+    }
+}
+
+static uint8_t* put_length(uint8_t* out, size_t length) {
+    do {
+        uint8_t byte = length & 0x7f;
+        length >>= 7;
+        *out++ = byte | (length ? 0x80 : 0);
+    } while (length);
+    return out;
+}
+
+static const uint8_t* get_length(const uint8_t* in, const uint8_t* end, size_t* length) {
+    size_t value = 0;
+    for (int shift = 0; in < end && shift < 32; shift += 7) {
+        uint8_t byte = *in++;
+        value |= (size_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *length = value;
+            return in;
+        }
+    }
+    return NULL;
+}
+
+// enough for any level, as runs are only broken by empties that take longer to copy than to skip
+static size_t encoded_bound(size_t count) {
+    return count * sizeof(pixel_t) * 2 + 16;
+}
+
+static size_t encode_level(uint8_t* out, const pixel_t* voxels, size_t count) {
+    uint8_t* start = out;
+
+    size_t i = 0;
+    while (i < count) {
+        size_t empty = 0;
+        while (i + empty < count && !voxels[i + empty]) {
+            ++empty;
+        }
+        i += empty;
+
+        size_t solid = 0;
+        while (i + solid < count) {
+            size_t gap = 0;
+            while (i + solid + gap < count && gap < VOXSHOT_MIN_SKIP && !voxels[i + solid + gap]) {
+                ++gap;
+            }
+            if (gap == VOXSHOT_MIN_SKIP || i + solid + gap == count) {
+                break;
+            }
+            solid += max(gap, 1);
+        }
+
+        out = put_length(out, empty);
+        out = put_length(out, solid);
+        memcpy(out, &voxels[i], solid * sizeof(pixel_t));
+        out += solid * sizeof(pixel_t);
+        i += solid;
+    }
+
+    return out - start;
+}
+
+static bool decode_level(pixel_t* voxels, size_t count, const uint8_t* in, const uint8_t* end) {
+    size_t i = 0;
+    while (i < count) {
+        size_t empty, solid;
+        if (!(in = get_length(in, end, &empty)) || !(in = get_length(in, end, &solid))) {
+            return false;
+        }
+        if (empty > count - i || solid > count - i - empty || solid * sizeof(pixel_t) > (size_t)(end - in)) {
+            return false;
+        }
+
+        memset(&voxels[i], 0, empty * sizeof(pixel_t));
+        i += empty;
+        memcpy(&voxels[i], in, solid * sizeof(pixel_t));
+        in += solid * sizeof(pixel_t);
+        i += solid;
+    }
+    return true;
+}
+
+typedef struct {
+    pixel_t* const* levels;
+    uint8_t* encoded;
+} voxshot_contents_t;
+
+static bool voxshot_write(FILE* fd, void* context) {
+    const voxshot_contents_t* contents = context;
+
+    voxshot_header_t header = {
+        .magic = VOXSHOT_MAGIC,
+        .version = VOXSHOT_VERSION,
+        .layout = VOXSHOT_LAYOUT,
+        .voxels = {VOXELS_X, VOXELS_Y, VOXELS_Z},
+        .level_count = VOXSHOT_LEVELS,
+        .reserved = 0
+    };
+
+    // levels follow the header in order
+    uint64_t offset = sizeof(header);
+    bool written = fwrite(&header, sizeof(header), 1, fd) == 1;
+    for (int l = 0; written && l < VOXSHOT_LEVELS; ++l) {
+        size_t length = encode_level(contents->encoded, contents->levels[l], voxshot_level_size(l));
+        header.levels[l] = (voxshot_level_t){offset, length};
+        offset += length;
+        written = fwrite(contents->encoded, 1, length, fd) == length;
+    }
+
+    // the header goes in last, now the levels are placed
+    header.size = offset;
+    return written && fseek(fd, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, fd) == 1;
+}
+
+void voxshot_save(const char* filename, pixel_t* const levels[VOXSHOT_LEVELS]) {
+    voxshot_contents_t contents = {levels, malloc(encoded_bound(voxshot_level_size(0)))};
+    file_write_atomic(filename, voxshot_write, &contents);
+    free(contents.encoded);
+}
+
+bool voxshot_load(const char* filename, pixel_t* levels[VOXSHOT_LEVELS], int first) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat sb;
+    if (fstat(fd, &sb) != 0 || sb.st_size < (off_t)sizeof(voxshot_header_t)) {
+        close(fd);
+        return false;
+    }
+
+    size_t mapping_size = sb.st_size;
+    const uint8_t* mapping = mmap(NULL, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+
+    const voxshot_header_t* header = (const voxshot_header_t*)mapping;
+    bool valid = header->magic == VOXSHOT_MAGIC && header->version == VOXSHOT_VERSION && header->layout == VOXSHOT_LAYOUT
+              && header->voxels[0] == VOXELS_X && header->voxels[1] == VOXELS_Y && header->voxels[2] == VOXELS_Z
+              && header->level_count == VOXSHOT_LEVELS && header->size == mapping_size;
+
+    // decoded aside, so a bad level leaves the caller's alone
+    pixel_t* decoded[VOXSHOT_LEVELS] = {NULL};
+    for (int l = first; valid && l < VOXSHOT_LEVELS; ++l) {
+        const voxshot_level_t* level = &header->levels[l];
+        valid = level->offset <= mapping_size && level->length <= mapping_size - level->offset;
+        if (valid) {
+            decoded[l] = malloc(voxshot_level_size(l) * sizeof(pixel_t));
+            valid = decode_level(decoded[l], voxshot_level_size(l), mapping + level->offset, mapping + level->offset + level->length);
+        }
+    }
+
+    munmap((void*)mapping, mapping_size);
+
+    for (int l = first; l < VOXSHOT_LEVELS; ++l) {
+        if (valid) {
+            free(levels[l]);
+            levels[l] = decoded[l];
+        } else {
+            free(decoded[l]);
+        }
+    }
+
+    return valid;
+}
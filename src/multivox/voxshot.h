@@ -0,0 +1,26 @@
+#ifndef _VOXSHOT_H_
+#define _VOXSHOT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "voxel.h"
+
+// a cart's voxel shot and its mips, saved as a .cvx file beside the cart. each level is run length encoded, as
+// most of a shot is empty, and the mips are stored rather than rebuilt whenever the shot is loaded.
+
+#define VOXSHOT_LEVELS 4
+
+// level l is (VOXELS_X>>l) by (VOXELS_Y>>l) by (VOXELS_Z>>l), z fastest then x then y
+size_t voxshot_level_size(int level);
+
+// fills levels 1 onwards from level 0, allocating any that are missing
+void voxshot_build_mips(pixel_t* levels[VOXSHOT_LEVELS]);
+
+// quietly gives up if the file can't be written
+void voxshot_save(const char* filename, pixel_t* const levels[VOXSHOT_LEVELS]);
+
+// allocates and decodes the levels from first on, leaving the others alone. false if there's no usable file
+bool voxshot_load(const char* filename, pixel_t* levels[VOXSHOT_LEVELS], int first);
+
+#endif
@@ -0,0 +1,118 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+#include "rammel.h"
+
+// the block is never smaller than this, and grows in steps of it
+#define ARENA_BLOCK_MIN (64 * 1024)
+
+// heads each allocation that didn't fit in the block, newest first
+typedef struct overflow_s {
+    struct overflow_s* next;
+    size_t size;
+} overflow_t;
+
+_Static_assert(sizeof(overflow_t) <= ARENA_ALIGNMENT, "overflow header must fit in the alignment");
+
+typedef struct {
+    uint8_t* block;
+    size_t capacity;
+    size_t used;
+    overflow_t* overflow;
+    size_t overflow_count;
+    size_t overflow_used;
+    size_t high_water;
+    uint32_t mallocs;
+} arena_t;
+
+static _Thread_local arena_t arena;
+
+static size_t align_size(size_t size, size_t alignment) {
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+void* arena_alloc(size_t size) {
+    size = align_size(max(size, (size_t)1), ARENA_ALIGNMENT);
+
+    void* data;
+    if (size <= arena.capacity - arena.used) {
+        data = arena.block + arena.used;
+        arena.used += size;
+    } else {
+        overflow_t* overflow = malloc(ARENA_ALIGNMENT + size);
+        if (!overflow) {
+            exit(1);
+        }
+        overflow->next = arena.overflow;
+        overflow->size = size;
+        arena.overflow = overflow;
+        arena.overflow_count += 1;
+        arena.overflow_used += size;
+        arena.mallocs += 1;
+        data = (uint8_t*)overflow + ARENA_ALIGNMENT;
+    }
+
+    arena.high_water = max(arena.high_water, arena.used + arena.overflow_used);
+    return data;
+}
+
+static void free_overflow(size_t keep) {
+    while (arena.overflow_count > keep) {
+        overflow_t* overflow = arena.overflow;
+        arena.overflow = overflow->next;
+        arena.overflow_count -= 1;
+        arena.overflow_used -= overflow->size;
+        free(overflow);
+    }
+}
+
+void arena_reset(void) {
+    free_overflow(0);
+
+    // replaced rather than realloced, there's nothing in it worth copying. the headroom saves regrowing
+    // for every frame that creeps a little past the last
+    if (arena.high_water > arena.capacity) {
+        free(arena.block);
+        arena.capacity = align_size(arena.high_water + arena.high_water / 2, ARENA_BLOCK_MIN);
+        arena.block = malloc(arena.capacity);
+        if (!arena.block) {
+            exit(1);
+        }
+        arena.mallocs += 1;
+    }
+
+    arena.used = 0;
+}
+
+arena_mark_t arena_mark(void) {
+    return (arena_mark_t){arena.used, arena.overflow_count};
+}
+
+void arena_rewind(arena_mark_t mark) {
+    // back to empty is as good as a reset, which lets threads that never swap still settle into the block
+    if (mark.used == 0 && mark.overflow_count == 0) {
+        arena_reset();
+        return;
+    }
+    free_overflow(mark.overflow_count);
+    arena.used = min(mark.used, arena.used);
+}
+
+arena_stats_t arena_get_stats(void) {
+    return (arena_stats_t){
+        .used = arena.used + arena.overflow_used,
+        .high_water = arena.high_water,
+        .capacity = arena.capacity,
+        .mallocs = arena.mallocs
+    };
+}
+
+void arena_destroy(void) {
+    free_overflow(0);
+    free(arena.block);
+    memset(&arena, 0, sizeof(arena));
+}
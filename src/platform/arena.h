@@ -0,0 +1,40 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// frame scoped scratch memory. every thread bump allocates from an arena of its own, which is emptied all at once by
+// arena_reset, as voxel_buffer_swap does for its caller. what a frame needed beyond the arena's block is malloced
+// separately, and the block grows to the high water mark at the next reset, so steady frames never touch the heap.
+// threads that never swap must reset their own arena, or bracket their allocations with a mark and rewind.
+
+#define ARENA_ALIGNMENT 16
+
+typedef struct {
+    size_t used;                // this frame, so far
+    size_t high_water;          // the most any frame has used
+    size_t capacity;            // of the block, overflow aside
+    uint32_t mallocs;           // heap allocations since the arena began, block regrowth and overflow both
+} arena_stats_t;
+
+typedef struct {
+    size_t used;
+    size_t overflow_count;
+} arena_mark_t;
+
+// ARENA_ALIGNMENT aligned and uninitialised, valid until the calling thread's next reset or rewind past it
+void* arena_alloc(size_t size);
+
+void arena_reset(void);
+
+// rewinding frees everything allocated since the mark, on the same thread
+arena_mark_t arena_mark(void);
+void arena_rewind(arena_mark_t mark);
+
+arena_stats_t arena_get_stats(void);
+
+// returns the calling thread's arena to the heap, it starts over empty if used again
+void arena_destroy(void);
+
+#endif
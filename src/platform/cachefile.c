@@ -0,0 +1,41 @@
+#include <stdio.h>
+#include <linux/limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "cachefile.h"
+
+bool cache_is_current(const char* filename, const char* cachename) {
+    struct stat source, cache;
+    if (stat(filename, &source) != 0 || stat(cachename, &cache) != 0) {
+        return false;
+    }
+
+    if (cache.st_mtim.tv_sec != source.st_mtim.tv_sec) {
+        return cache.st_mtim.tv_sec > source.st_mtim.tv_sec;
+    }
+    return cache.st_mtim.tv_nsec >= source.st_mtim.tv_nsec;
+}
+
+bool file_write_atomic(const char* filename, file_write_cb_t write, void* context) {
+    char tempname[PATH_MAX + 8];
+    int length = snprintf(tempname, sizeof(tempname), "%s.tmp", filename);
+    if (length <= 0 || (size_t)length >= sizeof(tempname)) {
+        return false;
+    }
+
+    bool written = false;
+    FILE* fd = fopen(tempname, "wb");
+    if (fd) {
+        written = write(fd, context);
+        written = (fclose(fd) == 0) && written;
+    }
+
+    if (written) {
+        written = rename(tempname, filename) == 0;
+    }
+    if (!written) {
+        unlink(tempname);
+    }
+    return written;
+}
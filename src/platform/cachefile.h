@@ -0,0 +1,19 @@
+#ifndef _CACHEFILE_H_
+#define _CACHEFILE_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+
+// what the .mvt, .mvm and .cvx files have in common: they're only trusted while they're newer than what they
+// were built from, and they're never seen half written
+
+// true if cachename exists and is no older than filename
+bool cache_is_current(const char* filename, const char* cachename);
+
+typedef bool (*file_write_cb_t)(FILE* fd, void* context);
+
+// write fills a file beside filename that's then renamed over it, so a reader sees the old file or the whole new
+// one. false, with nothing left behind, if write returns false or the file can't be made
+bool file_write_atomic(const char* filename, file_write_cb_t write, void* context);
+
+#endif
@@ -17,29 +17,176 @@
 #include "array.h"
 #include "image.h"
 
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 static triangle_state_t triangle_state;
 
-static void draw_triangle_flat(pixel_t* volume, const int* coordinate, const float* barycentric, const triangle_state_t* triangle) {
+static inline void draw_triangle_flat(pixel_t* volume, const int* coordinate, const float* barycentric, const triangle_state_t* triangle) {
     volume[VOXEL_INDEX(coordinate[0], coordinate[1], coordinate[2])] = triangle->colour;
 }
 
-static void draw_triangle_textured(pixel_t* volume, const int* coordinate, const float* barycentric, const triangle_state_t* triangle) {
+// triangles smaller than a voxel are textured from the level their uv extent covers, as that's the voxel's footprint
+static inline int tiny_texture_level(const triangle_state_t* triangle) {
+    const image_t* image = triangle->texture;
+    float footprint = 0;
+    for (int i = 0; i < 3; ++i) {
+        const float* a = triangle->texcoord[i];
+        const float* b = triangle->texcoord[(i + 1) % 3];
+        footprint = max(footprint, max(fabsf(b[0] - a[0]) * image->width, fabsf(b[1] - a[1]) * image->height));
+    }
+    return image_select_level(image, footprint);
+}
+
+static inline void draw_triangle_textured(pixel_t* volume, const int* coordinate, const float* barycentric, const triangle_state_t* triangle, int level) {
     bool masked = false;
 
     float texcoord[2] = {
         triangle->texcoord[0][0] * barycentric[0] + triangle->texcoord[1][0] * barycentric[1] + triangle->texcoord[2][0] * barycentric[2],
         triangle->texcoord[0][1] * barycentric[0] + triangle->texcoord[1][1] * barycentric[1] + triangle->texcoord[2][1] * barycentric[2]
     };
-    pixel_t colour = image_sample(triangle->texture, texcoord, &masked);
+    pixel_t colour = image_sample_level(triangle->texture, level, texcoord, &masked);
     
     if (!masked) {
         volume[VOXEL_INDEX(coordinate[0], coordinate[1], coordinate[2])] = colour;
     }
 }
 
+// texturing for whole triangles: one mip level picked from the uv derivatives,
+// and uvs in that level's texels stepped along each row in 16.16 fixed point
+typedef struct {
+    image_level_t level;
+    uint32_t wrap[2];       // size - 1 for power of two sizes, otherwise zero and wrapped with modulo
+    bool masked;
+    pixel_t key;
+    float texcoord[3][2];   // scaled to the level's texels
+    int64_t step[2];        // per voxel along a row
+    int64_t row[2];         // at the start of the current row
+} texture_walk_t;
+
+static inline void texture_walk_init(texture_walk_t* walk, const triangle_state_t* triangle, const float* dx, const float* dy) {
+    const image_t* image = triangle->texture;
+
+    float ddx[2], ddy[2];
+    for (int c = 0; c < 2; ++c) {
+        ddx[c] = triangle->texcoord[0][c] * dx[0] + triangle->texcoord[1][c] * dx[1] + triangle->texcoord[2][c] * dx[2];
+        ddy[c] = triangle->texcoord[0][c] * dy[0] + triangle->texcoord[1][c] * dy[1] + triangle->texcoord[2][c] * dy[2];
+    }
+    float footprint = max(max(fabsf(ddx[0]), fabsf(ddy[0])) * image->width, max(fabsf(ddx[1]), fabsf(ddy[1])) * image->height);
+
+    walk->level = image_get_level(image, image_select_level(image, footprint));
+    walk->wrap[0] = (walk->level.width & (walk->level.width - 1)) ? 0 : walk->level.width - 1;
+    walk->wrap[1] = (walk->level.height & (walk->level.height - 1)) ? 0 : walk->level.height - 1;
+    walk->masked = image->masked;
+    walk->key = image->key;
+
+    const float size[2] = {walk->level.width, walk->level.height};
+    for (int c = 0; c < 2; ++c) {
+        for (int i = 0; i < 3; ++i) {
+            walk->texcoord[i][c] = triangle->texcoord[i][c] * size[c];
+        }
+        walk->step[c] = llrintf(ddx[c] * size[c] * 65536.0f);
+    }
+}
+
+static inline void texture_walk_row(texture_walk_t* walk, const float* w) {
+    for (int c = 0; c < 2; ++c) {
+        float t = walk->texcoord[0][c] * w[0] + walk->texcoord[1][c] * w[1] + walk->texcoord[2][c] * w[2];
+        walk->row[c] = llrintf(t * 65536.0f);
+    }
+}
+
+static inline int texture_wrap(int t, uint32_t wrap, int size) {
+    return wrap ? (int)(t & wrap) : modulo(t, size);
+}
+
+static inline void texture_walk_voxel(pixel_t* volume, const int* coordinate, const texture_walk_t* walk, int x) {
+    if (!walk->level.data) {
+        volume[VOXEL_INDEX(coordinate[0], coordinate[1], coordinate[2])] = 0;
+        return;
+    }
+
+    int u = texture_wrap((int)((walk->row[0] + walk->step[0] * x) >> 16), walk->wrap[0], walk->level.width);
+    int v = texture_wrap((int)((walk->row[1] + walk->step[1] * x) >> 16), walk->wrap[1], walk->level.height);
+    pixel_t colour = walk->level.data[u + walk->level.width * ((walk->level.height - 1) - v)];
+
+    if (!walk->masked || colour != walk->key) {
+        volume[VOXEL_INDEX(coordinate[0], coordinate[1], coordinate[2])] = colour;
+    }
+}
+
+graphics_span_shader_t graphics_triangle_shader_cb = NULL;
+
+const graphics_box_t graphics_volume_box = {{0, 0, 0}, {VOXELS_X, VOXELS_Y, VOXELS_Z}};
+const graphics_box_t graphics_cylinder_box = {{0, 0, 0}, {VOXELS_X, VOXELS_Y, VOXELS_Z}, true};
+
+// voxel i spans [i, i+1), so this is the radius about the middle of the volume that matches voxel_in_cylinder
+#define CYLINDER_RADIUS ((VOXELS_X + VOXELS_Y) * 0.25f)
+
+graphics_cull_t graphics_cull_sphere(const graphics_sphere_t* sphere) {
+    const float radius = sphere->radius + 1.0f;
+
+    if (sphere->centre[2] + radius < 0 || sphere->centre[2] - radius > VOXELS_Z) {
+        return GRAPHICS_CULL_OUTSIDE;
+    }
+
+    float dx = sphere->centre[0] - VOXELS_X * 0.5f;
+    float dy = sphere->centre[1] - VOXELS_Y * 0.5f;
+    float distsq = dx * dx + dy * dy;
+    if (distsq > sqr(CYLINDER_RADIUS + radius)) {
+        return GRAPHICS_CULL_OUTSIDE;
+    }
+
+    if (radius < CYLINDER_RADIUS && distsq < sqr(CYLINDER_RADIUS - radius)) {
+        return GRAPHICS_CULL_INSIDE;
+    }
+
+    return GRAPHICS_CULL_INTERSECTS;
+}
+
+graphics_sphere_t graphics_sphere_transform(const graphics_sphere_t* sphere, const float* matrix) {
+    graphics_sphere_t transformed;
+    vec3_transform(transformed.centre, sphere->centre, matrix);
 
-graphics_draw_voxel_cb_t graphics_triangle_shader_cb = NULL;
-static graphics_draw_voxel_cb_t draw_voxel_cb = draw_triangle_flat;
+    // the longest basis vector is the largest scale when they're orthogonal, otherwise fall back on the sum of them all
+    float lengthsq[3];
+    for (int i = 0; i < 3; ++i) {
+        lengthsq[i] = vec3_dot(&matrix[i*4], &matrix[i*4]);
+    }
+    float total = lengthsq[0] + lengthsq[1] + lengthsq[2];
+    float skew = fabsf(vec3_dot(&matrix[0], &matrix[4])) + fabsf(vec3_dot(&matrix[4], &matrix[8])) + fabsf(vec3_dot(&matrix[8], &matrix[0]));
+    float scalesq = (skew > total * 1e-4f) ? total : max(lengthsq[0], max(lengthsq[1], lengthsq[2]));
+
+    transformed.radius = sphere->radius * sqrtf(scalesq);
+    return transformed;
+}
+
+// the voxels along a horizontal axis that are inside the display cylinder, on the row at coordinate along the other one
+static inline bool cylinder_row(int axis, int coordinate, int* lo, int* hi) {
+    const int diameter = (VOXELS_X + VOXELS_Y) / 2;
+    const int size[2] = {VOXELS_X, VOXELS_Y};
+
+    int offset = coordinate * 2 - (size[axis ^ 1] - 1);
+    int remaining = diameter * diameter - offset * offset;
+    if (remaining < 0) {
+        return false;
+    }
+
+    int half = (int)sqrtf((float)remaining);
+    while (half * half > remaining) {
+        --half;
+    }
+    while ((half + 1) * (half + 1) <= remaining) {
+        ++half;
+    }
+
+    *lo = max(0, (size[axis] - 1 - half + 1) >> 1);
+    *hi = min(size[axis] - 1, (size[axis] - 1 + half) >> 1);
+    return *lo <= *hi;
+}
 
 
 #ifdef TRIANGLE_DITHER
@@ -83,6 +230,92 @@ float* vec3_transform(float* vdst, const float* vsrc, const float* matrix) {
 	return vdst;
 }
 
+// the batch transform does four positions at a time, leaving any remainder to vec3_transform
+#define TRANSFORM_LANES 4
+
+#if defined(__ARM_NEON)
+
+static inline void transform_lanes(float* transformed, uint8_t* outcodes, const float* x, const float* y, const float* z, const float* matrix) {
+    float32x4_t px = vld1q_f32(x);
+    float32x4_t py = vld1q_f32(y);
+    float32x4_t pz = vld1q_f32(z);
+
+    // summed in the same order as vec3_transform so the results match it exactly
+    float32x4x3_t t;
+    for (int i = 0; i < 3; ++i) {
+        t.val[i] = vaddq_f32(vaddq_f32(vaddq_f32(vmulq_n_f32(px, matrix[i]), vmulq_n_f32(py, matrix[i+4])), vmulq_n_f32(pz, matrix[i+8])), vdupq_n_f32(matrix[i+12]));
+    }
+    vst3q_f32(transformed, t);
+
+    const float size[3] = {VOXELS_X, VOXELS_Y, VOXELS_Z};
+    uint32x4_t code = vdupq_n_u32(0);
+    for (int i = 0; i < 3; ++i) {
+        code = vorrq_u32(code, vandq_u32(vcltq_f32(t.val[i], vdupq_n_f32(0)), vdupq_n_u32(1 << (i*2))));
+        code = vorrq_u32(code, vandq_u32(vcgeq_f32(t.val[i], vdupq_n_f32(size[i])), vdupq_n_u32(2 << (i*2))));
+    }
+    uint8x8_t bytes = vmovn_u16(vcombine_u16(vmovn_u32(code), vdup_n_u16(0)));
+    vst1_lane_u32((uint32_t*)outcodes, vreinterpret_u32_u8(bytes), 0);
+}
+
+#elif defined(__SSE2__)
+
+static inline void transform_lanes(float* transformed, uint8_t* outcodes, const float* x, const float* y, const float* z, const float* matrix) {
+    __m128 px = _mm_loadu_ps(x);
+    __m128 py = _mm_loadu_ps(y);
+    __m128 pz = _mm_loadu_ps(z);
+
+    // summed in the same order as vec3_transform so the results match it exactly
+    __m128 t[3];
+    for (int i = 0; i < 3; ++i) {
+        t[i] = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(matrix[i])), _mm_mul_ps(py, _mm_set1_ps(matrix[i+4]))),
+                                     _mm_mul_ps(pz, _mm_set1_ps(matrix[i+8]))), _mm_set1_ps(matrix[i+12]));
+    }
+
+    // x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3
+    __m128 xy_lo = _mm_unpacklo_ps(t[0], t[1]);
+    __m128 xy_hi = _mm_unpackhi_ps(t[0], t[1]);
+    __m128 zx_lo = _mm_shuffle_ps(t[2], t[0], _MM_SHUFFLE(1, 1, 0, 0));
+    __m128 yz_lo = _mm_shuffle_ps(t[1], t[2], _MM_SHUFFLE(1, 1, 1, 1));
+    __m128 zx_hi = _mm_shuffle_ps(t[2], t[0], _MM_SHUFFLE(3, 3, 2, 2));
+    __m128 yz_hi = _mm_shuffle_ps(t[1], t[2], _MM_SHUFFLE(3, 3, 3, 3));
+    _mm_storeu_ps(&transformed[0], _mm_shuffle_ps(xy_lo, zx_lo, _MM_SHUFFLE(2, 0, 1, 0)));
+    _mm_storeu_ps(&transformed[4], _mm_shuffle_ps(yz_lo, xy_hi, _MM_SHUFFLE(1, 0, 2, 0)));
+    _mm_storeu_ps(&transformed[8], _mm_shuffle_ps(zx_hi, yz_hi, _MM_SHUFFLE(2, 0, 2, 0)));
+
+    const float size[3] = {VOXELS_X, VOXELS_Y, VOXELS_Z};
+    __m128i code = _mm_setzero_si128();
+    for (int i = 0; i < 3; ++i) {
+        code = _mm_or_si128(code, _mm_and_si128(_mm_castps_si128(_mm_cmplt_ps(t[i], _mm_setzero_ps())), _mm_set1_epi32(1 << (i*2))));
+        code = _mm_or_si128(code, _mm_and_si128(_mm_castps_si128(_mm_cmpge_ps(t[i], _mm_set1_ps(size[i]))), _mm_set1_epi32(2 << (i*2))));
+    }
+    code = _mm_packs_epi32(code, code);
+    code = _mm_packus_epi16(code, code);
+    uint32_t packed = _mm_cvtsi128_si32(code);
+    memcpy(outcodes, &packed, sizeof(packed));
+}
+
+#else
+
+static inline void transform_lanes(float* transformed, uint8_t* outcodes, const float* x, const float* y, const float* z, const float* matrix) {
+    for (int i = 0; i < TRANSFORM_LANES; ++i) {
+        vec3_transform(&transformed[i * VEC3_SIZE], (float[VEC3_SIZE]){x[i], y[i], z[i]}, matrix);
+        outcodes[i] = graphics_outcode(&transformed[i * VEC3_SIZE]);
+    }
+}
+
+#endif
+
+void graphics_transform_positions(float* transformed, uint8_t* outcodes, const float* const* positions, uint32_t count, const float* matrix) {
+    uint32_t i = 0;
+    for (; i + TRANSFORM_LANES <= count; i += TRANSFORM_LANES) {
+        transform_lanes(&transformed[i * VEC3_SIZE], &outcodes[i], &positions[0][i], &positions[1][i], &positions[2][i], matrix);
+    }
+    for (; i < count; ++i) {
+        vec3_transform(&transformed[i * VEC3_SIZE], (float[VEC3_SIZE]){positions[0][i], positions[1][i], positions[2][i]}, matrix);
+        outcodes[i] = graphics_outcode(&transformed[i * VEC3_SIZE]);
+    }
+}
+
 float* mat4_apply_scale(float* matrix, const float* scale) {
     for (int i = 0; i < 12; ++i) {
         matrix[i] *= scale[i/4];
@@ -205,68 +438,117 @@ static void sort_channels(float* axis, int* xchannel, int* ychannel, int* zchann
     }*/ 
 }
 
-static void draw_line_(pixel_t* volume, float x0, float x1, float y0, float y1, float z0, float z1, uint x_stride, uint y_stride, uint z_stride, pixel_t colour) {
-    float x = x0;
-    float y = y0;
-    float z = z0;
-    float dx = x1 - x0;
-    float dy = y1 - y0;
-    float dz = z1 - z0;
-    float edy = fabsf(dy / dx);
-    float edz = fabsf(dz / dx);
-    float sdy, sdz;
-
-    float ey = (0.5f - fmodf(x0, 1.0f)) * edy + fmodf(y0, 1.0f);
-    if (dy >= 0) {
-        sdy = 1.0f;
-        ey -= 1.0f;
+// a minor axis of a line. it steps with the float error term lines have always been drawn with, so the voxels
+// chosen, ties included, are exactly the ones they always were; only finding the voxel is cheaper
+typedef struct {
+    float position;
+    float error;
+    float step;
+    float direction;
+} line_axis_t;
+
+static inline void line_axis_init(line_axis_t* axis, float p0, float p1, float major_delta, float major_offset) {
+    axis->position = p0;
+    axis->step = fabsf((p1 - p0) / major_delta);
+    axis->error = major_offset * axis->step + (p0 - truncf(p0));
+    if (p1 - p0 >= 0) {
+        axis->direction = 1.0f;
+        axis->error -= 1.0f;
     } else {
-        sdy = -1.0f;
-        ey = -ey;
+        // lines heading down are sampled mirrored about the start of the line
+        axis->direction = -1.0f;
+        axis->error = -axis->error;
     }
-    
-    float ez = (0.5f - fmodf(x0, 1.0f)) * edz + fmodf(z0, 1.0f);
-    if (dz >= 0) {
-        sdz = 1.0f;
-        ez -= 1.0f;
-    } else {
-        sdz = -1.0f;
-        ez = -ez;
+}
+
+// the error never gets more than one voxel ahead, as a minor axis moves no faster than the major one, so
+// stepping is a select rather than a hard to predict branch
+static inline int line_axis_settle(line_axis_t* axis) {
+    const float move = axis->error > 0 ? 1.0f : 0.0f;
+    axis->position += move * axis->direction;
+    axis->error -= move;
+    return (int)axis->position;
+}
+
+// a minor axis only ever moves one way, so once it's out of the box in that direction it stays out
+static inline bool line_axis_past(const line_axis_t* axis, int position, int lo, int hi) {
+    return (axis->direction > 0) ? position >= hi : position < lo;
+}
+
+static void draw_line_(pixel_t* volume, float x0, float x1, float y0, float y1, float z0, float z1, const int* stride, const int* lo, const int* hi, pixel_t colour) {
+    // the middle of the first major voxel, relative to the start of the line
+    const float offset = 0.5f - (x0 - truncf(x0));
+
+    line_axis_t y, z;
+    line_axis_init(&y, y0, y1, x1 - x0, offset);
+    line_axis_init(&z, z0, z1, x1 - x0, offset);
+
+    const uint xextent = hi[0] - lo[0];
+    const uint yextent = hi[1] - lo[1];
+    const uint zextent = hi[2] - lo[2];
+
+    // a line binned into several tiles is walked once per tile, so up to where this box starts along x only the
+    // error terms move. they step exactly as they would drawing, so the voxels chosen after are the same
+    float x = x0;
+    for (; x < x1 && (int)x < lo[0]; ++x) {
+        line_axis_settle(&y);
+        line_axis_settle(&z);
+        y.error += y.step;
+        z.error += z.step;
     }
 
-    while (x < x1) {
-        while (ey > 0) {
-            y += sdy;
-            --ey;
-        }
-        while (ez > 0) {
-            z += sdz;
-            --ez;
-        }
-        
-        uint idx = (int)x * x_stride + (int)y * y_stride + (int)z * z_stride;
-        if (idx < VOXELS_COUNT) {
-            volume[idx] = colour;
+    for (; x < x1; ++x) {
+        int ix = (int)x;
+        int iy = line_axis_settle(&y);
+        int iz = line_axis_settle(&z);
+
+        if ((uint)(ix - lo[0]) < xextent && (uint)(iy - lo[1]) < yextent && (uint)(iz - lo[2]) < zextent) {
+            volume[ix * stride[0] + iy * stride[1] + iz * stride[2]] = colour;
+        } else if (ix >= hi[0] || line_axis_past(&y, iy, lo[1], hi[1]) || line_axis_past(&z, iz, lo[2], hi[2])) {
+            // left the box for good
+            break;
         }
-        
-        ++x;
-        ey += edy;
-        ez += edz;
+
+        y.error += y.step;
+        z.error += z.step;
     }
 }
 
-void graphics_draw_line(pixel_t* volume, const float* pone, const float* ptwo, pixel_t colour) {
+static inline uint line_outcode(const float* p) {
+    return (p[0] < 0) | (p[0] > VOXELS_X-1) << 1
+         | (p[1] < 0) << 2 | (p[1] > VOXELS_Y-1) << 3
+         | (p[2] < 0) << 4 | (p[2] > VOXELS_Z-1) << 5;
+}
+
+static void draw_segment(pixel_t* volume, const float* pone, const float* ptwo, uint outcode, pixel_t colour, const graphics_box_t* box) {
     vec3_t one = {.x=pone[0], .y=pone[1], .z=pone[2]};
     vec3_t two = {.x=ptwo[0], .y=ptwo[1], .z=ptwo[2]};
 
-    if (clip(one.v, two.v, 0, VOXELS_X-1)) {
-        return;
-    }
-    if (clip(one.v, two.v, 1, VOXELS_Y-1)) {
-        return;
+    // outcode is the union of both ends' outcodes; nothing to clip if it's zero
+    if (outcode) {
+        if (clip(one.v, two.v, 0, VOXELS_X-1)) {
+            return;
+        }
+        if (clip(one.v, two.v, 1, VOXELS_Y-1)) {
+            return;
+        }
+        if (clip(one.v, two.v, 2, VOXELS_Z-1)) {
+            return;
+        }
+
+        // clipping one axis can push an earlier one a hair outside, which would shift the whole line by a voxel
+        const float lo[VEC3_SIZE] = {0, 0, 0};
+        const float hi[VEC3_SIZE] = {VOXELS_X-1, VOXELS_Y-1, VOXELS_Z-1};
+        vec3_max(one.v, one.v, lo);
+        vec3_min(one.v, one.v, hi);
+        vec3_max(two.v, two.v, lo);
+        vec3_min(two.v, two.v, hi);
     }
-    if (clip(one.v, two.v, 2, VOXELS_Z-1)) {
-        return;
+
+    for (int i = 0; i < VEC3_SIZE; ++i) {
+        if (min(one.v[i], two.v[i]) >= box->max[i] || max(one.v[i], two.v[i]) + 1.0f < box->min[i]) {
+            return;
+        }
     }
 
     float delta[VEC3_SIZE];
@@ -276,16 +558,213 @@ void graphics_draw_line(pixel_t* volume, const float* pone, const float* ptwo, p
     int c[3];
     sort_channels(delta, &c[0], &c[1], &c[2]);
 
-    const uint stride[3] = {VOXEL_X_STRIDE, VOXEL_Y_STRIDE, VOXEL_Z_STRIDE};
+    const int stride[3] = {VOXEL_X_STRIDE, VOXEL_Y_STRIDE, VOXEL_Z_STRIDE};
+    const int axis_stride[3] = {stride[c[2]], stride[c[1]], stride[c[0]]};
+    const int lo[3] = {box->min[c[2]], box->min[c[1]], box->min[c[0]]};
+    const int hi[3] = {box->max[c[2]], box->max[c[1]], box->max[c[0]]};
     if (one.v[c[2]] < two.v[c[2]]) {
-        draw_line_(volume, one.v[c[2]], two.v[c[2]], one.v[c[1]], two.v[c[1]], one.v[c[0]], two.v[c[0]], stride[c[2]], stride[c[1]], stride[c[0]], colour);
+        draw_line_(volume, one.v[c[2]], two.v[c[2]], one.v[c[1]], two.v[c[1]], one.v[c[0]], two.v[c[0]], axis_stride, lo, hi, colour);
     } else {
-        draw_line_(volume, two.v[c[2]], one.v[c[2]], two.v[c[1]], one.v[c[1]], two.v[c[0]], one.v[c[0]], stride[c[2]], stride[c[1]], stride[c[0]], colour);
+        draw_line_(volume, two.v[c[2]], one.v[c[2]], two.v[c[1]], one.v[c[1]], two.v[c[0]], one.v[c[0]], axis_stride, lo, hi, colour);
     }
 }
 
+void graphics_draw_line(pixel_t* volume, const float* one, const float* two, pixel_t colour) {
+    graphics_draw_line_clipped(volume, one, two, colour, &graphics_volume_box);
+}
+
+void graphics_draw_line_clipped(pixel_t* volume, const float* one, const float* two, pixel_t colour, const graphics_box_t* box) {
+    uint outcode[2] = {line_outcode(one), line_outcode(two)};
+    if (!(outcode[0] & outcode[1])) {
+        draw_segment(volume, one, two, outcode[0] | outcode[1], colour, box);
+    }
+}
+
+void graphics_draw_edges(pixel_t* volume, const float* positions, const edge_t* edges, uint32_t edge_count) {
+    graphics_draw_edges_clipped(volume, positions, NULL, edges, edge_count, &graphics_volume_box);
+}
+
+void graphics_draw_edges_clipped(pixel_t* volume, const float* positions, const uint8_t* outcodes, const edge_t* edges, uint32_t edge_count, const graphics_box_t* box) {
+    for (uint i = 0; i < edge_count; ++i) {
+        if (outcodes && (outcodes[edges[i].index[0]] & outcodes[edges[i].index[1]])) {
+            continue;
+        }
+        const float* one = &positions[edges[i].index[0] * VEC3_SIZE];
+        const float* two = &positions[edges[i].index[1] * VEC3_SIZE];
+        uint outcode[2] = {line_outcode(one), line_outcode(two)};
+        if (!(outcode[0] & outcode[1])) {
+            draw_segment(volume, one, two, outcode[0] | outcode[1], edges[i].colour, box);
+        }
+    }
+}
+
+// each row of a triangle is walked as a single span: the edges' x intercepts are stepped in
+// 16.16 fixed point to bound the span, then the voxels in it are tested several at a time
+
+#define SPAN_EPSILON (-1e-5f)
+#define SPAN_MIN_SLOPE (1.0f / 4096.0f)
+#define SPAN_LANES 4
+
+typedef struct {
+    int64_t x[VEC3_SIZE];
+    int64_t step[VEC3_SIZE];
+    int side[VEC3_SIZE];
+} span_edges_t;
+
+static void span_edges_init(span_edges_t* edges, const float* w, const float* dx, const float* dy) {
+    for (int i = 0; i < VEC3_SIZE; ++i) {
+        if (fabsf(dx[i]) < SPAN_MIN_SLOPE) {
+            // too shallow to bound the span reliably, leave it to the per-voxel test
+            edges->side[i] = 0;
+            edges->x[i] = edges->step[i] = 0;
+        } else {
+            edges->side[i] = dx[i] > 0 ? 1 : -1;
+            edges->x[i] = (int64_t)llround(((double)SPAN_EPSILON - w[i]) / dx[i] * 65536.0);
+            edges->step[i] = (int64_t)llround(-(double)dy[i] / dx[i] * 65536.0);
+        }
+    }
+}
+
+static inline void span_edges_step(span_edges_t* edges) {
+    for (int i = 0; i < VEC3_SIZE; ++i) {
+        edges->x[i] += edges->step[i];
+    }
+}
+
+static inline bool span_edges_row(const span_edges_t* edges, int xrange, int* xmin, int* xmax) {
+    // pad by a voxel either side to soak up rounding, the per-voxel test has the final say
+    int64_t lo = 0;
+    int64_t hi = xrange - 1;
+    for (int i = 0; i < VEC3_SIZE; ++i) {
+        if (edges->side[i] > 0) {
+            lo = max(lo, ((edges->x[i] + 0xffff) >> 16) - 1);
+        } else if (edges->side[i] < 0) {
+            hi = min(hi, (edges->x[i] >> 16) + 1);
+        }
+    }
+    *xmin = (int)lo;
+    *xmax = (int)hi;
+    return lo <= hi;
+}
+
+// the barycentrics are stepped along the row one voxel at a time, as they always were, so coverage matches the
+// scalar rasteriser exactly. the vector paths add dx to the lanes one after another rather than multiplying,
+// which rounds the same way, and leave the depth to the caller. wrun is the next voxel's barycentrics, and
+// is advanced past the group
+
+#if defined(__ARM_NEON)
+
+static inline uint span_evaluate(float* wrun, const float* dx, float w[VEC3_SIZE][SPAN_LANES]) {
+    static const uint32_t later[SPAN_LANES - 1][SPAN_LANES] = {{0, ~0u, ~0u, ~0u}, {0, 0, ~0u, ~0u}, {0, 0, 0, ~0u}};
+    static const uint32_t bits[SPAN_LANES] = {1, 2, 4, 8};
+    float32x4_t e = vdupq_n_f32(SPAN_EPSILON);
+
+    uint32x4_t inside = vdupq_n_u32(~0u);
+    for (int c = 0; c < VEC3_SIZE; ++c) {
+        float32x4_t step = vdupq_n_f32(dx[c]);
+        float32x4_t v = vdupq_n_f32(wrun[c]);
+        for (int i = 0; i < SPAN_LANES - 1; ++i) {
+            v = vbslq_f32(vld1q_u32(later[i]), vaddq_f32(v, step), v);
+        }
+        inside = vandq_u32(inside, vcgeq_f32(v, e));
+        vst1q_f32(w[c], v);
+        wrun[c] = w[c][SPAN_LANES - 1] + dx[c];
+    }
+
+    uint32x4_t masked = vandq_u32(inside, vld1q_u32(bits));
+    uint32x2_t sum = vadd_u32(vget_low_u32(masked), vget_high_u32(masked));
+    return vget_lane_u32(vpadd_u32(sum, sum), 0);
+}
+
+#elif defined(__SSE2__)
+
+static inline uint span_evaluate(float* wrun, const float* dx, float w[VEC3_SIZE][SPAN_LANES]) {
+    const __m128 later[SPAN_LANES - 1] = {
+        _mm_castsi128_ps(_mm_set_epi32(~0, ~0, ~0, 0)),
+        _mm_castsi128_ps(_mm_set_epi32(~0, ~0, 0, 0)),
+        _mm_castsi128_ps(_mm_set_epi32(~0, 0, 0, 0))
+    };
+    __m128 e = _mm_set1_ps(SPAN_EPSILON);
+
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(~0));
+    for (int c = 0; c < VEC3_SIZE; ++c) {
+        __m128 step = _mm_set1_ps(dx[c]);
+        __m128 v = _mm_set1_ps(wrun[c]);
+        for (int i = 0; i < SPAN_LANES - 1; ++i) {
+            v = _mm_or_ps(_mm_and_ps(later[i], _mm_add_ps(v, step)), _mm_andnot_ps(later[i], v));
+        }
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(v, e));
+        _mm_storeu_ps(w[c], v);
+        wrun[c] = w[c][SPAN_LANES - 1] + dx[c];
+    }
+
+    return _mm_movemask_ps(inside);
+}
+
+#else
+
+static inline uint span_evaluate(float* wrun, const float* dx, float w[VEC3_SIZE][SPAN_LANES]) {
+    uint mask = 0;
+    for (int i = 0; i < SPAN_LANES; ++i) {
+        w[0][i] = wrun[0];
+        w[1][i] = wrun[1];
+        w[2][i] = wrun[2];
+        if (w[0][i] >= SPAN_EPSILON && w[1][i] >= SPAN_EPSILON && w[2][i] >= SPAN_EPSILON) {
+            mask |= 1u << i;
+        }
+        vec3_add(wrun, wrun, dx);
+    }
+    return mask;
+}
+
+#endif
+
+// the built-in shaders are expanded inline per voxel, custom shaders are called once per span
+typedef enum {
+    SHADE_FLAT,
+    SHADE_TEXTURED,
+    SHADE_CUSTOM
+} shade_t;
+
+static const int voxel_strides[VEC3_SIZE] = {VOXEL_X_STRIDE, VOXEL_Y_STRIDE, VOXEL_Z_STRIDE};
+
+#define SPAN_MAX_LENGTH (VOXELS_X > VOXELS_Y ? (VOXELS_X > VOXELS_Z ? VOXELS_X : VOXELS_Z) : (VOXELS_Y > VOXELS_Z ? VOXELS_Y : VOXELS_Z))
+
+static inline void span_emit(pixel_t* volume, graphics_span_t* span, int start, int length, const float* barycentric, const triangle_state_t* triangle, graphics_span_shader_t shader) {
+    span->coordinate[span->axis] = start;
+    span->coordinate[span->depth_axis] = 0;
+    span->index = VOXEL_INDEX(span->coordinate[0], span->coordinate[1], span->coordinate[2]);
+    span->coordinate[span->depth_axis] = span->depth[0];
+    span->length = length;
+    vec3_assign(span->barycentric, barycentric);
+    shader(volume, span, triangle);
+}
+
+static inline __attribute__((always_inline)) void shade_tiny(pixel_t* volume, const int* coordinate, const float* barycentric, const triangle_state_t* triangle, graphics_span_shader_t shader, const shade_t shade) {
+    if (shade == SHADE_CUSTOM) {
+        graphics_span_t span = {
+            .coordinate = {coordinate[0], coordinate[1], coordinate[2]},
+            .axis = 0, .depth_axis = 2,
+            .depth = &coordinate[2],
+            .axis_stride = VOXEL_X_STRIDE, .depth_stride = VOXEL_Z_STRIDE
+        };
+        span_emit(volume, &span, coordinate[0], 1, barycentric, triangle, shader);
+    } else if (shade == SHADE_TEXTURED) {
+        draw_triangle_textured(volume, coordinate, barycentric, triangle, tiny_texture_level(triangle));
+    } else {
+        draw_triangle_flat(volume, coordinate, barycentric, triangle);
+    }
+}
+
+static inline bool in_box(const int* pos, const graphics_box_t* box) {
+    return pos[0] >= box->min[0] && pos[0] < box->max[0]
+        && pos[1] >= box->min[1] && pos[1] < box->max[1]
+        && pos[2] >= box->min[2] && pos[2] < box->max[2]
+        && (!box->cylinder || voxel_in_cylinder(pos[0], pos[1]));
+}
+
 #ifdef TINY_TRIANGLES_CENTRED
-static void draw_tiny_triangle(pixel_t* volume, const float* v0, const float* v1, const float* v2, pixel_t colour) {
+static inline __attribute__((always_inline)) void draw_tiny_triangle(pixel_t* volume, const float* v0, const float* v1, const float* v2, const triangle_state_t* triangle, graphics_span_shader_t shader, const graphics_box_t* box, const shade_t shade) {
 
     int pos[VEC3_SIZE] = {
         (int)roundf((v0[0] + v1[0] + v2[0]) * (1.0f/3.0f)),
@@ -293,25 +772,25 @@ static void draw_tiny_triangle(pixel_t* volume, const float* v0, const float* v1
         (int)roundf((v0[2] + v1[2] + v2[2]) * (1.0f/3.0f)),
     };
 
-    if ((uint)pos[0] >= VOXELS_X || (uint)pos[1] >= VOXELS_Y || (uint)pos[2] >= VOXELS_Z) {
+    if ((uint)pos[0] >= VOXELS_X || (uint)pos[1] >= VOXELS_Y || (uint)pos[2] >= VOXELS_Z || !in_box(pos, box)) {
         return;
     }
 
     float bary[3] = {1.0f/3.0f, 1.0f/3.0f, 1.0f/3.0f};
 
-    draww_voxel_cb(volume, pos, bary, &triangle_state);
+    shade_tiny(volume, pos, bary, triangle, shader, shade);
 }
 #else
-static void draw_tiny_triangle(pixel_t* volume, const float* v0, const float* v1, const float* v2) {
+static inline __attribute__((always_inline)) void draw_tiny_triangle(pixel_t* volume, const float* v0, const float* v1, const float* v2, const triangle_state_t* triangle, graphics_span_shader_t shader, const graphics_box_t* box, const shade_t shade) {
 
     int pos[VEC3_SIZE] = {(int)v0[0], (int)v0[1], (int)v0[2]};
-    if ((uint)pos[0] >= VOXELS_X || (uint)pos[1] >= VOXELS_Y || (uint)pos[2] >= VOXELS_Z) {
+    if ((uint)pos[0] >= VOXELS_X || (uint)pos[1] >= VOXELS_Y || (uint)pos[2] >= VOXELS_Z || !in_box(pos, box)) {
         return;
     }
 
     float bary[3] = {1.0f, 0.0f, 0.0f};
 
-    draw_voxel_cb(volume, pos, bary, &triangle_state);
+    shade_tiny(volume, pos, bary, triangle, shader, shade);
 }
 #endif
 
@@ -321,25 +800,15 @@ void graphics_triangle_colour(pixel_t colour) {
 }
 
 void graphics_triangle_texture(const float* uv0, const float* uv1, const float* uv2, image_t* texture) {
-    vec3_assign(triangle_state.texcoord[0], uv0);
-    vec3_assign(triangle_state.texcoord[1], uv1);
-    vec3_assign(triangle_state.texcoord[2], uv2);
+    vec2_assign(triangle_state.texcoord[0], uv0);
+    vec2_assign(triangle_state.texcoord[1], uv1);
+    vec2_assign(triangle_state.texcoord[2], uv2);
     triangle_state.texture = texture;
 }
 
-void graphics_draw_triangle(pixel_t* volume, const float* v0, const float* v1, const float* v2) {
+static inline __attribute__((always_inline)) void rasterise_triangle(pixel_t* volume, const float* v0, const float* v1, const float* v2, const triangle_state_t* triangle, graphics_span_shader_t shader, const graphics_box_t* box, const shade_t shade) {
     // voxelise a triangle by rendering it on its most flat axis
 
-    if (graphics_triangle_shader_cb) {
-        draw_voxel_cb = graphics_triangle_shader_cb;
-    } else {
-        if (triangle_state.texture) {
-            draw_voxel_cb = draw_triangle_textured;
-        } else {
-            draw_voxel_cb = draw_triangle_flat;
-        }
-    }
-
     float ab_min[VEC3_SIZE];
     vec3_min(ab_min, v0, v1);
     vec3_min(ab_min, ab_min, v2);
@@ -354,6 +823,22 @@ void graphics_draw_triangle(pixel_t* volume, const float* v0, const float* v1, c
         return;
     }
 
+    for (int i = 0; i < VEC3_SIZE; ++i) {
+        // a voxel of slack for dithering and truncation
+        if (ab_min[i] - 1.0f >= box->max[i] || ab_max[i] + 1.0f < box->min[i]) {
+            return;
+        }
+    }
+
+    if (box->cylinder) {
+        // nearest point of the bounds to the cylinder's axis
+        float dx = clamp(VOXELS_X * 0.5f, ab_min[0], ab_max[0]) - VOXELS_X * 0.5f;
+        float dy = clamp(VOXELS_Y * 0.5f, ab_min[1], ab_max[1]) - VOXELS_Y * 0.5f;
+        if (dx * dx + dy * dy > sqr(CYLINDER_RADIUS + 1.0f)) {
+            return;
+        }
+    }
+
     float t1[VEC3_SIZE] = {v1[0]-v0[0], v1[1]-v0[1], v1[2]-v0[2]};
     float t2[VEC3_SIZE] = {v2[0]-v0[0], v2[1]-v0[1], v2[2]-v0[2]};
     float minor[VEC3_SIZE];
@@ -361,7 +846,7 @@ void graphics_draw_triangle(pixel_t* volume, const float* v0, const float* v1, c
 
     float areasq2 = vec3_dot(minor, minor);
     if (areasq2 < 4) {
-        draw_tiny_triangle(volume, v0, v1, v2);
+        draw_tiny_triangle(volume, v0, v1, v2, triangle, shader, box, shade);
         return;
     }
 
@@ -404,40 +889,178 @@ void graphics_draw_triangle(pixel_t* volume, const float* v0, const float* v1, c
 
     int xrange = (int)(ab_max[xchannel] - ab_min[xchannel] + 1.5f);
     int yrange = (int)(ab_max[ychannel] - ab_min[ychannel] + 1.5f);
-    const uint voxels_z = (uint[3]){VOXELS_X, VOXELS_Y, VOXELS_Z}[zchannel];
+
+    // restrict rows, spans and depth to the clip box without moving the origin the edges are evaluated from
+    const int xorigin = (int)floorf(ab_min[xchannel]);
+    const int yorigin = (int)floorf(ab_min[ychannel]);
+    const int xclip[2] = {box->min[xchannel] - xorigin, box->max[xchannel] - 1 - xorigin};
+    const int yclip[2] = {box->min[ychannel] - yorigin, min(yrange, box->max[ychannel] - yorigin)};
+    const int zmin = box->min[zchannel];
+    const uint zextent = box->max[zchannel] - box->min[zchannel];
+
+    // the cylinder narrows each row's span when it lies in the horizontal plane, or its depth when the row runs
+    // horizontally across the depth axis; otherwise the row is vertical and each voxel has to be tested
+    const bool cylinder_spans = box->cylinder && zchannel == 2;
+    const bool cylinder_depths = box->cylinder && xchannel == 2;
+    const bool cylinder_voxels = box->cylinder && ychannel == 2;
+
+    span_edges_t edges;
+    span_edges_init(&edges, w0, dx, dy);
+
+    const float depth[VEC3_SIZE] = {v0[zchannel], v1[zchannel], v2[zchannel]};
 
     int voxel[VEC3_SIZE];
-    voxel[ychannel] = (int)floorf(ab_min[ychannel]);
-
-    for (int y = 0; y < yrange; ++y) {
-        float w[VEC3_SIZE] = {w0[0], w0[1], w0[2]};
-
-        bool done = false;
-        voxel[xchannel] = (int)floorf(ab_min[xchannel]);
-        for (int x = 0; x < xrange; ++x) {
-            const float e = -1e-5f;
-            if (w[0] >= e && w[1] >= e && w[2] >= e) {
-                done = true;
-                
+    voxel[ychannel] = yorigin;
+
+    texture_walk_t texture;
+    if (shade == SHADE_TEXTURED) {
+        texture_walk_init(&texture, triangle, dx, dy);
+    }
+
+    // custom shaders get the covered voxels of a row gathered into contiguous runs
+    int span_depth[SPAN_MAX_LENGTH];
+    graphics_span_t span = {
+        .axis = xchannel, .depth_axis = zchannel, .depth = span_depth,
+        .axis_stride = voxel_strides[xchannel], .depth_stride = voxel_strides[zchannel],
+        .step = {dx[0], dx[1], dx[2]}
+    };
+    float span_barycentric[VEC3_SIZE];
+    int span_start = 0;
+    int span_length = 0;
+
+    for (int y = 0; y < yclip[1]; ++y) {
+        int xmin, xmax;
+        int row_zmin = zmin;
+        uint row_zextent = zextent;
+        int lo, hi;
+        if (y >= yclip[0] && span_edges_row(&edges, xrange, &xmin, &xmax)
+            && (!(cylinder_spans || cylinder_depths) || cylinder_row(cylinder_spans ? xchannel : zchannel, voxel[ychannel], &lo, &hi))) {
+            xmin = max(xmin, xclip[0]);
+            xmax = min(xmax, xclip[1]);
+            if (cylinder_spans) {
+                xmin = max(xmin, lo - xorigin);
+                xmax = min(xmax, hi - xorigin);
+            } else if (cylinder_depths) {
+                row_zmin = max(zmin, lo);
+                row_zextent = max(0, min(zmin + (int)zextent, hi + 1) - row_zmin);
+            }
+            span.coordinate[ychannel] = voxel[ychannel];
+            if (shade == SHADE_TEXTURED) {
+                texture_walk_row(&texture, w0);
+            }
+
+            // step up to the start of the span the same way
+            float wrun[VEC3_SIZE] = {w0[0], w0[1], w0[2]};
+            for (int x = 0; x < xmin; ++x) {
+                wrun[0] += dx[0];
+                wrun[1] += dx[1];
+                wrun[2] += dx[2];
+            }
+
+            for (int x = xmin; x <= xmax; x += SPAN_LANES) {
+                float w[VEC3_SIZE][SPAN_LANES];
+                uint mask = span_evaluate(wrun, dx, w);
+                if (xmax - x < SPAN_LANES - 1) {
+                    mask &= (1u << (xmax - x + 1)) - 1;
+                }
+
+                for (int i = 0; mask; ++i, mask >>= 1) {
+                    if (!(mask & 1)) {
+                        continue;
+                    }
 #ifdef TRIANGLE_DITHER
-                float dither = ((float)(((x&1)<<1)|(y&1)) - 1.5f) * graphics_triangle_fuzz;
+                    float dither = ((float)((((x+i)&1)<<1)|(y&1)) - 1.5f) * graphics_triangle_fuzz;
 #else
-                const float dither = 0;
+                    const float dither = 0;
 #endif
-                voxel[zchannel] = (int)floorf(v0[zchannel] * w[0] + v1[zchannel] * w[1] + v2[zchannel] * w[2] + dither);
-                if ((uint)voxel[zchannel] < voxels_z) {
-                    draw_voxel_cb(volume, voxel, w, &triangle_state);
+                    int z = (int)floorf(depth[0] * w[0][i] + depth[1] * w[1][i] + depth[2] * w[2][i] + dither);
+                    if ((uint)(z - row_zmin) < row_zextent) {
+                        voxel[xchannel] = xorigin + x + i;
+                        voxel[zchannel] = z;
+                        if (cylinder_voxels && !voxel_in_cylinder(voxel[0], voxel[1])) {
+                            continue;
+                        }
+                        if (shade == SHADE_CUSTOM) {
+                            if (span_length && voxel[xchannel] != span_start + span_length) {
+                                span_emit(volume, &span, span_start, span_length, span_barycentric, triangle, shader);
+                                span_length = 0;
+                            }
+                            if (!span_length) {
+                                span_start = voxel[xchannel];
+                                span_barycentric[0] = w[0][i];
+                                span_barycentric[1] = w[1][i];
+                                span_barycentric[2] = w[2][i];
+                            }
+                            span_depth[span_length++] = z;
+                        } else if (shade == SHADE_TEXTURED) {
+                            texture_walk_voxel(volume, voxel, &texture, x + i);
+                        } else {
+                            draw_triangle_flat(volume, voxel, (float[VEC3_SIZE]){w[0][i], w[1][i], w[2][i]}, triangle);
+                        }
+                    }
                 }
-            } else if (done) {
-                break;
             }
 
-            vec3_add(w, w, dx);
-            voxel[xchannel] += 1.0f;
+            if (shade == SHADE_CUSTOM && span_length) {
+                span_emit(volume, &span, span_start, span_length, span_barycentric, triangle, shader);
+                span_length = 0;
+            }
         }
+
+        span_edges_step(&edges);
         vec3_add(w0, w0, dy);
-        voxel[ychannel] += 1.0f;
+        voxel[ychannel] += 1;
+    }
+}
+
+static void rasterise_flat(pixel_t* volume, const float* v0, const float* v1, const float* v2, const triangle_state_t* triangle, graphics_span_shader_t shader, const graphics_box_t* box) {
+    rasterise_triangle(volume, v0, v1, v2, triangle, shader, box, SHADE_FLAT);
+}
+
+static void rasterise_textured(pixel_t* volume, const float* v0, const float* v1, const float* v2, const triangle_state_t* triangle, graphics_span_shader_t shader, const graphics_box_t* box) {
+    rasterise_triangle(volume, v0, v1, v2, triangle, shader, box, SHADE_TEXTURED);
+}
+
+static void rasterise_custom(pixel_t* volume, const float* v0, const float* v1, const float* v2, const triangle_state_t* triangle, graphics_span_shader_t shader, const graphics_box_t* box) {
+    rasterise_triangle(volume, v0, v1, v2, triangle, shader, box, SHADE_CUSTOM);
+}
+
+typedef void (*rasterise_t)(pixel_t* volume, const float* v0, const float* v1, const float* v2, const triangle_state_t* triangle, graphics_span_shader_t shader, const graphics_box_t* box);
+
+static rasterise_t select_rasteriser(graphics_span_shader_t shader, const triangle_state_t* triangle) {
+    if (shader) {
+        return rasterise_custom;
     }
+    return triangle->texture ? rasterise_textured : rasterise_flat;
 }
 
+void graphics_draw_triangle(pixel_t* volume, const float* v0, const float* v1, const float* v2) {
+    graphics_draw_triangle_clipped(volume, v0, v1, v2, &triangle_state, graphics_triangle_shader_cb, &graphics_volume_box);
+}
 
+void graphics_draw_triangle_clipped(pixel_t* volume, const float* v0, const float* v1, const float* v2, const triangle_state_t* triangle, graphics_span_shader_t shader, const graphics_box_t* box) {
+    select_rasteriser(shader, triangle)(volume, v0, v1, v2, triangle, shader, box);
+}
+
+void graphics_draw_triangles_clipped(pixel_t* volume, const float* positions, const uint8_t* outcodes, const float* texcoords, uint32_t texcoord_stride, const index_t* indices, uint32_t index_count, const graphics_material_t* material, const graphics_box_t* box) {
+    triangle_state_t triangle = {.colour = material->colour, .texture = material->texture};
+    rasterise_t rasterise = select_rasteriser(material->shader, &triangle);
+
+    for (uint t = 2; t < index_count; t += 3) {
+        const index_t* index = &indices[t-2];
+        if (outcodes && (outcodes[index[0]] & outcodes[index[1]] & outcodes[index[2]])) {
+            continue;
+        }
+        if (texcoords) {
+            for (int i = 0; i < 3; ++i) {
+                triangle.texcoord[i][0] = texcoords[index[i] * texcoord_stride + 0];
+                triangle.texcoord[i][1] = texcoords[index[i] * texcoord_stride + 1];
+            }
+        }
+        rasterise(volume, &positions[index[0] * VEC3_SIZE], &positions[index[1] * VEC3_SIZE], &positions[index[2] * VEC3_SIZE], &triangle, material->shader, box);
+    }
+}
+
+void graphics_draw_triangles(pixel_t* volume, const float* positions, const float* texcoords, uint32_t texcoord_stride, const index_t* indices, uint32_t index_count, const graphics_material_t* material) {
+    graphics_draw_triangles_clipped(volume, positions, NULL, texcoords, texcoord_stride, indices, index_count, material, &graphics_volume_box);
+}
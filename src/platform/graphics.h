@@ -12,10 +12,85 @@ typedef struct {
     struct image_s* texture;
 } triangle_state_t;
 
-typedef void (*graphics_draw_voxel_cb_t)(pixel_t* volume, const int* coordinate, const float* barycentric, const triangle_state_t* triangle);
-extern graphics_draw_voxel_cb_t graphics_triangle_shader_cb;
+// a run of covered voxels along one axis of a triangle's rasterisation plane
+typedef struct {
+    int coordinate[3];      // first voxel of the run
+    int axis;               // advances by one voxel per step
+    int depth_axis;         // taken from depth[] per voxel
+    int length;
+    const int* depth;
+    uint32_t index;         // VOXEL_INDEX of the first voxel at depth zero
+    int axis_stride;
+    int depth_stride;
+    float barycentric[3];   // at the first voxel
+    float step[3];          // barycentric increment per voxel
+} graphics_span_t;
+
+// custom shaders are called once per span; NULL selects the built-in flat or textured shading
+typedef void (*graphics_span_shader_t)(pixel_t* volume, const graphics_span_t* span, const triangle_state_t* triangle);
+extern graphics_span_shader_t graphics_triangle_shader_cb;
+
+static inline void graphics_span_voxel(const graphics_span_t* span, int i, int* coordinate) {
+    coordinate[0] = span->coordinate[0];
+    coordinate[1] = span->coordinate[1];
+    coordinate[2] = span->coordinate[2];
+    coordinate[span->axis] += i;
+    coordinate[span->depth_axis] = span->depth[i];
+}
+
+static inline uint32_t graphics_span_index(const graphics_span_t* span, int i) {
+    return span->index + i * span->axis_stride + span->depth[i] * span->depth_stride;
+}
+
+typedef struct {
+    index_t index[2];
+    pixel_t colour;
+} edge_t;
+
+// half-open range of voxels that drawing is restricted to
+typedef struct {
+    int min[3];
+    int max[3];
+    bool cylinder;          // triangles are further restricted to the voxels inside the display cylinder
+} graphics_box_t;
+
+extern const graphics_box_t graphics_volume_box;
+extern const graphics_box_t graphics_cylinder_box;
+
+typedef struct {
+    float centre[3];
+    float radius;
+} graphics_sphere_t;
+
+typedef enum {
+    GRAPHICS_CULL_OUTSIDE,
+    GRAPHICS_CULL_INTERSECTS,
+    GRAPHICS_CULL_INSIDE
+} graphics_cull_t;
+
+// where a sphere in volume space lies relative to the display cylinder, with a voxel of slack either way
+graphics_cull_t graphics_cull_sphere(const graphics_sphere_t* sphere);
+graphics_sphere_t graphics_sphere_transform(const graphics_sphere_t* sphere, const float* matrix);
+
+// per-batch shading: a flat colour, a texture, or a custom shader
+typedef struct {
+    pixel_t colour;
+    struct image_s* texture;
+    graphics_span_shader_t shader;
+} graphics_material_t;
 
 float* vec3_transform(float* vdst, const float* vsrc, const float* matrix);
+
+// a bit per side of the volume that a position lies beyond: 1<<(axis*2) below zero, 2<<(axis*2) at or past its size.
+// a triangle or line whose ends all share a bit can't touch the volume
+static inline uint8_t graphics_outcode(const float* p) {
+    return (p[0] < 0) | (p[0] >= VOXELS_X) << 1
+         | (p[1] < 0) << 2 | (p[1] >= VOXELS_Y) << 3
+         | (p[2] < 0) << 4 | (p[2] >= VOXELS_Z) << 5;
+}
+
+// transforms count positions held as separate x, y and z arrays into xyz triples, with the outcode of each
+void graphics_transform_positions(float* transformed, uint8_t* outcodes, const float* const* positions, uint32_t count, const float* matrix);
 float* mat4_apply_scale(float* matrix, const float* scale);
 float* mat4_apply_scale_f(float* matrix, float scale);
 float* mat4_apply_translation(float* matrix, const float* vector);
@@ -29,4 +104,17 @@ void graphics_triangle_colour(pixel_t colour);
 void graphics_triangle_texture(const float* uv0, const float* uv1, const float* uv2, struct image_s* texture);
 void graphics_draw_triangle(pixel_t* volume, const float* v0, const float* v1, const float* v2);
 
+// stateless versions, safe to call from several threads as long as their clip boxes don't overlap
+void graphics_draw_line_clipped(pixel_t* volume, const float* one, const float* two, pixel_t colour, const graphics_box_t* clip);
+
+// lines between indexed positions, sharing the endpoints' clip tests
+void graphics_draw_edges(pixel_t* volume, const float* positions, const edge_t* edges, uint32_t edge_count);
+void graphics_draw_edges_clipped(pixel_t* volume, const float* positions, const uint8_t* outcodes, const edge_t* edges, uint32_t edge_count, const graphics_box_t* clip);
+void graphics_draw_triangle_clipped(pixel_t* volume, const float* v0, const float* v1, const float* v2, const triangle_state_t* triangle, graphics_span_shader_t shader, const graphics_box_t* clip);
+
+// draws index_count/3 triangles sharing one material; positions are xyz triples and texcoords, if any, are uv pairs every texcoord_stride floats.
+// the clipped versions of the batches optionally take an outcode per position, to skip primitives wholly outside the volume
+void graphics_draw_triangles(pixel_t* volume, const float* positions, const float* texcoords, uint32_t texcoord_stride, const index_t* indices, uint32_t index_count, const graphics_material_t* material);
+void graphics_draw_triangles_clipped(pixel_t* volume, const float* positions, const uint8_t* outcodes, const float* texcoords, uint32_t texcoord_stride, const index_t* indices, uint32_t index_count, const graphics_material_t* material, const graphics_box_t* clip);
+
 #endif
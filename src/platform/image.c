@@ -2,15 +2,81 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "image.h"
+#include "imagecache.h"
 
 #include "rammel.h"
+#include "array.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
-image_t* image_load(const char* filename) {
+static pixel_t* image_convert(image_t* image, const uint8_t* rgba, int size) {
+    pixel_t* data = malloc(sizeof(pixel_t) * size);
+    bool key_clash = false;
+
+    for (int i = 0; i < size; ++i) {
+        const uint8_t* p = &rgba[i*4];
+        pixel_t colour = RGBPIX(p[0], p[1], p[2]);
+        if (p[3] < 128) {
+            image->masked = true;
+            colour = image->key;
+        } else if (colour == image->key) {
+            key_clash = true;
+        }
+        data[i] = colour;
+    }
+
+    if (image->masked && key_clash) {
+        for (int i = 0; i < size; ++i) {
+            if (data[i] == image->key && rgba[i*4+3] >= 128) {
+                data[i] ^= HEXPIX(200000);
+            }
+        }
+    }
+
+    return data;
+}
+
+static uint8_t* image_halve(const uint8_t* rgba, int width, int height, int half_width, int half_height) {
+    uint8_t* half = malloc(half_width * half_height * 4);
+
+    for (int y = 0; y < half_height; ++y) {
+        const int sy[2] = {min(y*2, height-1), min(y*2+1, height-1)};
+        for (int x = 0; x < half_width; ++x) {
+            const int sx[2] = {min(x*2, width-1), min(x*2+1, width-1)};
+
+            // weight colours by alpha so transparent texels don't bleed into their neighbours
+            uint32_t sum[4] = {0, 0, 0, 0};
+            for (int j = 0; j < 4; ++j) {
+                const uint8_t* p = &rgba[(sx[j&1] + sy[j>>1] * width) * 4];
+                sum[0] += p[0] * p[3];
+                sum[1] += p[1] * p[3];
+                sum[2] += p[2] * p[3];
+                sum[3] += p[3];
+            }
+
+            uint8_t* q = &half[(x + y * half_width) * 4];
+            for (int c = 0; c < 3; ++c) {
+                q[c] = sum[3] ? (sum[c] + sum[3] / 2) / sum[3] : 0;
+            }
+            q[3] = (sum[3] + 2) / 4;
+        }
+    }
+
+    return half;
+}
+
+// every image from image_load that's still in use, so that loading a file again shares it
+static array_t loaded_images = {sizeof(image_t*)};
+static pthread_mutex_t loaded_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static image_t* image_decode(const char* filename) {
     image_t* image = NULL;
 
     int w = 0, h = 0, c = 0;
@@ -28,7 +94,6 @@ image_t* image_load(const char* filename) {
             image->key = HEXPIX(200000);
 
             int size = image->width * image->height;
-            image->data = malloc(sizeof(pixel_t) * size);
 
             int r, g, b, a;
             switch (c) {
@@ -38,33 +103,33 @@ image_t* image_load(const char* filename) {
                 default: r = g = b = a = 0; break;
             }
 
-            if (a) {
-                bool key_clash = false;
-                for (int i = 0; i < size; ++i) {
-                    uint8_t* p = &data[i*c];
-                    pixel_t colour = RGBPIX(p[r], p[g], p[b]);
-                    if (p[a] < 128) {
-                        image->masked = true;
-                        colour = image->key;
-                    } else if (colour == image->key) {
-                        key_clash = true;
-                    }
-                    image->data[i] = colour;
-                }
-                if (image->masked && key_clash) {
-                    for (int i = 0; i < size; ++i) {
-                        uint8_t* p = &data[i*c];
-                        if (image->data[i] == image->key && p[a] >= 128) {
-                            image->data[i] ^= HEXPIX(200000);
-                        }
-                    }
-                }
-            } else {
-                for (int i = 0; i < size; ++i) {
-                    uint8_t* p = &data[i*c];
-                    image->data[i] = RGBPIX(p[r], p[g], p[b]);
-                }
+            uint8_t* rgba = malloc(size * 4);
+            for (int i = 0; i < size; ++i) {
+                const uint8_t* p = &data[i*c];
+                rgba[i*4+0] = p[r];
+                rgba[i*4+1] = p[g];
+                rgba[i*4+2] = p[b];
+                rgba[i*4+3] = a ? p[a] : 255;
             }
+            image->data = image_convert(image, rgba, size);
+
+            // box filtered mips down to a single texel
+            int level_width = w, level_height = h;
+            while ((level_width > 1 || level_height > 1) && image->mip_count < IMAGE_MAX_MIPS) {
+                int half_width = max(level_width / 2, 1);
+                int half_height = max(level_height / 2, 1);
+                uint8_t* half = image_halve(rgba, level_width, level_height, half_width, half_height);
+                free(rgba);
+                rgba = half;
+                level_width = half_width;
+                level_height = half_height;
+
+                image_level_t* mip = &image->mips[image->mip_count++];
+                mip->width = level_width;
+                mip->height = level_height;
+                mip->data = image_convert(image, rgba, level_width * level_height);
+            }
+            free(rgba);
         }
         stbi_image_free(data);
     }
@@ -72,17 +137,108 @@ image_t* image_load(const char* filename) {
     return image;
 }
 
-pixel_t image_sample(image_t* image, const float* uv, bool* masked) {
-    if (!image->data || image->width <= 0 || image->height <= 0) {
+static void image_release(image_t* image) {
+    if (image->mapping) {
+        munmap(image->mapping, image->mapping_size);
+    } else {
+        for (int i = 0; i < image->mip_count; ++i) {
+            free(image->mips[i].data);
+        }
+        free(image->data);
+    }
+    free(image->filename);
+    free(image);
+}
+
+// needs loaded_lock held
+static image_t* find_loaded(const char* filename, const struct timespec* modified) {
+    for (size_t i = 0; i < loaded_images.count; ++i) {
+        image_t* image = *(image_t**)array_get(&loaded_images, i);
+        if (image->modified.tv_sec == modified->tv_sec && image->modified.tv_nsec == modified->tv_nsec
+         && strcmp(image->filename, filename) == 0) {
+            return image;
+        }
+    }
+    return NULL;
+}
+
+image_t* image_load(const char* filename) {
+    struct stat sb;
+    if (stat(filename, &sb) != 0) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&loaded_lock);
+    image_t* image = find_loaded(filename, &sb.st_mtim);
+    if (image) {
+        ++image->refs;
+    }
+    pthread_mutex_unlock(&loaded_lock);
+
+    if (image) {
+        return image;
+    }
+
+    image = image_cache_load(filename);
+    if (!image) {
+        image = image_decode(filename);
+        if (image) {
+            image_cache_save(filename, image);
+        }
+    }
+    if (!image) {
+        return NULL;
+    }
+
+    image->refs = 1;
+    image->filename = strdup(filename);
+    image->modified = sb.st_mtim;
+
+    // loaded without the lock held, so another thread may have got there first
+    pthread_mutex_lock(&loaded_lock);
+    image_t* loaded = find_loaded(filename, &sb.st_mtim);
+    if (loaded) {
+        ++loaded->refs;
+    } else {
+        *(image_t**)array_push(&loaded_images) = image;
+    }
+    pthread_mutex_unlock(&loaded_lock);
+
+    if (loaded) {
+        image_release(image);
+        image = loaded;
+    }
+    return image;
+}
+
+int image_select_level(const image_t* image, float footprint) {
+    if (!(footprint >= 2.0f)) {
+        return 0;
+    }
+    int exponent;
+    frexpf(footprint, &exponent);
+    return min(exponent - 1, image->mip_count);
+}
+
+image_level_t image_get_level(const image_t* image, int level) {
+    if (level <= 0 || image->mip_count <= 0) {
+        return (image_level_t){image->data, image->width, image->height};
+    }
+    return image->mips[min(level, image->mip_count) - 1];
+}
+
+pixel_t image_sample_level(const image_t* image, int level, const float* uv, bool* masked) {
+    image_level_t texels = image_get_level(image, level);
+    if (!texels.data || texels.width <= 0 || texels.height <= 0) {
         return 0;
     }
 
-    int x = modulo((int)floor(uv[0] * image->width), image->width);
-    int y = modulo((int)floor(uv[1] * image->height), image->height);
+    int x = modulo((int)floor(uv[0] * texels.width), texels.width);
+    int y = modulo((int)floor(uv[1] * texels.height), texels.height);
 
-    y = (image->height - 1) - y;
+    y = (texels.height - 1) - y;
 
-    pixel_t colour = image->data[x + image->width * y];
+    pixel_t colour = texels.data[x + texels.width * y];
 
     if (masked) {
         *masked = image->masked && colour == image->key;
@@ -91,9 +247,25 @@ pixel_t image_sample(image_t* image, const float* uv, bool* masked) {
     return colour;
 }
 
+pixel_t image_sample(image_t* image, const float* uv, bool* masked) {
+    return image_sample_level(image, 0, uv, masked);
+}
+
 void image_free(image_t* image) {
     if (image) {
-        free(image->data);
-        free(image);
+        pthread_mutex_lock(&loaded_lock);
+        bool last = --image->refs <= 0;
+        for (size_t i = 0; last && i < loaded_images.count; ++i) {
+            image_t** loaded = array_get(&loaded_images, i);
+            if (*loaded == image) {
+                *loaded = *(image_t**)array_get(&loaded_images, --loaded_images.count);
+                break;
+            }
+        }
+        pthread_mutex_unlock(&loaded_lock);
+
+        if (last) {
+            image_release(image);
+        }
     }
 }
@@ -1,19 +1,46 @@
 #ifndef _IMAGE_H_
 #define _IMAGE_H_
 
+#include <time.h>
+
 #include "voxel.h"
 
+#define IMAGE_MAX_MIPS 15
+
+typedef struct {
+    pixel_t* data;
+    int width, height;
+} image_level_t;
+
 typedef struct image_s {
     pixel_t* data;
     int width, height;
 
     uint8_t masked;
     pixel_t key;
+
+    // successively halved copies of data, built by image_load
+    int mip_count;
+    image_level_t mips[IMAGE_MAX_MIPS];
+
+    // images from image_load are shared by everything that loads the same file, until the last image_free
+    int refs;
+    char* filename;
+    struct timespec modified;
+
+    // set when the levels point into a mapped image cache rather than being allocated
+    void* mapping;
+    size_t mapping_size;
 } image_t;
 
+// loads are shared while the file is unchanged, and safe from any thread
 image_t* image_load(const char* filename);
 pixel_t image_sample(image_t* image, const float* uv, bool* masked);
 void image_free(image_t* image);
 
+// level 0 is the full image, footprint is how many full size texels a sample covers
+int image_select_level(const image_t* image, float footprint);
+image_level_t image_get_level(const image_t* image, int level);
+pixel_t image_sample_level(const image_t* image, int level, const float* uv, bool* masked);
 
 #endif
@@ -0,0 +1,159 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "imagecache.h"
+
+#include "rammel.h"
+#include "cachefile.h"
+
+#define CACHE_MAGIC 0x3154564d     // "MVT1"
+#define CACHE_VERSION 1
+#define CACHE_ALIGNMENT 16
+
+// pixel_t differs with HIGH_COLOUR, and the key with it
+#define CACHE_LAYOUT ((sizeof(pixel_t) << 16) | (uint32_t)HEXPIX(200000))
+
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint64_t pixels;            // offset from the start of the file
+} cache_level_t;
+
+// level zero is the full image, the rest are its mips
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t layout;
+    uint32_t level_count;
+    uint64_t size;
+    uint32_t masked;
+    uint32_t key;
+    cache_level_t levels[IMAGE_MAX_MIPS + 1];
+} cache_header_t;
+
+// the source's extension is kept, as a .png and a .jpg often share a name
+static bool cache_filename(char* cachename, const char* filename) {
+    int length = snprintf(cachename, PATH_MAX, "%s.mvt", filename);
+    return length > 0 && length < PATH_MAX;
+}
+
+static bool cache_level_valid(const cache_level_t* level, uint64_t mapping_size) {
+    if (!level->width || !level->height || (level->pixels % CACHE_ALIGNMENT) || level->pixels > mapping_size) {
+        return false;
+    }
+    return (uint64_t)level->width * level->height <= (mapping_size - level->pixels) / sizeof(pixel_t);
+}
+
+image_t* image_cache_load(const char* filename) {
+    char cachename[PATH_MAX];
+    if (!cache_filename(cachename, filename) || !cache_is_current(filename, cachename)) {
+        return NULL;
+    }
+
+    int fd = open(cachename, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat sb;
+    if (fstat(fd, &sb) != 0 || sb.st_size < (off_t)sizeof(cache_header_t)) {
+        close(fd);
+        return NULL;
+    }
+
+    size_t mapping_size = sb.st_size;
+    void* mapping = mmap(NULL, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return NULL;
+    }
+
+    const cache_header_t* header = mapping;
+    bool valid = header->magic == CACHE_MAGIC && header->version == CACHE_VERSION && header->layout == CACHE_LAYOUT
+              && header->size == mapping_size && header->level_count >= 1 && header->level_count <= count_of(header->levels);
+    for (uint32_t l = 0; valid && l < header->level_count; ++l) {
+        valid = cache_level_valid(&header->levels[l], mapping_size);
+    }
+
+    if (!valid) {
+        munmap(mapping, mapping_size);
+        return NULL;
+    }
+
+    image_t* image = calloc(1, sizeof(image_t));
+    image->width = header->levels[0].width;
+    image->height = header->levels[0].height;
+    image->data = (pixel_t*)((uint8_t*)mapping + header->levels[0].pixels);
+    image->masked = header->masked;
+    image->key = header->key;
+
+    image->mip_count = header->level_count - 1;
+    for (int i = 0; i < image->mip_count; ++i) {
+        const cache_level_t* level = &header->levels[i + 1];
+        image->mips[i] = (image_level_t){(pixel_t*)((uint8_t*)mapping + level->pixels), level->width, level->height};
+    }
+
+    // read only, nothing draws into a texture
+    image->mapping = mapping;
+    image->mapping_size = mapping_size;
+    madvise(mapping, mapping_size, MADV_WILLNEED);
+    return image;
+}
+
+static bool cache_write(FILE* fd, const void* data, size_t size, uint64_t* offset) {
+    static const uint8_t padding[CACHE_ALIGNMENT];
+    size_t pad = (CACHE_ALIGNMENT - *offset % CACHE_ALIGNMENT) % CACHE_ALIGNMENT;
+    *offset += pad + size;
+    return fwrite(padding, 1, pad, fd) == pad && fwrite(data, 1, size, fd) == size;
+}
+
+typedef struct {
+    const cache_header_t* header;
+    const image_t* image;
+} cache_contents_t;
+
+static bool cache_write_contents(FILE* fd, void* context) {
+    const cache_contents_t* contents = context;
+    uint64_t offset = 0;
+    bool written = cache_write(fd, contents->header, sizeof(cache_header_t), &offset);
+    for (uint32_t l = 0; written && l < contents->header->level_count; ++l) {
+        image_level_t level = image_get_level(contents->image, l);
+        written = cache_write(fd, level.data, (size_t)level.width * level.height * sizeof(pixel_t), &offset);
+    }
+    return written;
+}
+
+void image_cache_save(const char* filename, const image_t* image) {
+    char cachename[PATH_MAX];
+    if (!cache_filename(cachename, filename)) {
+        return;
+    }
+
+    cache_header_t header = {
+        .magic = CACHE_MAGIC,
+        .version = CACHE_VERSION,
+        .layout = CACHE_LAYOUT,
+        .level_count = 1 + min(image->mip_count, IMAGE_MAX_MIPS),
+        .masked = image->masked,
+        .key = image->key
+    };
+
+    // levels follow the header in order, each aligned
+    uint64_t offset = sizeof(header);
+    for (uint32_t l = 0; l < header.level_count; ++l) {
+        image_level_t level = image_get_level(image, l);
+        offset = (offset + CACHE_ALIGNMENT - 1) & ~(uint64_t)(CACHE_ALIGNMENT - 1);
+        header.levels[l] = (cache_level_t){level.width, level.height, offset};
+        offset += (uint64_t)level.width * level.height * sizeof(pixel_t);
+    }
+    header.size = offset;
+
+    file_write_atomic(cachename, cache_write_contents, &(cache_contents_t){&header, image});
+}
@@ -0,0 +1,15 @@
+#ifndef _IMAGECACHE_H_
+#define _IMAGECACHE_H_
+
+#include "image.h"
+
+// decoded images saved beside their source as .mvt files: every level's converted pixels one after another,
+// so that a texture seen before is mapped rather than decoded. a cache older than its source is ignored and rewritten.
+
+// NULL if there's no usable cache for filename. the image's levels point into the mapping
+image_t* image_cache_load(const char* filename);
+
+// quietly gives up if the cache can't be written, the image still decodes from source next time
+void image_cache_save(const char* filename, const image_t* image);
+
+#endif
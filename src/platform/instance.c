@@ -0,0 +1,286 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "instance.h"
+#include "graphics.h"
+#include "mathc.h"
+#include "rammel.h"
+#include "array.h"
+#include "arena.h"
+
+#define INSTANCE_BUCKET_BITS 8
+#define INSTANCE_BUCKET_COUNT (1<<INSTANCE_BUCKET_BITS)
+#define INSTANCE_BUCKET_MASK (INSTANCE_BUCKET_COUNT - 1)
+
+typedef struct {
+    const model_t* model;
+    float linear[9];
+    uint8_t phase[3];
+
+    uint32_t previous;
+    uint32_t first_column;
+    uint32_t column_count;
+} entry_t;
+
+struct instance_cache_s {
+    uint32_t buckets[INSTANCE_BUCKET_COUNT];
+    array_t entries;
+    array_t columns;
+    array_t runs;
+    array_t colours;
+};
+
+typedef struct {
+    int16_t x, y, z;
+    pixel_t colour;
+    uint32_t order;
+} captured_t;
+
+static array_t scratch_captured = {sizeof(captured_t)};
+
+instance_cache_t* instance_cache_create(void) {
+    instance_cache_t* cache = calloc(1, sizeof(instance_cache_t));
+    if (!cache) {
+        return NULL;
+    }
+
+    cache->entries.size = sizeof(entry_t);
+    cache->columns.size = sizeof(instance_column_t);
+    cache->runs.size = sizeof(instance_run_t);
+    cache->colours.size = sizeof(pixel_t);
+    instance_cache_clear(cache);
+
+    return cache;
+}
+
+void instance_cache_destroy(instance_cache_t* cache) {
+    if (!cache) {
+        return;
+    }
+
+    array_destroy(&cache->entries);
+    array_destroy(&cache->columns);
+    array_destroy(&cache->runs);
+    array_destroy(&cache->colours);
+    free(cache);
+}
+
+void instance_cache_clear(instance_cache_t* cache) {
+    memset(cache->buckets, 0xff, sizeof(cache->buckets));
+    array_clear(&cache->entries);
+    array_clear(&cache->columns);
+    array_clear(&cache->runs);
+    array_clear(&cache->colours);
+}
+
+bool instance_supported(const model_t* model) {
+    if (model->edge_count) {
+        return false;
+    }
+    for (uint32_t s = 0; s < model->surface_count; ++s) {
+        if (model->surfaces[s].image) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static uint32_t key_hash(const entry_t* key) {
+    uint32_t words[11];
+    memcpy(words, key->linear, sizeof(key->linear));
+    words[9] = (uint32_t)(uintptr_t)key->model;
+    words[10] = key->phase[0] | (key->phase[1] << 8) | (key->phase[2] << 16);
+
+    uint32_t hash = 3323198485ul;
+    for (int i = 0; i < count_of(words); ++i) {
+        hash ^= words[i];
+        hash *= 0x5bd1e995;
+        hash ^= hash >> 15;
+    }
+    return hash;
+}
+
+static bool key_equal(const entry_t* one, const entry_t* two) {
+    return one->model == two->model
+        && memcmp(one->linear, two->linear, sizeof(one->linear)) == 0
+        && memcmp(one->phase, two->phase, sizeof(one->phase)) == 0;
+}
+
+static void capture_span(pixel_t* volume, const graphics_span_t* span, const triangle_state_t* triangle) {
+    for (int i = 0; i < span->length; ++i) {
+        int coordinate[VEC3_SIZE];
+        graphics_span_voxel(span, i, coordinate);
+
+        captured_t* voxel = array_push(&scratch_captured);
+        voxel->x = coordinate[0] - VOXELS_X / 2;
+        voxel->y = coordinate[1] - VOXELS_Y / 2;
+        voxel->z = coordinate[2] - VOXELS_Z / 2;
+        voxel->colour = triangle->colour;
+        voxel->order = scratch_captured.count - 1;
+    }
+}
+
+static int captured_compare(const void* a, const void* b) {
+    const captured_t* one = a;
+    const captured_t* two = b;
+    if (one->y != two->y) {
+        return one->y - two->y;
+    }
+    if (one->x != two->x) {
+        return one->x - two->x;
+    }
+    if (one->z != two->z) {
+        return one->z - two->z;
+    }
+    return (one->order > two->order) - (one->order < two->order);
+}
+
+static void voxelise(instance_cache_t* cache, entry_t* entry, const float* matrix) {
+    // draw the triangles about the middle of the volume, collecting voxels instead of writing them
+    float placed[MAT4_SIZE];
+    memcpy(placed, matrix, sizeof(placed));
+    placed[12] = VOXELS_X / 2 + (entry->phase[0] + 0.5f) / INSTANCE_PHASES;
+    placed[13] = VOXELS_Y / 2 + (entry->phase[1] + 0.5f) / INSTANCE_PHASES;
+    placed[14] = VOXELS_Z / 2 + (entry->phase[2] + 0.5f) / INSTANCE_PHASES;
+
+    const model_t* model = entry->model;
+    arena_mark_t mark = arena_mark();
+    vec3_t* transformed = arena_alloc(model->vertex_count * sizeof(vec3_t));
+    for (uint32_t i = 0; i < model->vertex_count; ++i) {
+        vec3_transform(transformed[i].v, model->vertices[i].position.v, placed);
+    }
+
+    array_clear(&scratch_captured);
+    for (uint32_t s = 0; s < model->surface_count; ++s) {
+        const surface_t* surface = &model->surfaces[s];
+        graphics_material_t material = {.colour = surface->colour, .shader = capture_span};
+        graphics_draw_triangles(NULL, transformed[0].v, NULL, 0, surface->indices, surface->index_count, &material);
+    }
+    arena_rewind(mark);
+
+    // later triangles win where they overlap, as they would drawn directly
+    captured_t* voxels = scratch_captured.data;
+    qsort(voxels, scratch_captured.count, sizeof(captured_t), captured_compare);
+
+    entry->first_column = cache->columns.count;
+    entry->column_count = 0;
+
+    instance_column_t* column = NULL;
+    instance_run_t* run = NULL;
+    for (size_t i = 0; i < scratch_captured.count; ++i) {
+        const captured_t* voxel = &voxels[i];
+        const captured_t* next = (i + 1 < scratch_captured.count) ? &voxels[i+1] : NULL;
+        if (next && next->x == voxel->x && next->y == voxel->y && next->z == voxel->z) {
+            continue;
+        }
+
+        if (!column || column->x != voxel->x || column->y != voxel->y) {
+            column = array_push(&cache->columns);
+            column->x = voxel->x;
+            column->y = voxel->y;
+            column->run_count = 0;
+            column->first_run = cache->runs.count;
+            entry->column_count += 1;
+            run = NULL;
+        }
+
+        if (!run || run->z + run->length != voxel->z) {
+            run = array_push(&cache->runs);
+            run->z = voxel->z;
+            run->length = 0;
+            run->first_colour = cache->colours.count;
+            column->run_count += 1;
+        }
+
+        *(pixel_t*)array_push(&cache->colours) = voxel->colour;
+        run->length += 1;
+    }
+}
+
+instance_t instance_cache_get(instance_cache_t* cache, const model_t* model, const float* matrix, int* origin) {
+    entry_t key = {.model = model};
+    for (int c = 0; c < 3; ++c) {
+        memcpy(&key.linear[c*3], &matrix[c*4], sizeof(float) * 3);
+
+        float whole = floorf(matrix[12 + c]);
+        origin[c] = (int)whole;
+        key.phase[c] = min((int)((matrix[12 + c] - whole) * INSTANCE_PHASES), INSTANCE_PHASES - 1);
+    }
+
+    assert(instance_supported(model));
+
+    const uint32_t none = ~0u;
+    uint32_t* head = &cache->buckets[key_hash(&key) & INSTANCE_BUCKET_MASK];
+    uint32_t index = *head;
+    while (index != none && !key_equal(array_get(&cache->entries, index), &key)) {
+        index = ((entry_t*)array_get(&cache->entries, index))->previous;
+    }
+
+    if (index == none) {
+        if (cache->colours.count >= INSTANCE_CACHE_VOXELS) {
+            // instances already handed out are only good until the next get, so nothing is still using them
+            instance_cache_clear(cache);
+            head = &cache->buckets[key_hash(&key) & INSTANCE_BUCKET_MASK];
+        }
+
+        index = cache->entries.count;
+        entry_t* entry = array_push(&cache->entries);
+        *entry = key;
+        entry->previous = *head;
+        *head = index;
+        voxelise(cache, entry, matrix);
+    }
+
+    const entry_t* entry = array_get(&cache->entries, index);
+    return (instance_t){
+        .column_count = entry->column_count,
+        .columns = (const instance_column_t*)cache->columns.data + entry->first_column,
+        .runs = cache->runs.data,
+        .colours = cache->colours.data
+    };
+}
+
+void instance_draw(pixel_t* volume, const instance_t* instance, const int* origin) {
+    instance_draw_columns(volume, instance, origin, NULL, NULL);
+}
+
+void instance_draw_columns(pixel_t* volume, const instance_t* instance, const int* origin, instance_column_cb_t column_cb, void* context) {
+    for (uint32_t c = 0; c < instance->column_count; ++c) {
+        const instance_column_t* column = &instance->columns[c];
+        int x = origin[0] + column->x;
+        int y = origin[1] + column->y;
+        if ((uint)x >= VOXELS_X || (uint)y >= VOXELS_Y) {
+            continue;
+        }
+
+        const instance_run_t* runs = &instance->runs[column->first_run];
+        int bottom = 0;
+        if (column_cb) {
+            // runs go up the column, so the top is in the last one that reaches the volume
+            int top = -1;
+            for (uint32_t r = column->run_count; r-- > 0 && top < 0;) {
+                int z0 = max(origin[2] + runs[r].z, 0);
+                int z1 = min(origin[2] + runs[r].z + runs[r].length, VOXELS_Z);
+                if (z0 < z1) {
+                    top = z1 - 1;
+                }
+            }
+            if (top < 0) {
+                continue;
+            }
+            bottom = max(column_cb(volume, x, y, top, context), 0);
+        }
+
+        for (uint32_t r = 0; r < column->run_count; ++r) {
+            const instance_run_t* run = &runs[r];
+            int z0 = max(origin[2] + run->z, bottom);
+            int z1 = min(origin[2] + run->z + run->length, VOXELS_Z);
+            if (z0 < z1) {
+                instance_copy_run(volume, x, y, z0, &instance->colours[run->first_colour + z0 - (origin[2] + run->z)], z1 - z0);
+            }
+        }
+    }
+}
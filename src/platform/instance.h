@@ -0,0 +1,72 @@
+#ifndef _INSTANCE_H_
+#define _INSTANCE_H_
+
+#include <string.h>
+
+#include "voxel.h"
+#include "model.h"
+
+// models voxelised once for a given scale and orientation, then stamped into the volume at whole voxel offsets.
+// the fractional part of the translation is rounded to one of INSTANCE_PHASES steps per axis, and each step
+// is voxelised separately. only the surfaces' flat colours are captured, so models with edges or textures
+// have to be drawn directly. models are voxelised about the middle of the volume, so have to fit inside it.
+
+#define INSTANCE_PHASES 4
+
+// once the cache holds this many voxels it's emptied, and refills with the instances still being drawn
+#define INSTANCE_CACHE_VOXELS (1 << 20)
+
+typedef struct {
+    int16_t x, y;           // relative to the origin the instance is drawn at
+    uint16_t run_count;
+    uint32_t first_run;
+} instance_column_t;
+
+typedef struct {
+    int16_t z;              // lowest voxel of the run, relative to the origin
+    uint16_t length;
+    uint32_t first_colour;
+} instance_run_t;
+
+// columns of runs of voxels, pointing into the cache and only good until it's next used
+typedef struct {
+    uint32_t column_count;
+    const instance_column_t* columns;
+    const instance_run_t* runs;
+    const pixel_t* colours;
+} instance_t;
+
+typedef struct instance_cache_s instance_cache_t;
+
+instance_cache_t* instance_cache_create(void);
+void instance_cache_destroy(instance_cache_t* cache);
+
+// forgets every instance, for when the scale they were voxelised at changes
+void instance_cache_clear(instance_cache_t* cache);
+
+// false for models with edges or textured surfaces, which an instance can't reproduce
+bool instance_supported(const model_t* model);
+
+// the model voxelised under matrix, and the voxel to draw it at. the model must be instance_supported
+instance_t instance_cache_get(instance_cache_t* cache, const model_t* model, const float* matrix, int* origin);
+
+void instance_draw(pixel_t* volume, const instance_t* instance, const int* origin);
+
+// called for each column of an instance with some of it in the volume, before the column is drawn, with the
+// highest voxel it'll cover. returns the lowest z to draw the column from
+typedef int (*instance_column_cb_t)(pixel_t* volume, int x, int y, int top, void* context);
+
+void instance_draw_columns(pixel_t* volume, const instance_t* instance, const int* origin, instance_column_cb_t column_cb, void* context);
+
+// length voxels up from z in the column at x, y, which the caller has already clipped to the volume
+static inline void instance_copy_run(pixel_t* volume, int x, int y, int z, const pixel_t* colours, int length) {
+#if VOXEL_Z_CONTIGUOUS
+    memcpy(&volume[VOXEL_INDEX(x, y, z)], colours, length * sizeof(pixel_t));
+#else
+    for (int i = 0; i < length; ++i) {
+        volume[VOXEL_INDEX(x, y, z + i)] = colours[i];
+    }
+#endif
+}
+
+#endif
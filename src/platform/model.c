@@ -5,15 +5,24 @@
 #include <linux/limits.h>
 #include <ctype.h>
 #include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "model.h"
+#include "modelcache.h"
+#include "simplify.h"
 
 #include "graphics.h"
 #include "mathc.h"
 #include "rammel.h"
 #include "array.h"
+#include "arena.h"
 #include "image.h"
 #include "timer.h"
+#include "workers.h"
 
 typedef struct {
     float x, y, rsq;
@@ -29,15 +38,22 @@ typedef struct {
 #ifdef VERTEX_NORMALS
     index_t normal;
 #endif
-
-    uint32_t previous;
 } vertex_tuple_t;
 
-#define SCRATCH_VERTEX_BUCKET_BITS 8
-#define SCRATCH_VERTEX_BUCKET_COUNT (1<<SCRATCH_VERTEX_BUCKET_BITS)
-#define SCRATCH_VERTEX_BUCKET_MASK (SCRATCH_VERTEX_BUCKET_COUNT - 1)
+// open addressed slots holding indices into scratch_vertices and scratch_edges, a power of two in size
+// and kept at most half full
+#define SCRATCH_TABLE_MIN 16384
+static array_t scratch_vertex_table = {sizeof(uint32_t)};
+static array_t scratch_edge_table = {sizeof(uint32_t)};
+
+// how many faces meet at each of scratch_edges, and how sharply, for picking out feature edges
+typedef struct {
+    vec3_t normal;
+    uint32_t face_count;
+    float min_dot;
+} edge_faces_t;
 
-static uint32_t scratch_vertex_list[SCRATCH_VERTEX_BUCKET_COUNT];
+static array_t scratch_edge_faces = {sizeof(edge_faces_t)};
 
 #ifdef VERTEX_NORMALS
 static array_t scratch_normals = {sizeof(vertex_tuple_t)};
@@ -46,10 +62,17 @@ static array_t scratch_vertices = {sizeof(vertex_tuple_t)};
 static array_t scratch_positions = {sizeof(vec3_t)};
 static array_t scratch_texcoords = {sizeof(vec2_t)};
 static array_t scratch_edges = {sizeof(edge_t)};
-static array_t scratch_edge_exists = {sizeof(uint32_t)};
 static array_t scratch_indices = {sizeof(index_t)};
 static array_t scratch_surfaces = {sizeof(surface_t)};
 static array_t scratch_materials = {sizeof(material_t)};
+static array_t scratch_mtllibs = {sizeof(char*)};    // the .mtl files read, as the .obj names them
+
+// per-draw culling state, from the drawing thread's arena: a graphics_cull_t for every cluster, edges' first then
+// each surface's in turn, and a flag for each block of vertices that a visible cluster refers to.
+// model_draw gives it back as it returns, model_render's lasts the frame alongside the render context's bins
+#define VERTEX_BLOCK_SIZE 64
+
+_Thread_local model_cull_stats_t model_cull_stats;
 
 static void vertex_assign(vertex_t* vertex, float px, float py, float pz, float u, float v, float nx, float ny, float nz) {
     vertex->position.x = px;
@@ -62,88 +85,83 @@ static void vertex_assign(vertex_t* vertex, float px, float py, float pz, float
     //vertex->normal.z = nz;
 }
 
-static int vertex_compare(index_t* one, index_t* two) {
+static inline uint32_t vertex_hash(const vertex_tuple_t* vertex) {
+    uint32_t hash = vertex->position * 0x9e3779b1u;
+    hash ^= vertex->texcoord * 0x85ebca77u;
 #ifdef VERTEX_NORMALS
-    for (int i = 0; i < 3; ++i) {
-#else
-    for (int i = 0; i < 2; ++i) {
-#endif    
-        if (one[i] > two[i]) {
-            return 1;
-        }
-        if (one[i] < two[i]) {
-            return -1;
-        }
-    }
-    return 0;
+    hash ^= vertex->normal * 0xc2b2ae3du;
+#endif
+    return hash ^ (hash >> 15);
 }
 
-static uint get_vertex(uint position, uint texcoord/*, uint normal*/) {
-    const uint32_t none = ~0u;
-    
-    uint32_t* ihead = &scratch_vertex_list[position & SCRATCH_VERTEX_BUCKET_MASK];
-    uint32_t iprev = none;
-    uint32_t icurr = *ihead;
-
-    while (icurr != none) {
-        vertex_tuple_t* vcurr = array_get(&scratch_vertices, icurr);
-        
-        int compare = vertex_compare((index_t*)&vcurr->position, (index_t[]){position, texcoord});
-        if (compare == 0) {
-            return icurr;
-        }
-        if (compare < 0) {
-            break;
-        }
-
-        iprev = icurr;
-        icurr = vcurr->previous;
-    }
-
-    uint index = scratch_vertices.count;
-    array_resize(&scratch_vertices, index + 1);
-
-    vertex_tuple_t* vert = array_get(&scratch_vertices, index);
-    vert->previous = none;
-    vert->position = position;
-    vert->texcoord = texcoord;
+static inline bool vertex_equal(const vertex_tuple_t* one, const vertex_tuple_t* two) {
+    return one->position == two->position
+        && one->texcoord == two->texcoord
 #ifdef VERTEX_NORMALS
-    vert->normal = normal;
+        && one->normal == two->normal
 #endif
+        ;
+}
 
-    if (iprev == none) {
-        *ihead = index;
-    } else {
-        vertex_tuple_t* vprev = array_get(&scratch_vertices, iprev);
-        vert->previous = vprev->previous;
-        vprev->previous = index;
-    }
+static uint32_t vertex_entry_hash(uint32_t index) {
+    return vertex_hash(array_get(&scratch_vertices, index));
+}
 
-    return index;
+static inline uint32_t edge_hash(index_t one, index_t two) {
+    uint32_t hash = one * 0x9e3779b1u;
+    hash ^= two * 0x85ebca77u;
+    return hash ^ (hash >> 15);
+}
+
+static uint32_t edge_entry_hash(uint32_t index) {
+    const edge_t* edge = array_get(&scratch_edges, index);
+    return edge_hash(edge->index[0], edge->index[1]);
 }
 
-static bool edge_exists(index_t end0, index_t end1) {    
-    size_t bitindex = 0;
+// doubles the table and puts the first entry_count entries back in it
+static void table_grow(array_t* table, uint32_t entry_count, uint32_t (*entry_hash)(uint32_t)) {
+    const uint32_t none = ~0u;
+
+    size_t size = max(table->count * 2, (size_t)SCRATCH_TABLE_MIN);
+    array_resize(table, size);
+
+    uint32_t* slots = table->data;
+    uint32_t mask = size - 1;
+    memset(slots, 0xff, size * sizeof(uint32_t));
 
-    for (int i = 0; end1 >= (1U << i); ++i) {
-        bitindex |= (end0 & 1U << i) << i | (end1 & 1U << i) << (i + 1);
+    for (uint32_t i = 0; i < entry_count; ++i) {
+        uint32_t slot = entry_hash(i) & mask;
+        while (slots[slot] != none) {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = i;
     }
+}
+
+static uint get_vertex(uint position, uint texcoord/*, uint normal*/) {
+    const uint32_t none = ~0u;
 
-    size_t bitbucket = bitindex / 32;
-    if (bitbucket >= scratch_edge_exists.count) {
-        size_t end = scratch_edge_exists.count;
-        array_resize(&scratch_edge_exists, ((bitbucket + 256) & ~255));
-        memset(array_get(&scratch_edge_exists, end), 0, (scratch_edge_exists.count - end) * sizeof(uint32_t));
+    if ((scratch_vertices.count + 1) * 2 > scratch_vertex_table.count) {
+        table_grow(&scratch_vertex_table, scratch_vertices.count, vertex_entry_hash);
     }
 
-    uint32_t bitmask = 1U << (bitindex & 31);
+    vertex_tuple_t key = {.position = position, .texcoord = texcoord};
 
-    uint32_t* bucket = array_get(&scratch_edge_exists, bitbucket);
-    bool exists = ((*bucket) & bitmask) != 0;
+    uint32_t* table = scratch_vertex_table.data;
+    uint32_t mask = scratch_vertex_table.count - 1;
+    uint32_t slot = vertex_hash(&key) & mask;
 
-    *bucket |= bitmask;
-    
-    return exists;
+    for (; table[slot] != none; slot = (slot + 1) & mask) {
+        if (vertex_equal(array_get(&scratch_vertices, table[slot]), &key)) {
+            return table[slot];
+        }
+    }
+
+    uint index = scratch_vertices.count;
+    *(vertex_tuple_t*)array_push(&scratch_vertices) = key;
+    table[slot] = index;
+
+    return index;
 }
 
 static void trim_trailing_whitespace(char* line) {
@@ -152,37 +170,43 @@ static void trim_trailing_whitespace(char* line) {
     }
 }
 
-static uint parse_vertex(char* group, bool position_only) {
-    uint p = 0, t = 0;//, n = 0;
-    char* tok = group;
-    p = strtol(tok, &tok, 10);
-    if (!position_only && tok && tok[0] == '/') {
-        if (tok[1] == '/') {
-#ifdef VERTEX_NORMALS
-            n = strtol(tok+2, &tok, 10);
-#endif
-        } else {
-            t = strtol(tok+1, &tok, 10);
-#ifdef VERTEX_NORMALS
-            if (tok && tok[0] == '/') {
-                n = strtol(tok+1, &tok, 10);
-            }
-#endif
+// the edge between two vertices, added with colour if it's not already there
+static uint32_t get_edge(index_t end0, index_t end1, pixel_t colour, bool* added) {
+    const uint32_t none = ~0u;
+
+    index_t one = min(end0, end1);
+    index_t two = max(end0, end1);
+
+    if ((scratch_edges.count + 1) * 2 > scratch_edge_table.count) {
+        table_grow(&scratch_edge_table, scratch_edges.count, edge_entry_hash);
+    }
+
+    uint32_t* table = scratch_edge_table.data;
+    uint32_t mask = scratch_edge_table.count - 1;
+    uint32_t slot = edge_hash(one, two) & mask;
+
+    for (; table[slot] != none; slot = (slot + 1) & mask) {
+        const edge_t* edge = array_get(&scratch_edges, table[slot]);
+        if (edge->index[0] == one && edge->index[1] == two) {
+            *added = false;
+            return table[slot];
         }
     }
-    return get_vertex(p, t/*, n*/);
+
+    uint32_t index = scratch_edges.count;
+    edge_t* edge = array_push(&scratch_edges);
+    edge->index[0] = one;
+    edge->index[1] = two;
+    edge->colour = colour;
+    table[slot] = index;
+
+    *added = true;
+    return index;
 }
 
 static void add_unique_edge(int end0, int end1, pixel_t colour) {
-    index_t one = min(end0, end1);
-    index_t two = max(end0, end1);
-    
-    if (!edge_exists(one, two)) {
-        edge_t* edge = array_push(&scratch_edges);
-        edge->index[0] = one;
-        edge->index[1] = two;
-        edge->colour = colour;
-    }
+    bool added;
+    get_edge(end0, end1, colour, &added);
 }
 
 static void add_triangle(uint v0, uint v1, uint v2) {
@@ -218,7 +242,7 @@ static pixel_t hash_colour(const char* str) {
     return RGBPIX(r, g, b);
 }
 
-static void load_mtllib(const char* path, const char* mtlfile) {
+static bool load_mtllib(const char* path, const char* mtlfile) {
     char filename[PATH_MAX];
     size_t pathlen = path ? strlen(path) : 0;
     if (pathlen) {
@@ -228,7 +252,7 @@ static void load_mtllib(const char* path, const char* mtlfile) {
 
     FILE* fd = fopen(filename, "r");
     if (!fd) {
-        return;
+        return false;
     }
 
     char line[1024];
@@ -261,6 +285,7 @@ static void load_mtllib(const char* path, const char* mtlfile) {
     }
 
     fclose(fd);
+    return true;
 }
 
 static material_t* get_material(const char* mtl) {
@@ -285,6 +310,7 @@ static void add_surface(array_t* surfaces, const char* mtl) {
             surface->colour = material->colour;
             if (material->image) {
                 surface->image = image_load(material->image);
+                surface->image_name = strdup(material->image);
             }
         } else {
             surface->colour = hash_colour(mtl);
@@ -294,8 +320,12 @@ static void add_surface(array_t* surfaces, const char* mtl) {
     }
 }
 
-static void surface_free_resources(surface_t* surface) {
-    free(surface->indices);
+static void surface_free_resources(surface_t* surface, bool mapped) {
+    if (!mapped) {
+        free(surface->indices);
+        free(surface->clusters);
+    }
+    free(surface->image_name);
     if (surface->image) {
         image_free(surface->image);
     }
@@ -305,7 +335,7 @@ static void surface_free_resources(surface_t* surface) {
 static void pop_surface(array_t* surfaces) {
     if (surfaces->count > 0) {
         --surfaces->count;
-        surface_free_resources(&((surface_t*)surfaces->data)[surfaces->count]);
+        surface_free_resources(&((surface_t*)surfaces->data)[surfaces->count], false);
     }
 }
 
@@ -317,16 +347,17 @@ static void apply_indices_to_surface(surface_t* surface, array_t* indices) {
 }
 
 static void clear_scratch_arrays() {
-    memset(scratch_vertex_list, 0xff, sizeof(scratch_vertex_list));
-
+    array_clear(&scratch_vertex_table);
     array_clear(&scratch_vertices);
     array_clear(&scratch_edges);
-    array_clear(&scratch_edge_exists);
+    array_clear(&scratch_edge_table);
+    array_clear(&scratch_edge_faces);
     array_clear(&scratch_positions);
     array_clear(&scratch_texcoords);
     array_clear(&scratch_indices);
     array_clear(&scratch_surfaces);
     array_clear(&scratch_materials);
+    array_clear(&scratch_mtllibs);
 #ifdef VERTEX_NORMALS
     array_clear(&scratch_normals);
 
@@ -336,79 +367,393 @@ static void clear_scratch_arrays() {
     array_reserve(&scratch_positions, 16384);
     array_reserve(&scratch_texcoords, 16384);
     array_reserve(&scratch_edges, 16384);
-    array_reserve(&scratch_edge_exists, 16384);
     array_reserve(&scratch_indices, 65536);
     array_reserve(&scratch_surfaces, 256);
     array_reserve(&scratch_materials, 256);
 
 }
 
-model_t* model_load(const char* filename, const model_style_t style) {
-    timespec_t timer = timer_time_now();
+// ritter's sphere: linear time and usually within a few percent of the smallest
+static graphics_sphere_t bounding_sphere(const vertex_t* vertices, const index_t* indices, uint32_t count) {
+    #define POINT(i) (vertices[indices ? indices[i] : (i)].position.v)
 
-    FILE* fd = fopen(filename, "r");
-    if (!fd) {
-        return NULL;
+    graphics_sphere_t sphere = {{0, 0, 0}, 0};
+    if (!count) {
+        return sphere;
     }
 
-    clear_scratch_arrays();
+    const float* one = POINT(0);
+    const float* two = one;
+    for (int pass = 0; pass < 2; ++pass) {
+        float farthest = -1;
+        for (uint32_t i = 0; i < count; ++i) {
+            float distsq = vec3_distance_squared(one, POINT(i));
+            if (distsq > farthest) {
+                farthest = distsq;
+                two = POINT(i);
+            }
+        }
+        if (pass == 0) {
+            one = two;
+        }
+    }
 
-    add_surface(&scratch_surfaces, NULL);
-    pixel_t colour = 0b01010011;
+    vec3_lerp(sphere.centre, one, two, 0.5f);
+    sphere.radius = vec3_distance(one, two) * 0.5f;
 
-    char line[1024];
-    while (fgets(line, sizeof(line), fd)) {
-        switch (line[0]) {
-
-            case 'v': {
-                switch (line[1]) {
-                    case ' ': {
-                        // vertex position
-                        vec3_t* vert = array_push(&scratch_positions);
-                        sscanf(line, "v %f %f %f", &vert->x, &vert->z, &vert->y);
-                        vert->y = -vert->y;
-                    } break;
-
-                    case 't': {
-                        // vertex uv
-                        vec2_t* vert = array_push(&scratch_texcoords);
-                        sscanf(line, "vt %f %f", &vert->x, &vert->y);
-                    } break;
+    for (uint32_t i = 0; i < count; ++i) {
+        float distance = vec3_distance(sphere.centre, POINT(i));
+        if (distance > sphere.radius) {
+            // grow just enough to take in the point, keeping the far side where it was
+            float radius = (sphere.radius + distance) * 0.5f;
+            vec3_lerp(sphere.centre, POINT(i), sphere.centre, radius / distance);
+            sphere.radius = radius;
+        }
+    }
 
-#ifdef VERTEX_NORMALS
-                    case 'n': {
-                        // vertex normal
-                        vec3_t* vert = array_push(&scratch_normals);
-                        sscanf(line, "vn %f %f %f", &vert->x, &vert->z, &vert->y);
-                        vert->y = -vert->y;
-                    } break;
-#endif
-                }
+    #undef POINT
+    return sphere;
+}
 
-            } break;
+static model_cluster_t cluster_indices(const vertex_t* vertices, const index_t* indices, uint32_t count) {
+    model_cluster_t cluster = {
+        .bounds = bounding_sphere(vertices, indices, count),
+        .first_vertex = UINT32_MAX,
+        .last_vertex = 0
+    };
+    for (uint32_t i = 0; i < count; ++i) {
+        cluster.first_vertex = min(cluster.first_vertex, indices[i]);
+        cluster.last_vertex = max(cluster.last_vertex, indices[i]);
+    }
+    return cluster;
+}
 
-            case 'l': {
-                // line
-                int end0, end1;
-                if (sscanf(line, "l %d %d", &end0, &end1) == 2) {
-                    add_unique_edge(get_vertex(end0, 0/*, 0*/), get_vertex(end1, 0/*, 0*/), colour);
-                }
-            } break;
+static void model_split_positions(model_t* model) {
+    for (int c = 0; c < VEC3_SIZE; ++c) {
+        model->positions[c] = malloc(model->vertex_count * sizeof(float));
+        for (uint32_t i = 0; i < model->vertex_count; ++i) {
+            model->positions[c][i] = model->vertices[i].position.v[c];
+        }
+    }
+}
+
+static void model_cluster(model_t* model) {
+    if (!model->vertex_count) {
+        return;
+    }
+
+    model->bounds = bounding_sphere(model->vertices, NULL, model->vertex_count);
+
+    model->edge_cluster_count = (model->edge_count + MODEL_CLUSTER_SIZE - 1) / MODEL_CLUSTER_SIZE;
+    if (model->edge_cluster_count) {
+        model->edge_clusters = malloc(model->edge_cluster_count * sizeof(model_cluster_t));
+        for (uint32_t c = 0; c < model->edge_cluster_count; ++c) {
+            index_t ends[MODEL_CLUSTER_SIZE * 2];
+            uint32_t count = min(MODEL_CLUSTER_SIZE, model->edge_count - c * MODEL_CLUSTER_SIZE);
+            for (uint32_t e = 0; e < count; ++e) {
+                ends[e*2+0] = model->edges[c * MODEL_CLUSTER_SIZE + e].index[0];
+                ends[e*2+1] = model->edges[c * MODEL_CLUSTER_SIZE + e].index[1];
+            }
+            model->edge_clusters[c] = cluster_indices(model->vertices, ends, count * 2);
+        }
+    }
+
+    for (uint32_t s = 0; s < model->surface_count; ++s) {
+        surface_t* surface = &model->surfaces[s];
+        surface->bounds = bounding_sphere(model->vertices, surface->indices, surface->index_count);
+        surface->cluster_count = (surface->index_count / 3 + MODEL_CLUSTER_SIZE - 1) / MODEL_CLUSTER_SIZE;
+        if (surface->cluster_count) {
+            surface->clusters = malloc(surface->cluster_count * sizeof(model_cluster_t));
+            for (uint32_t c = 0; c < surface->cluster_count; ++c) {
+                uint32_t first = c * MODEL_CLUSTER_SIZE * 3;
+                uint32_t count = min(MODEL_CLUSTER_SIZE * 3, surface->index_count - first);
+                surface->clusters[c] = cluster_indices(model->vertices, &surface->indices[first], count);
+            }
+        }
+    }
+
+    model->clustered = true;
+}
+
+// the text is split into chunks of whole lines, each parsed on its own into positions, texcoords and a
+// stream of commands, then the commands are played back in order to build the surfaces
+#define LOAD_CHUNK_MIN (256 * 1024)
+#define LOAD_CHUNKS_PER_THREAD 4
+
+typedef enum {
+    LOAD_FACE,          // count, then count position and texcoord pairs
+    LOAD_LINE,          // two positions
+    LOAD_USEMTL,        // offset of the name from the start of the chunk, and its length
+    LOAD_MTLLIB
+} load_command_t;
+
+typedef struct {
+    const char* begin;
+    const char* end;
+    array_t positions;
+    array_t texcoords;
+    array_t commands;
+} load_chunk_t;
+
+static inline bool is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline const char* skip_blanks(const char* c, const char* end) {
+    while (c < end && is_blank(*c)) {
+        ++c;
+    }
+    return c;
+}
+
+static const char* scan_int(const char* c, const char* end, int32_t* value, bool* found) {
+    bool negative = (c < end && *c == '-');
+    if (c < end && (*c == '-' || *c == '+')) {
+        ++c;
+    }
+
+    const char* digits = c;
+    int32_t result = 0;
+    while (c < end && (uint)(*c - '0') < 10) {
+        result = result * 10 + (*c - '0');
+        ++c;
+    }
+
+    *found = (c != digits);
+    *value = negative ? -result : result;
+    return c;
+}
+
+static const char* scan_float(const char* c, const char* end, float* value, bool* found) {
+    static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+    const char* start = c;
+    bool negative = (c < end && *c == '-');
+    if (c < end && (*c == '-' || *c == '+')) {
+        ++c;
+    }
+
+    // up to 19 significant digits fit the mantissa, the rest only move the exponent
+    uint64_t mantissa = 0;
+    int digit_count = 0;
+    int exponent = 0;
+    const char* digits = c;
+    for (; c < end && (uint)(*c - '0') < 10; ++c) {
+        if (digit_count < 19) {
+            mantissa = mantissa * 10 + (*c - '0');
+            digit_count += (mantissa != 0);
+        } else {
+            ++exponent;
+        }
+    }
+    if (c < end && *c == '.') {
+        for (++c; c < end && (uint)(*c - '0') < 10; ++c) {
+            if (digit_count < 19) {
+                mantissa = mantissa * 10 + (*c - '0');
+                digit_count += (mantissa != 0);
+                --exponent;
+            }
+        }
+    }
+    if (c == digits || (c == digits + 1 && *digits == '.')) {
+        *found = false;
+        *value = 0;
+        return start;
+    }
+
+    if (c < end && (*c == 'e' || *c == 'E')) {
+        int32_t power;
+        bool has_power;
+        const char* after = scan_int(c + 1, end, &power, &has_power);
+        if (has_power) {
+            exponent += power;
+            c = after;
+        }
+    }
+
+    double result = (double)mantissa;
+    if (exponent < 0) {
+        result = (exponent >= -22) ? result / powers[-exponent] : result * pow(10, exponent);
+    } else if (exponent > 0) {
+        result = (exponent <= 22) ? result * powers[exponent] : result * pow(10, exponent);
+    }
+
+    *found = true;
+    *value = negative ? -(float)result : (float)result;
+    return c;
+}
+
+static const char* scan_floats(const char* c, const char* end, float* values, int count) {
+    for (int i = 0; i < count; ++i) {
+        bool found;
+        c = scan_float(skip_blanks(c, end), end, &values[i], &found);
+    }
+    return c;
+}
+
+static int32_t* push_commands(array_t* commands, size_t count) {
+    array_resize(commands, commands->count + count);
+    return array_get(commands, commands->count - count);
+}
+
+static void parse_name(load_chunk_t* chunk, load_command_t command, const char* name, const char* eol) {
+    name = skip_blanks(name, eol);
+    while (eol > name && is_blank(eol[-1])) {
+        --eol;
+    }
+
+    int32_t* words = push_commands(&chunk->commands, 3);
+    words[0] = command;
+    words[1] = name - chunk->begin;
+    words[2] = eol - name;
+}
+
+static void parse_face(load_chunk_t* chunk, const char* c, const char* eol) {
+    size_t start = chunk->commands.count;
+    int32_t* header = push_commands(&chunk->commands, 2);
+    header[0] = LOAD_FACE;
+    header[1] = 0;
+
+    int32_t count = 0;
+    for (c = skip_blanks(c, eol); c < eol; c = skip_blanks(c, eol)) {
+        int32_t position = 0, texcoord = 0;
+        bool found;
+        c = scan_int(c, eol, &position, &found);
+        if (c < eol && *c == '/' && (c + 1 == eol || c[1] != '/')) {
+            c = scan_int(c + 1, eol, &texcoord, &found);
+        }
+        // normals aren't used
+        while (c < eol && !is_blank(*c)) {
+            ++c;
+        }
+
+        int32_t* pair = push_commands(&chunk->commands, 2);
+        pair[0] = position;
+        pair[1] = texcoord;
+        ++count;
+    }
+
+    ((int32_t*)array_get(&chunk->commands, start))[1] = count;
+}
+
+static void parse_line(load_chunk_t* chunk, const char* line, const char* eol) {
+    switch (line[0]) {
+
+        case 'v': {
+            if (line + 1 < eol && is_blank(line[1])) {
+                // vertex position
+                float xzy[3] = {0, 0, 0};
+                scan_floats(line + 1, eol, xzy, 3);
+                vec3_t* vert = array_push(&chunk->positions);
+                vert->x = xzy[0];
+                vert->y = -xzy[2];
+                vert->z = xzy[1];
+            } else if (line + 2 < eol && line[1] == 't' && is_blank(line[2])) {
+                // vertex uv
+                vec2_t* vert = array_push(&chunk->texcoords);
+                vert->x = vert->y = 0;
+                scan_floats(line + 2, eol, vert->v, 2);
+            }
+        } break;
+
+        case 'l': {
+            // line
+            int32_t ends[2];
+            bool found[2];
+            const char* c = scan_int(skip_blanks(line + 1, eol), eol, &ends[0], &found[0]);
+            scan_int(skip_blanks(c, eol), eol, &ends[1], &found[1]);
+            if (found[0] && found[1]) {
+                int32_t* words = push_commands(&chunk->commands, 3);
+                words[0] = LOAD_LINE;
+                words[1] = ends[0];
+                words[2] = ends[1];
+            }
+        } break;
+
+        case 'f': {
+            // face
+            parse_face(chunk, line + 1, eol);
+        } break;
+
+        case 'm': {
+            if (eol - line > 7 && strncasecmp(line, "mtllib ", 7) == 0) {
+                parse_name(chunk, LOAD_MTLLIB, line + 7, eol);
+            }
+        } break;
+
+        case 'u': {
+            if (eol - line > 7 && strncasecmp(line, "usemtl ", 7) == 0) {
+                parse_name(chunk, LOAD_USEMTL, line + 7, eol);
+            }
+        } break;
+
+    }
+}
+
+static void parse_chunk(void* context, int job) {
+    load_chunk_t* chunk = &((load_chunk_t*)context)[job];
+
+    for (const char* line = chunk->begin; line < chunk->end; ) {
+        const char* eol = memchr(line, '\n', chunk->end - line);
+        if (!eol) {
+            eol = chunk->end;
+        }
+        parse_line(chunk, line, eol);
+        line = eol + 1;
+    }
+}
+
+// obj indices count from one, anything missing or out of range reads as zeroes
+static const float* scratch_lookup(array_t* array, index_t index) {
+    static const float zero[VEC3_SIZE];
+    return (index >= 1 && index <= array->count) ? array_get(array, index - 1) : zero;
+}
+
+static void load_mtllib_for(const char* filename, const char* mtlfile) {
+    bool loaded;
+    char* sep = strrchr(filename, '/');
+    if (sep) {
+        size_t pathlen = sep - filename;
+        char path[pathlen + 2];
+        memcpy(path, filename, pathlen + 1);
+        path[pathlen + 1] = '\0';
+        loaded = load_mtllib(path, mtlfile);
+    } else {
+        loaded = load_mtllib("", mtlfile);
+    }
+
+    // remembered for the cache, which is stale once any of them changes
+    if (loaded) {
+        *(char**)array_push(&scratch_mtllibs) = strdup(mtlfile);
+    }
+}
 
-            case 'f': {
-                // face
+static void assemble_chunk(const load_chunk_t* chunk, const char* filename, model_style_t style, pixel_t* colour) {
+    const int32_t* words = chunk->commands.data;
+    const int32_t* end = words + chunk->commands.count;
+
+    while (words < end) {
+        switch (words[0]) {
+
+            case LOAD_FACE: {
                 const bool wireframe = (style == STYLE_WIREFRAME_ALWAYS)
                                    || ((style == STYLE_WIREFRAME_IF_UNDEFINED) && (!scratch_materials.count));
 
-                char* last = strrchr(line, ' ');
-                if (last) {
+                // features are found from triangles, joined up by position alone so texture seams don't show
+                const bool position_only = wireframe || (style == STYLE_WIREFRAME_FEATURES);
+
+                int32_t count = words[1];
+                const int32_t* pairs = &words[2];
+                if (count > 0) {
+                    #define FACE_VERTEX(i) get_vertex(pairs[(i)*2], position_only ? 0 : pairs[(i)*2+1])
+
                     int vzero = -1;
-                    int vprev = parse_vertex(last+1, wireframe);
-                    for (char* tok = line+1; tok && *tok; tok = strchr(tok+1, ' ')) {
-                        int vcurr = parse_vertex(tok+1, wireframe);
-                        
+                    int vprev = FACE_VERTEX(count - 1);
+                    for (int32_t i = 0; i < count; ++i) {
+                        int vcurr = FACE_VERTEX(i);
+
                         if (wireframe) {
-                            add_unique_edge(vprev, vcurr, colour);
+                            add_unique_edge(vprev, vcurr, *colour);
                         } else {
                             if (vzero < 0) {
                                 vzero = vcurr;
@@ -416,34 +761,28 @@ model_t* model_load(const char* filename, const model_style_t style) {
                                 add_triangle(vzero, vprev, vcurr);
                             }
                         }
-                        
+
                         vprev = vcurr;
                     }
+
+                    #undef FACE_VERTEX
                 }
+                words += 2 + count * 2;
             } break;
 
-            case 'm': {
-                if (strncasecmp(line, "mtllib ", 7) == 0) {
-                    trim_trailing_whitespace(line);
-
-                    char* sep = strrchr(filename, '/');
-                    if (sep) {
-                        size_t pathlen = sep - filename;
-                        char path[pathlen + 2];
-                        memcpy(path, filename, pathlen + 1);
-                        path[pathlen + 1] = '\0';
-                        load_mtllib(path, &line[7]);
-                    } else {
-                        load_mtllib("", &line[7]);
-                    }
-
-                }
+            case LOAD_LINE: {
+                add_unique_edge(get_vertex(words[1], 0/*, 0*/), get_vertex(words[2], 0/*, 0*/), *colour);
+                words += 3;
             } break;
 
-            case 'u': {
-                if (strncasecmp(line, "usemtl ", 7) == 0) {
-                    trim_trailing_whitespace(line);
+            case LOAD_MTLLIB:
+            case LOAD_USEMTL: {
+                char name[PATH_MAX];
+                snprintf(name, sizeof(name), "%.*s", (int)words[2], chunk->begin + words[1]);
 
+                if (words[0] == LOAD_MTLLIB) {
+                    load_mtllib_for(filename, name);
+                } else {
                     if (scratch_indices.count > 0) {
                         // add all the current face data to the current surface
                         apply_indices_to_surface(array_get(&scratch_surfaces, scratch_surfaces.count-1), &scratch_indices);
@@ -453,17 +792,250 @@ model_t* model_load(const char* filename, const model_style_t style) {
                     }
 
                     // start a new surface
-                    add_surface(&scratch_surfaces, &line[7]);
-                    colour = ((surface_t*)array_get(&scratch_surfaces, scratch_surfaces.count-1))->colour;
+                    add_surface(&scratch_surfaces, name);
+                    *colour = ((surface_t*)array_get(&scratch_surfaces, scratch_surfaces.count-1))->colour;
                 }
+                words += 3;
+            } break;
 
+            default: {
+                words = end;
             } break;
+        }
+    }
+}
 
+static bool parse_obj(const char* filename, model_style_t style) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat sb;
+    if (fstat(fd, &sb) != 0) {
+        close(fd);
+        return false;
+    }
+
+    size_t size = sb.st_size;
+    const char* text = size ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+    if (text == MAP_FAILED) {
+        return false;
+    }
+    if (text) {
+        madvise((void*)text, size, MADV_WILLNEED);
+    }
+
+    int thread_count = max(1, (int)sysconf(_SC_NPROCESSORS_ONLN));
+    int chunk_count = clamp((int)(size / LOAD_CHUNK_MIN), 1, thread_count * LOAD_CHUNKS_PER_THREAD);
+    load_chunk_t* chunks = calloc(chunk_count, sizeof(load_chunk_t));
+
+    // chunks end after the first newline past their share of the file
+    const char* begin = text;
+    const char* end = text + size;
+    for (int i = 0; i < chunk_count; ++i) {
+        load_chunk_t* chunk = &chunks[i];
+        chunk->positions.size = sizeof(vec3_t);
+        chunk->texcoords.size = sizeof(vec2_t);
+        chunk->commands.size = sizeof(int32_t);
+
+        const char* split = (i == chunk_count - 1) ? end : text + (size * (i + 1)) / chunk_count;
+        if (split < begin) {
+            split = begin;
         }
+        const char* newline = (split < end) ? memchr(split, '\n', end - split) : NULL;
+        chunk->begin = begin;
+        chunk->end = newline ? newline + 1 : end;
+        begin = chunk->end;
+    }
 
+    workers_t* workers = workers_create(min(thread_count, chunk_count));
+    workers_run(workers, parse_chunk, chunks, chunk_count);
+    workers_destroy(workers);
+
+    // positions and texcoords are numbered through the whole file, so join them up before the faces use them
+    for (int i = 0; i < chunk_count; ++i) {
+        array_t* parts[2][2] = {{&scratch_positions, &chunks[i].positions}, {&scratch_texcoords, &chunks[i].texcoords}};
+        for (int a = 0; a < 2; ++a) {
+            array_t* to = parts[a][0];
+            array_t* from = parts[a][1];
+            if (from->count) {
+                size_t first = to->count;
+                array_resize(to, first + from->count);
+                memcpy(array_get(to, first), from->data, from->count * from->size);
+            }
+        }
     }
 
-    fclose(fd);
+    add_surface(&scratch_surfaces, NULL);
+    pixel_t colour = 0b01010011;
+
+    for (int i = 0; i < chunk_count; ++i) {
+        assemble_chunk(&chunks[i], filename, style, &colour);
+        array_destroy(&chunks[i].positions);
+        array_destroy(&chunks[i].texcoords);
+        array_destroy(&chunks[i].commands);
+    }
+
+    free(chunks);
+    if (text) {
+        munmap((void*)text, size);
+    }
+
+    return true;
+}
+
+// replaces the model's surfaces with edges where they border nothing, or meet each other at a crease
+static void extract_feature_edges(model_t* model) {
+    const float crease = cosf(to_radians(MODEL_FEATURE_CREASE_DEGREES));
+
+    array_clear(&scratch_edges);
+    array_clear(&scratch_edge_table);
+    array_clear(&scratch_edge_faces);
+
+    // lines from the file border no faces, so they're always kept
+    for (uint32_t e = 0; e < model->edge_count; ++e) {
+        bool added;
+        get_edge(model->edges[e].index[0], model->edges[e].index[1], model->edges[e].colour, &added);
+        if (added) {
+            *(edge_faces_t*)array_push(&scratch_edge_faces) = (edge_faces_t){.face_count = 0, .min_dot = 1};
+        }
+    }
+    free(model->edges);
+
+    for (uint32_t s = 0; s < model->surface_count; ++s) {
+        const surface_t* surface = &model->surfaces[s];
+        for (uint32_t i = 0; i + 2 < surface->index_count; i += 3) {
+            const index_t* triangle = &surface->indices[i];
+
+            vec3_t normal, one, two;
+            vec3_subtract(one.v, model->vertices[triangle[1]].position.v, model->vertices[triangle[0]].position.v);
+            vec3_subtract(two.v, model->vertices[triangle[2]].position.v, model->vertices[triangle[0]].position.v);
+            vec3_cross(normal.v, one.v, two.v);
+            if (vec3_length_squared(normal.v) <= 0) {
+                continue;
+            }
+            vec3_normalize(normal.v, normal.v);
+
+            for (int k = 0; k < 3; ++k) {
+                bool added;
+                uint32_t e = get_edge(triangle[k], triangle[(k + 1) % 3], surface->colour, &added);
+                if (added) {
+                    edge_faces_t* faces = array_push(&scratch_edge_faces);
+                    faces->normal = normal;
+                    faces->face_count = 1;
+                    faces->min_dot = 1;
+                } else {
+                    edge_faces_t* faces = array_get(&scratch_edge_faces, e);
+                    faces->face_count += 1;
+                    faces->min_dot = min(faces->min_dot, vec3_dot(faces->normal.v, normal.v));
+                }
+            }
+        }
+    }
+
+    const edge_t* edges = scratch_edges.data;
+    const edge_faces_t* faces = scratch_edge_faces.data;
+    model->edge_count = 0;
+    model->edges = malloc(max(scratch_edges.count, (size_t)1) * sizeof(edge_t));
+    for (uint32_t e = 0; e < scratch_edges.count; ++e) {
+        if (faces[e].face_count != 2 || faces[e].min_dot < crease) {
+            model->edges[model->edge_count++] = edges[e];
+        }
+    }
+
+    for (uint32_t s = 0; s < model->surface_count; ++s) {
+        surface_free_resources(&model->surfaces[s], false);
+    }
+    free(model->surfaces);
+    model->surfaces = NULL;
+    model->surface_count = 0;
+}
+
+static uint32_t model_triangle_count(const model_t* model) {
+    uint32_t count = 0;
+    for (uint32_t s = 0; s < model->surface_count; ++s) {
+        count += model->surfaces[s].index_count / 3;
+    }
+    return count;
+}
+
+static float mean_edge_length(const model_t* model) {
+    double total = 0;
+    uint32_t count = 0;
+    for (uint32_t s = 0; s < model->surface_count; ++s) {
+        const surface_t* surface = &model->surfaces[s];
+        for (uint32_t i = 0; i < surface->index_count; ++i) {
+            uint32_t next = (i % 3 == 2) ? i - 2 : i + 1;
+            total += vec3_distance(model->vertices[surface->indices[i]].position.v, model->vertices[surface->indices[next]].position.v);
+        }
+        count += surface->index_count;
+    }
+    return count ? (float)(total / count) : 0;
+}
+
+// coarser levels only carry triangles, so models with lines keep the one level
+static void model_build_lods(model_t* model) {
+    if (model->edge_count || model_triangle_count(model) < MODEL_LOD_MIN_TRIANGLES * 4) {
+        return;
+    }
+
+    model->triangle_size = mean_edge_length(model);
+
+    model_t* level = model;
+    for (int l = 0; l < MODEL_LOD_LEVELS; ++l) {
+        uint32_t triangle_count = model_triangle_count(level);
+        if (triangle_count < MODEL_LOD_MIN_TRIANGLES * 4) {
+            break;
+        }
+
+        model_t* coarser = simplify_model(level, triangle_count / 4);
+        if (!coarser) {
+            break;
+        }
+
+        model_split_positions(coarser);
+        model_cluster(coarser);
+        coarser->triangle_size = mean_edge_length(coarser);
+
+        level->coarser = coarser;
+        level = coarser;
+    }
+}
+
+// the coarsest level whose triangles are still small enough under matrix
+static const model_t* model_level(const model_t* model, const float* matrix) {
+    if (!model->coarser) {
+        return model;
+    }
+
+    float scale = 0;
+    for (int c = 0; c < 3; ++c) {
+        scale = max(scale, vec3_length_squared(&matrix[c * 4]));
+    }
+    scale = sqrtf(scale);
+
+    while (model->coarser && model->coarser->triangle_size * scale <= MODEL_LOD_VOXELS) {
+        model = model->coarser;
+    }
+    return model;
+}
+
+model_t* model_load(const char* filename, const model_style_t style) {
+    timespec_t timer = timer_time_now();
+
+    model_t* cached = model_cache_load(filename, style);
+    if (cached) {
+        printf("v %u  e %u  s %u   %d ms cached\n", cached->vertex_count, cached->edge_count, cached->surface_count, timer_elapsed_ms(&timer));
+        return cached;
+    }
+
+    clear_scratch_arrays();
+
+    if (!parse_obj(filename, style)) {
+        return NULL;
+    }
 
     if (scratch_indices.count > 0) {
         apply_indices_to_surface(array_get(&scratch_surfaces, scratch_surfaces.count-1), &scratch_indices);
@@ -480,8 +1052,8 @@ model_t* model_load(const char* filename, const model_style_t style) {
         for (int i = 0; i < model->vertex_count; ++i) {
             vertex_tuple_t* ivert = array_get(&scratch_vertices, i);
             vertex_t* mvert = &model->vertices[i];
-            vec3_assign(mvert->position.v, ((vec3_t*)array_get(&scratch_positions, clamp(ivert->position-1, 0, scratch_positions.capacity-1)))->v);
-            vec2_assign(mvert->texcoord.v, ((vec3_t*)array_get(&scratch_texcoords, clamp(ivert->texcoord-1, 0, scratch_texcoords.capacity-1)))->v);
+            vec3_assign(mvert->position.v, scratch_lookup(&scratch_positions, ivert->position));
+            vec2_assign(mvert->texcoord.v, scratch_lookup(&scratch_texcoords, ivert->texcoord));
 #ifdef VERTEX_NORMALS
             vec3_assign(mvert->normal.v, ((vec3_t*)array_get(&scratch_normals, clamp(ivert->v[2]-1, 0, scratch_normals.capacity-1)))->v);
 #endif
@@ -500,6 +1072,15 @@ model_t* model_load(const char* filename, const model_style_t style) {
         memcpy(model->surfaces, scratch_surfaces.data, model->surface_count * sizeof(surface_t));
     }
 
+    if (style == STYLE_WIREFRAME_FEATURES) {
+        extract_feature_edges(model);
+    }
+
+    model_split_positions(model);
+    model_cluster(model);
+    model_build_lods(model);
+    model_cache_save(filename, style, model, &scratch_mtllibs);
+
     /*for (int i = 0; i < scratch_vertices.count; ++i) {
         vertex_tuple_t* ivert = array_get(&scratch_vertices, i);
         printf("%d %d %d\n", ivert->x, ivert->y, ivert->z);
@@ -507,9 +1088,11 @@ model_t* model_load(const char* filename, const model_style_t style) {
    
     printf("v %ld  e %ld  s %ld   %d ms\n", scratch_vertices.count, scratch_edges.count, scratch_surfaces.count, timer_elapsed_ms(&timer));
 
+    array_clear(&scratch_vertex_table);
     array_clear(&scratch_vertices);
     array_clear(&scratch_edges);
-    array_clear(&scratch_edge_exists);
+    array_clear(&scratch_edge_table);
+    array_clear(&scratch_edge_faces);
     array_clear(&scratch_positions);
 #ifdef VERTEX_NORMALS
     array_clear(&scratch_normals);
@@ -525,6 +1108,11 @@ model_t* model_load(const char* filename, const model_style_t style) {
     }
     array_clear(&scratch_materials);
 
+    for (int i = 0; i < scratch_mtllibs.count; ++i) {
+        free(*(char**)array_get(&scratch_mtllibs, i));
+    }
+    array_clear(&scratch_mtllibs);
+
     return model;
 }
 
@@ -552,7 +1140,7 @@ model_t* model_load_image(const char* filename) {
     vertex_assign(&model->vertices[3], -sx, 0,  sy,  0, 1,  0, -1, 0);
 
     model->surface_count = 1;
-    model->surfaces = malloc(model->surface_count * sizeof(surface_t));
+    model->surfaces = calloc(model->surface_count, sizeof(surface_t));
     model->surfaces[0].colour = HEXPIX(FFFFFF);
     model->surfaces[0].index_count = 6;
     model->surfaces[0].indices = malloc(model->surfaces[0].index_count * sizeof(index_t));
@@ -562,73 +1150,271 @@ model_t* model_load_image(const char* filename) {
 
     model->surfaces[0].image = image;
 
+    model_split_positions(model);
+    model_cluster(model);
+
     return model;
 }
 
 void model_set_colour(model_t* model, pixel_t colour) {
-    for (int i = 0; i < model->surface_count; ++i) {
-        model->surfaces[i].colour = colour;
+    for (; model; model = model->coarser) {
+        for (int i = 0; i < model->surface_count; ++i) {
+            model->surfaces[i].colour = colour;
+        }
+
+        for (int i = 0; i < model->edge_count; ++i) {
+            model->edges[i].colour = colour;
+        }
     }
+}
 
-    for (int i = 0; i < model->edge_count; ++i) {
-        model->edges[i].colour = colour;
+static void model_free_level(model_t* model, bool mapped) {
+    if (!mapped) {
+        free(model->edges);
+        free(model->edge_clusters);
+        free(model->vertices);
+        for (int c = 0; c < VEC3_SIZE; ++c) {
+            free(model->positions[c]);
+        }
+    }
+    if (model->surfaces) {
+        for (int i = 0; i < model->surface_count; ++i) {
+            surface_free_resources(&model->surfaces[i], mapped);
+        }
+        free(model->surfaces);
     }
+    free(model);
 }
 
 void model_free(model_t* model) {
     if (model) {
-        free(model->edges);
-        free(model->vertices);
-        if (model->surfaces) {
-            for (int i = 0; i < model->surface_count; ++i) {
-                surface_free_resources(&model->surfaces[i]);
+        bool mapped = model->mapping != NULL;
+        void* mapping = model->mapping;
+        size_t mapping_size = model->mapping_size;
+
+        // coarser levels borrow the finest level's images
+        for (model_t* level = model->coarser; level;) {
+            model_t* next = level->coarser;
+            for (uint32_t s = 0; s < level->surface_count; ++s) {
+                level->surfaces[s].image = NULL;
             }
-            free(model->surfaces);
+            model_free_level(level, mapped);
+            level = next;
+        }
+        model_free_level(model, mapped);
+
+        if (mapped) {
+            munmap(mapping, mapping_size);
         }
-        free(model);
     }
 }
 
 
-void model_draw(pixel_t* volume, const model_t* model, float* matrix) {
-    array_reserve(&scratch_positions, model->vertex_count);
-    if (!scratch_positions.data) {
-        exit(1);
+static vec3_t* reserve_positions(const model_t* model, uint8_t** outcodes) {
+    *outcodes = arena_alloc(model->vertex_count);
+    return arena_alloc(model->vertex_count * sizeof(vec3_t));
+}
+
+static void transform_range(const model_t* model, const float* matrix, vec3_t* transformed, uint8_t* outcodes, uint32_t first, uint32_t count) {
+    if (model->positions[0]) {
+        const float* positions[VEC3_SIZE] = {&model->positions[0][first], &model->positions[1][first], &model->positions[2][first]};
+        graphics_transform_positions(transformed[first].v, &outcodes[first], positions, count, matrix);
+    } else {
+        for (uint32_t i = first; i < first + count; ++i) {
+            vec3_transform(transformed[i].v, model->vertices[i].position.v, matrix);
+            outcodes[i] = graphics_outcode(transformed[i].v);
+        }
+    }
+    model_cull_stats.vertices_transformed += count;
+}
+
+static vec3_t* transform_positions(const model_t* model, float* matrix, uint8_t** outcodes) {
+    vec3_t* transformed = reserve_positions(model, outcodes);
+    transform_range(model, matrix, transformed, *outcodes, 0, model->vertex_count);
+    model_cull_stats.vertices += model->vertex_count;
+    return transformed;
+}
+
+static graphics_cull_t cull_sphere(const graphics_sphere_t* sphere, const float* matrix) {
+    graphics_sphere_t transformed = graphics_sphere_transform(sphere, matrix);
+    return graphics_cull_sphere(&transformed);
+}
+
+// a parent wholly inside or outside the cylinder decides for all of its clusters
+static void cull_clusters(uint8_t* visibility, uint8_t* blocks, const model_cluster_t* clusters, uint32_t cluster_count, uint32_t primitive_count, graphics_cull_t parent, const float* matrix) {
+    for (uint32_t c = 0; c < cluster_count; ++c) {
+        graphics_cull_t cull = (parent == GRAPHICS_CULL_INTERSECTS) ? cull_sphere(&clusters[c].bounds, matrix) : parent;
+        visibility[c] = cull;
+
+        if (cull == GRAPHICS_CULL_OUTSIDE) {
+            model_cull_stats.clusters_culled += 1;
+            model_cull_stats.primitives_culled += min(MODEL_CLUSTER_SIZE, primitive_count - c * MODEL_CLUSTER_SIZE);
+        } else {
+            model_cull_stats.clusters_clipped += (cull == GRAPHICS_CULL_INTERSECTS);
+            for (uint32_t b = clusters[c].first_vertex / VERTEX_BLOCK_SIZE; b <= clusters[c].last_vertex / VERTEX_BLOCK_SIZE; ++b) {
+                blocks[b] = 1;
+            }
+        }
+    }
+
+    model_cull_stats.clusters += cluster_count;
+    model_cull_stats.primitives += primitive_count;
+}
+
+// culls every cluster against the display cylinder and transforms only the vertices the survivors refer to
+static vec3_t* cull_model(const model_t* model, float* matrix, uint8_t** visibility, uint8_t** outcodes) {
+    if (!model->clustered) {
+        *visibility = NULL;
+        return transform_positions(model, matrix, outcodes);
+    }
+
+    uint32_t cluster_count = model->edge_cluster_count;
+    for (uint32_t s = 0; s < model->surface_count; ++s) {
+        cluster_count += model->surfaces[s].cluster_count;
+    }
+    uint32_t block_count = (model->vertex_count + VERTEX_BLOCK_SIZE - 1) / VERTEX_BLOCK_SIZE;
+
+    uint8_t* cull = arena_alloc(cluster_count);
+    uint8_t* blocks = arena_alloc(block_count);
+    memset(blocks, 0, block_count);
+    *visibility = cull;
+
+    graphics_cull_t whole = cull_sphere(&model->bounds, matrix);
+
+    cull_clusters(cull, blocks, model->edge_clusters, model->edge_cluster_count, model->edge_count, whole, matrix);
+    cull += model->edge_cluster_count;
+
+    for (uint32_t s = 0; s < model->surface_count; ++s) {
+        const surface_t* surface = &model->surfaces[s];
+        graphics_cull_t parent = (whole == GRAPHICS_CULL_INTERSECTS) ? cull_sphere(&surface->bounds, matrix) : whole;
+        cull_clusters(cull, blocks, surface->clusters, surface->cluster_count, surface->index_count / 3, parent, matrix);
+        cull += surface->cluster_count;
+    }
+
+    vec3_t* transformed = reserve_positions(model, outcodes);
+    for (uint32_t b = 0; b < block_count;) {
+        if (!blocks[b]) {
+            ++b;
+            continue;
+        }
+        uint32_t end = b + 1;
+        while (end < block_count && blocks[end]) {
+            ++end;
+        }
+        uint32_t first = b * VERTEX_BLOCK_SIZE;
+        transform_range(model, matrix, transformed, *outcodes, first, min(end * VERTEX_BLOCK_SIZE, model->vertex_count) - first);
+        b = end;
     }
-    scratch_positions.count = 0;
+    model_cull_stats.vertices += model->vertex_count;
+
+    return transformed;
+}
 
-    //timespec_t timer = timer_time_now();
+// steps through runs of visible clusters that share a clip, giving the range of primitives they cover.
+// without visibility everything is drawn as one run clipped to the volume
+static bool next_run(const uint8_t* visibility, uint32_t cluster_count, uint32_t primitive_count, uint32_t* cursor, uint32_t* first, uint32_t* count, const graphics_box_t** clip) {
+    if (!visibility) {
+        *first = 0;
+        *count = primitive_count;
+        *clip = &graphics_volume_box;
+        return (*cursor)++ == 0 && primitive_count > 0;
+    }
 
-    vec3_t* transformed = scratch_positions.data;
-    for (uint i = 0; i < model->vertex_count; ++i) {
-        vec3_transform(transformed[i].v, model->vertices[i].position.v, matrix);
+    uint32_t start = *cursor;
+    while (start < cluster_count && visibility[start] == GRAPHICS_CULL_OUTSIDE) {
+        ++start;
+    }
+    if (start >= cluster_count) {
+        return false;
     }
 
-    for (uint i = 0; i < model->edge_count; ++i) {
-        edge_t* edge = &model->edges[i];
-        graphics_draw_line(volume, transformed[edge->index[0]].v, transformed[edge->index[1]].v, edge->colour);
+    uint32_t end = start + 1;
+    while (end < cluster_count && visibility[end] == visibility[start]) {
+        ++end;
+    }
+
+    *cursor = end;
+    *first = start * MODEL_CLUSTER_SIZE;
+    *count = min(end * MODEL_CLUSTER_SIZE, primitive_count) - *first;
+    *clip = (visibility[start] == GRAPHICS_CULL_INSIDE) ? &graphics_volume_box : &graphics_cylinder_box;
+    return true;
+}
+
+static graphics_material_t surface_material(const surface_t* surface, graphics_span_shader_t shader) {
+    return (graphics_material_t){.colour = surface->colour, .texture = surface->image, .shader = shader};
+}
+
+void model_draw(pixel_t* volume, const model_t* model, float* matrix) {
+    model_draw_shaded(volume, model, matrix, graphics_triangle_shader_cb);
+}
+
+void model_draw_shaded(pixel_t* volume, const model_t* model, float* matrix, graphics_span_shader_t shader) {
+    model = model_level(model, matrix);
+    arena_mark_t mark = arena_mark();
+
+    uint8_t* visibility;
+    uint8_t* outcodes;
+    vec3_t* transformed = cull_model(model, matrix, &visibility, &outcodes);
+
+    uint32_t cursor, first, count;
+    const graphics_box_t* clip;
+
+    // lines are only culled, the cylinder doesn't clip them
+    for (cursor = 0; next_run(visibility, model->edge_cluster_count, model->edge_count, &cursor, &first, &count, &clip);) {
+        graphics_draw_edges_clipped(volume, transformed[0].v, outcodes, &model->edges[first], count, &graphics_volume_box);
+    }
+    if (visibility) {
+        visibility += model->edge_cluster_count;
     }
 
     for (uint s = 0; s < model->surface_count; ++s) {
         surface_t* surface = &model->surfaces[s];
-        for (uint t = 2; t < surface->index_count; t += 3) {
-            if (surface->image) {
-                graphics_triangle_texture(
-                        model->vertices[surface->indices[t-2]].texcoord.v,
-                        model->vertices[surface->indices[t-1]].texcoord.v,
-                        model->vertices[surface->indices[t  ]].texcoord.v,
-                        surface->image);
-            } else {
-                graphics_triangle_colour(surface->colour);
-            }
-            graphics_draw_triangle( volume,
-                        transformed[surface->indices[t-2]].v,
-                        transformed[surface->indices[t-1]].v,
-                        transformed[surface->indices[t  ]].v);
+        graphics_material_t material = surface_material(surface, shader);
+        for (cursor = 0; next_run(visibility, surface->cluster_count, surface->index_count / 3, &cursor, &first, &count, &clip);) {
+            graphics_draw_triangles_clipped(volume, transformed[0].v, outcodes, surface->image ? model->vertices[0].texcoord.v : NULL, sizeof(vertex_t) / sizeof(float),
+                                            &surface->indices[first * 3], count * 3, &material, clip);
+        }
+        if (visibility) {
+            visibility += surface->cluster_count;
         }
     }
 
-    //printf("%ld ms\n", timer_elapsed_ms(&timer));
+    arena_rewind(mark);
+}
+
+void model_render(render_context_t* context, const model_t* model, float* matrix) {
+    model_render_shaded(context, model, matrix, graphics_triangle_shader_cb);
+}
+
+void model_render_shaded(render_context_t* context, const model_t* model, float* matrix, graphics_span_shader_t shader) {
+    model = model_level(model, matrix);
+
+    uint8_t* visibility;
+    uint8_t* outcodes;
+    vec3_t* transformed = cull_model(model, matrix, &visibility, &outcodes);
+    uint32_t positions = render_positions(context, transformed[0].v, model->vertex_count);
+
+    uint32_t cursor, first, count;
+    const graphics_box_t* clip;
+
+    for (cursor = 0; next_run(visibility, model->edge_cluster_count, model->edge_count, &cursor, &first, &count, &clip);) {
+        render_edges(context, positions, &model->edges[first], count);
+    }
+    if (visibility) {
+        visibility += model->edge_cluster_count;
+    }
+
+    for (uint s = 0; s < model->surface_count; ++s) {
+        surface_t* surface = &model->surfaces[s];
+        graphics_material_t material = surface_material(surface, shader);
+        for (cursor = 0; next_run(visibility, surface->cluster_count, surface->index_count / 3, &cursor, &first, &count, &clip);) {
+            render_triangles_clipped(context, positions, surface->image ? model->vertices[0].texcoord.v : NULL, sizeof(vertex_t) / sizeof(float),
+                                     &surface->indices[first * 3], count * 3, &material, clip);
+        }
+        if (visibility) {
+            visibility += surface->cluster_count;
+        }
+    }
 }
 
 static circlesq_t circle_from_1(const vec2_t* point) {
@@ -782,6 +1568,10 @@ void model_get_bounds(model_t* model, vec3_t* centre, float* radius, float* heig
 }
 
 
+graphics_sphere_t model_get_sphere(const model_t* model) {
+    return model->clustered ? model->bounds : bounding_sphere(model->vertices, NULL, model->vertex_count);
+}
+
 
 void model_dump(model_t* model) {
     if (!model) {
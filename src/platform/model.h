@@ -4,6 +4,7 @@
 #include "mathc.h"
 #include "voxel.h"
 #include "graphics.h"
+#include "render.h"
 
 typedef struct {
     char* name;
@@ -17,43 +18,93 @@ typedef struct {
     //vec3_t normal;
 } vertex_t;
 
+// consecutive triangles or edges that are culled against the display cylinder together
+#define MODEL_CLUSTER_SIZE 64
+
 typedef struct {
-    index_t index[2];
-    pixel_t colour;
-} edge_t;
+    graphics_sphere_t bounds;
+    uint32_t first_vertex;
+    uint32_t last_vertex;
+} model_cluster_t;
 
 typedef struct {
     uint32_t index_count;
     index_t* indices;
     pixel_t colour;
     struct image_s* image;
+    char* image_name;       // where image was loaded from, for the model cache
+
+    graphics_sphere_t bounds;
+    uint32_t cluster_count;
+    model_cluster_t* clusters;
 } surface_t;
 
-typedef struct {
+// coarser copies of a model are made for drawing it small, each with about a quarter of the triangles of the one before.
+// a level is drawn when its triangles are still no bigger than MODEL_LOD_VOXELS across
+#define MODEL_LOD_LEVELS 4
+#define MODEL_LOD_MIN_TRIANGLES 1024
+#define MODEL_LOD_VOXELS 2.0f
+
+typedef struct model_s {
     uint32_t vertex_count;
     vertex_t* vertices;
+    float* positions[3];    // optional copy of the vertex positions as separate x, y and z arrays, for the batch transform
 
     uint32_t edge_count;
     edge_t* edges;
     
     uint32_t surface_count;
     surface_t* surfaces;
+
+    // bounds are filled in by the loaders, models without them are always transformed and drawn whole
+    bool clustered;
+    graphics_sphere_t bounds;
+    uint32_t edge_cluster_count;
+    model_cluster_t* edge_clusters;
+
+    struct model_s* coarser;
+    float triangle_size;        // mean edge length, zero for models without levels
+
+    // set when the arrays point into a mapped model cache rather than being allocated, for coarser levels too
+    void* mapping;
+    size_t mapping_size;
 } model_t;
 
+// accumulated by model_draw and model_render on each thread until cleared by the caller
+typedef struct {
+    uint32_t clusters;
+    uint32_t clusters_culled;
+    uint32_t clusters_clipped;      // straddling the cylinder wall, so clipped to it voxel by voxel
+    uint32_t primitives;
+    uint32_t primitives_culled;
+    uint32_t vertices;
+    uint32_t vertices_transformed;
+} model_cull_stats_t;
+
+extern _Thread_local model_cull_stats_t model_cull_stats;
+
 typedef enum {
     STYLE_DEFAULT,
     STYLE_WIREFRAME_ALWAYS,
     STYLE_WIREFRAME_IF_UNDEFINED,
+    STYLE_WIREFRAME_FEATURES,       // only the edges on the mesh's borders and creases
     STYLE_COUNT
 } model_style_t;
 
+// faces meeting at more than this are a crease, for STYLE_WIREFRAME_FEATURES
+#define MODEL_FEATURE_CREASE_DEGREES 30
+
 
 model_t* model_load(const char* filename, model_style_t style);
 model_t* model_load_image(const char* filename);
 void model_set_colour(model_t* model, pixel_t colour);
 void model_free(model_t* model);
 void model_draw(pixel_t* volume, const model_t* model, float* matrix);
+void model_draw_shaded(pixel_t* volume, const model_t* model, float* matrix, graphics_span_shader_t shader);
+void model_render(render_context_t* context, const model_t* model, float* matrix);
+void model_render_shaded(render_context_t* context, const model_t* model, float* matrix, graphics_span_shader_t shader);
 void model_get_bounds(model_t* model, vec3_t* centre, float* radius, float* height);
+graphics_sphere_t model_get_sphere(const model_t* model);
 
 void model_dump(model_t* model);
 
@@ -0,0 +1,398 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "modelcache.h"
+
+#include "rammel.h"
+#include "array.h"
+#include "image.h"
+#include "cachefile.h"
+
+#define CACHE_MAGIC 0x314d564d     // "MVM1"
+#define CACHE_VERSION 4
+#define CACHE_ALIGNMENT 16
+
+// catches caches written by a build with different types, HIGH_COLOUR or not for one
+#define CACHE_LAYOUT ((sizeof(vertex_t) << 24) | (sizeof(edge_t) << 16) | (sizeof(model_cluster_t) << 8) | (sizeof(pixel_t) << 4) | sizeof(index_t))
+
+// offsets are from the start of the file
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t layout;
+    uint32_t style;
+    uint64_t size;
+    uint64_t model;
+    uint64_t mtllibs;           // the .mtl files read, one name after another, zero without any
+    uint32_t mtllib_count;
+    uint32_t reserved;
+} cache_header_t;
+
+_Static_assert(sizeof(cache_header_t) == 24 + 3 * sizeof(uint64_t), "cache header has padding");
+
+// a model, or one of its coarser levels
+typedef struct {
+    uint32_t vertex_count;
+    uint32_t edge_count;
+    uint32_t edge_cluster_count;
+    uint32_t surface_count;
+    graphics_sphere_t bounds;
+    float triangle_size;
+    uint32_t reserved;
+
+    uint64_t vertices;
+    uint64_t positions[VEC3_SIZE];
+    uint64_t edges;
+    uint64_t edge_clusters;
+    uint64_t surfaces;
+    uint64_t coarser;           // zero for the last level, otherwise always further into the file
+} cache_model_t;
+
+_Static_assert(sizeof(cache_model_t) == 24 + sizeof(graphics_sphere_t) + 8 * sizeof(uint64_t), "cached model has padding");
+
+typedef struct {
+    uint32_t index_count;
+    uint32_t cluster_count;
+    uint64_t indices;
+    uint64_t clusters;
+    uint64_t image_name;        // relative to the .obj's directory, zero without an image
+    graphics_sphere_t bounds;
+    uint32_t colour;            // widened from pixel_t, so the size doesn't hang on HIGH_COLOUR
+    uint32_t reserved;
+} cache_surface_t;
+
+_Static_assert(sizeof(cache_surface_t) == 8 + 3 * sizeof(uint64_t) + sizeof(graphics_sphere_t) + 8, "cached surface has padding");
+
+static const char* style_suffix[STYLE_COUNT] = {
+    [STYLE_DEFAULT] = "",
+    [STYLE_WIREFRAME_ALWAYS] = ".wire",
+    [STYLE_WIREFRAME_IF_UNDEFINED] = ".auto",
+    [STYLE_WIREFRAME_FEATURES] = ".feat"
+};
+
+static bool cache_filename(char* cachename, const char* filename, model_style_t style) {
+    if ((uint)style >= STYLE_COUNT) {
+        return false;
+    }
+
+    const char* sep = strrchr(filename, '/');
+    const char* ext = strrchr(sep ? sep : filename, '.');
+    int stem = ext ? (int)(ext - filename) : (int)strlen(filename);
+
+    int length = snprintf(cachename, PATH_MAX, "%.*s%s.mvm", stem, filename, style_suffix[style]);
+    return length > 0 && length < PATH_MAX;
+}
+
+// names in the file are relative to the .obj's directory, so a model and its cache can be moved together
+static size_t directory_length(const char* filename) {
+    const char* sep = strrchr(filename, '/');
+    return sep ? (size_t)(sep - filename + 1) : 0;
+}
+
+static bool cache_join(char* joined, const char* filename, const char* name) {
+    int length = snprintf(joined, PATH_MAX, "%.*s%s", (int)directory_length(filename), filename, name);
+    return length > 0 && length < PATH_MAX;
+}
+
+// count elements of size bytes at offset, or NULL if they don't all lie inside the mapping
+static void* cache_section(void* mapping, uint64_t mapping_size, uint64_t offset, uint64_t count, size_t size) {
+    if (!count) {
+        return NULL;
+    }
+    if ((offset % CACHE_ALIGNMENT) || offset > mapping_size || count > (mapping_size - offset) / size) {
+        return NULL;
+    }
+    return (uint8_t*)mapping + offset;
+}
+
+static const char* cache_string(void* mapping, uint64_t mapping_size, uint64_t offset) {
+    if (!offset || offset >= mapping_size) {
+        return NULL;
+    }
+    const char* string = (const char*)mapping + offset;
+    return memchr(string, '\0', mapping_size - offset) ? string : NULL;
+}
+
+// the level at offset, with its images taken from finest's surfaces, or from the file for the finest level itself
+static model_t* cache_load_model(void* mapping, uint64_t mapping_size, uint64_t offset, const model_t* finest, const char* filename) {
+    const cache_model_t* cached = cache_section(mapping, mapping_size, offset, 1, sizeof(cache_model_t));
+    if (!cached) {
+        return NULL;
+    }
+
+    model_t* model = calloc(1, sizeof(model_t));
+
+    model->vertex_count = cached->vertex_count;
+    model->vertices = cache_section(mapping, mapping_size, cached->vertices, cached->vertex_count, sizeof(vertex_t));
+    for (int c = 0; c < VEC3_SIZE; ++c) {
+        model->positions[c] = cache_section(mapping, mapping_size, cached->positions[c], cached->vertex_count, sizeof(float));
+    }
+
+    model->edge_count = cached->edge_count;
+    model->edges = cache_section(mapping, mapping_size, cached->edges, cached->edge_count, sizeof(edge_t));
+    model->edge_cluster_count = cached->edge_cluster_count;
+    model->edge_clusters = cache_section(mapping, mapping_size, cached->edge_clusters, cached->edge_cluster_count, sizeof(model_cluster_t));
+    model->bounds = cached->bounds;
+    model->triangle_size = cached->triangle_size;
+
+    bool valid = (!model->vertex_count || (model->vertices && model->positions[0] && model->positions[1] && model->positions[2]))
+              && (!model->edge_count || model->edges)
+              && (!model->edge_cluster_count || model->edge_clusters)
+              && (!finest || cached->surface_count == finest->surface_count);
+
+    const cache_surface_t* surfaces = cache_section(mapping, mapping_size, cached->surfaces, cached->surface_count, sizeof(cache_surface_t));
+    if (valid && cached->surface_count) {
+        if (surfaces) {
+            model->surface_count = cached->surface_count;
+            model->surfaces = calloc(model->surface_count, sizeof(surface_t));
+        } else {
+            valid = false;
+        }
+    }
+
+    for (uint32_t s = 0; valid && s < model->surface_count; ++s) {
+        const cache_surface_t* from = &surfaces[s];
+        surface_t* surface = &model->surfaces[s];
+
+        surface->colour = from->colour;
+        surface->bounds = from->bounds;
+        surface->index_count = from->index_count;
+        surface->indices = cache_section(mapping, mapping_size, from->indices, from->index_count, sizeof(index_t));
+        surface->cluster_count = from->cluster_count;
+        surface->clusters = cache_section(mapping, mapping_size, from->clusters, from->cluster_count, sizeof(model_cluster_t));
+        valid = (!surface->index_count || surface->indices) && (!surface->cluster_count || surface->clusters);
+
+        if (finest) {
+            surface->image = finest->surfaces[s].image;
+        } else if (valid && from->image_name) {
+            const char* image_name = cache_string(mapping, mapping_size, from->image_name);
+            char path[PATH_MAX];
+            if (image_name && cache_join(path, filename, image_name)) {
+                surface->image_name = strdup(path);
+                surface->image = image_load(path);
+            } else {
+                valid = false;
+            }
+        }
+    }
+
+    model->clustered = true;
+
+    if (!valid) {
+        // the arrays all belong to the mapping, which the caller unmaps
+        for (uint32_t s = 0; !finest && s < model->surface_count; ++s) {
+            if (model->surfaces[s].image) {
+                image_free(model->surfaces[s].image);
+            }
+            free(model->surfaces[s].image_name);
+        }
+        free(model->surfaces);
+        free(model);
+        return NULL;
+    }
+
+    return model;
+}
+
+// the cache is only as new as the oldest of its sources
+static bool cache_mtllibs_current(void* mapping, uint64_t mapping_size, const cache_header_t* header, const char* filename, const char* cachename) {
+    uint64_t offset = header->mtllibs;
+    for (uint32_t i = 0; i < header->mtllib_count; ++i) {
+        const char* name = cache_string(mapping, mapping_size, offset);
+        char path[PATH_MAX];
+        if (!name || !cache_join(path, filename, name) || !cache_is_current(path, cachename)) {
+            return false;
+        }
+        offset += strlen(name) + 1;
+    }
+    return true;
+}
+
+model_t* model_cache_load(const char* filename, model_style_t style) {
+    char cachename[PATH_MAX];
+    if (!cache_filename(cachename, filename, style) || !cache_is_current(filename, cachename)) {
+        return NULL;
+    }
+
+    int fd = open(cachename, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat sb;
+    if (fstat(fd, &sb) != 0 || sb.st_size < (off_t)sizeof(cache_header_t)) {
+        close(fd);
+        return NULL;
+    }
+
+    // private and writable, so callers can still recolour the model without touching the file
+    size_t mapping_size = sb.st_size;
+    void* mapping = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return NULL;
+    }
+
+    const cache_header_t* header = mapping;
+    model_t* model = NULL;
+    if (header->magic == CACHE_MAGIC && header->version == CACHE_VERSION && header->layout == CACHE_LAYOUT
+     && header->style == style && header->size == mapping_size
+     && cache_mtllibs_current(mapping, mapping_size, header, filename, cachename)) {
+        model = cache_load_model(mapping, mapping_size, header->model, NULL, filename);
+    }
+
+    if (!model) {
+        munmap(mapping, mapping_size);
+        return NULL;
+    }
+
+    // indices are trusted to be in range once the sections are, as they are in the models loaded from source
+    model->mapping = mapping;
+    model->mapping_size = mapping_size;
+
+    // levels only point forwards, so a bad file can't loop. any bad level and the whole file is passed over
+    model_t* level = model;
+    uint64_t offset = header->model;
+    const cache_model_t* cached = cache_section(mapping, mapping_size, offset, 1, sizeof(cache_model_t));
+    while (level && cached && cached->coarser) {
+        uint64_t coarser = cached->coarser;
+        cached = (coarser > offset) ? cache_section(mapping, mapping_size, coarser, 1, sizeof(cache_model_t)) : NULL;
+        level->coarser = cached ? cache_load_model(mapping, mapping_size, coarser, model, filename) : NULL;
+        level = level->coarser;
+        offset = coarser;
+    }
+
+    if (!level) {
+        model_free(model);
+        return NULL;
+    }
+
+    return model;
+}
+
+// appends size bytes and returns their offset, or zero for nothing
+static uint64_t cache_put(array_t* arena, const void* data, size_t size) {
+    if (!size) {
+        return 0;
+    }
+
+    size_t end = arena->count;
+    size_t offset = (end + CACHE_ALIGNMENT - 1) & ~(size_t)(CACHE_ALIGNMENT - 1);
+    array_resize(arena, offset + size);
+    memset(array_get(arena, end), 0, offset + size - end);
+    if (data) {
+        memcpy(array_get(arena, offset), data, size);
+    }
+    return offset;
+}
+
+static uint64_t cache_put_name(array_t* arena, const char* filename, const char* name) {
+    size_t directory = directory_length(filename);
+    if (strncmp(name, filename, directory) == 0) {
+        name += directory;
+    }
+    return cache_put(arena, name, strlen(name) + 1);
+}
+
+static uint64_t cache_put_model(array_t* arena, const model_t* model, const char* filename) {
+    uint64_t offset = cache_put(arena, NULL, sizeof(cache_model_t));
+
+    cache_model_t cached = {
+        .vertex_count = model->vertex_count,
+        .edge_count = model->edge_count,
+        .edge_cluster_count = model->edge_cluster_count,
+        .surface_count = model->surface_count,
+        .bounds = model->bounds,
+        .triangle_size = model->triangle_size,
+        .reserved = 0
+    };
+
+    cached.vertices = cache_put(arena, model->vertices, model->vertex_count * sizeof(vertex_t));
+    for (int c = 0; c < VEC3_SIZE; ++c) {
+        if (model->positions[c]) {
+            cached.positions[c] = cache_put(arena, model->positions[c], model->vertex_count * sizeof(float));
+        } else {
+            cached.positions[c] = cache_put(arena, NULL, model->vertex_count * sizeof(float));
+            float* positions = array_get(arena, cached.positions[c]);
+            for (uint32_t i = 0; i < model->vertex_count; ++i) {
+                positions[i] = model->vertices[i].position.v[c];
+            }
+        }
+    }
+    cached.edges = cache_put(arena, model->edges, model->edge_count * sizeof(edge_t));
+    cached.edge_clusters = cache_put(arena, model->edge_clusters, model->edge_cluster_count * sizeof(model_cluster_t));
+    cached.surfaces = cache_put(arena, NULL, model->surface_count * sizeof(cache_surface_t));
+
+    for (uint32_t s = 0; s < model->surface_count; ++s) {
+        const surface_t* surface = &model->surfaces[s];
+        cache_surface_t cached_surface = {
+            .index_count = surface->index_count,
+            .cluster_count = surface->cluster_count,
+            .indices = cache_put(arena, surface->indices, surface->index_count * sizeof(index_t)),
+            .clusters = cache_put(arena, surface->clusters, surface->cluster_count * sizeof(model_cluster_t)),
+            .image_name = surface->image_name ? cache_put_name(arena, filename, surface->image_name) : 0,
+            .bounds = surface->bounds,
+            .colour = surface->colour,
+            .reserved = 0
+        };
+        memcpy(array_get(arena, cached.surfaces + s * sizeof(cache_surface_t)), &cached_surface, sizeof(cached_surface));
+    }
+
+    if (model->coarser) {
+        cached.coarser = cache_put_model(arena, model->coarser, filename);
+    }
+
+    memcpy(array_get(arena, offset), &cached, sizeof(cached));
+    return offset;
+}
+
+static bool cache_write_arena(FILE* fd, void* context) {
+    const array_t* arena = context;
+    return fwrite(arena->data, 1, arena->count, fd) == arena->count;
+}
+
+void model_cache_save(const char* filename, model_style_t style, const model_t* model, array_t* mtllibs) {
+    char cachename[PATH_MAX];
+    if (!model->clustered || !cache_filename(cachename, filename, style)) {
+        return;
+    }
+
+    array_t arena = {sizeof(uint8_t)};
+    array_reserve(&arena, sizeof(cache_header_t) + model->vertex_count * (sizeof(vertex_t) + sizeof(float) * VEC3_SIZE));
+    cache_put(&arena, NULL, sizeof(cache_header_t));
+
+    cache_header_t header = {
+        .magic = CACHE_MAGIC,
+        .version = CACHE_VERSION,
+        .layout = CACHE_LAYOUT,
+        .style = style,
+        .model = cache_put_model(&arena, model, filename),
+        .mtllib_count = mtllibs->count,
+        .reserved = 0
+    };
+
+    // the names run on unaligned, the first one's offset finding the rest
+    for (size_t i = 0; i < mtllibs->count; ++i) {
+        const char* name = *(char**)array_get(mtllibs, i);
+        size_t length = strlen(name) + 1;
+        if (!i) {
+            header.mtllibs = cache_put(&arena, name, length);
+        } else {
+            array_resize(&arena, arena.count + length);
+            memcpy(array_get(&arena, arena.count - length), name, length);
+        }
+    }
+    header.size = arena.count;
+    memcpy(arena.data, &header, sizeof(header));
+
+    file_write_atomic(cachename, cache_write_arena, &arena);
+
+    array_destroy(&arena);
+}
@@ -0,0 +1,18 @@
+#ifndef _MODELCACHE_H_
+#define _MODELCACHE_H_
+
+#include "model.h"
+#include "array.h"
+
+// loaded models saved beside their source as .mvm files: the model's arrays laid out one after another,
+// so that loading is an mmap and a few pointer fix ups. a cache older than the .obj or any .mtl it read is ignored
+// and rewritten. paths are kept relative to the .obj, so the whole directory can be moved.
+
+// NULL if there's no usable cache for filename loaded in style
+model_t* model_cache_load(const char* filename, model_style_t style);
+
+// mtllibs holds the names of the .mtl files the model read, as the .obj gives them. quietly gives up if the
+// cache can't be written, the model still loads from source next time
+void model_cache_save(const char* filename, model_style_t style, const model_t* model, array_t* mtllibs);
+
+#endif
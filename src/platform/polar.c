@@ -0,0 +1,321 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "polar.h"
+#include "slicemap.h"
+#include "mathc.h"
+#include "rammel.h"
+#include "array.h"
+
+// as built, since the toys don't share the driver's adjustable eccentricity[]. columns are placed by
+// slicemap_column_offset, and the inverse mappings here have to agree with it
+static const float panel_eccentricity[PANEL_COUNT] = {ECCENTRICITY_0, ECCENTRICITY_1};
+
+#define COLUMN_CENTRE ((float)(PANEL_WIDTH - 1) * 0.5f)
+
+typedef struct {
+    float u[VEC2_SIZE];     // along the panels
+    float n[VEC2_SIZE];     // normal to them
+} slice_axes_t;
+
+struct polar_target_s {
+    array_t slices[SLICE_COUNT];
+
+    // each slice's axes, and those half a slice either side of it. boundary s is the leading edge of slice s
+    slice_axes_t axes[SLICE_COUNT];
+    slice_axes_t boundaries[SLICE_COUNT + 1];
+};
+
+static void axes_at(slice_axes_t* axes, float angle) {
+    axes->u[0] = cosf(angle);
+    axes->u[1] = sinf(angle);
+    axes->n[0] = axes->u[1];
+    axes->n[1] = -axes->u[0];
+}
+
+polar_target_t* polar_create(void) {
+    polar_target_t* target = calloc(1, sizeof(polar_target_t));
+    if (!target) {
+        return NULL;
+    }
+
+    for (int s = 0; s < SLICE_COUNT; ++s) {
+        target->slices[s].size = sizeof(polar_voxel_t);
+        axes_at(&target->axes[s], (float)s * M_PI * 2.0f / SLICE_COUNT);
+    }
+    for (int s = 0; s <= SLICE_COUNT; ++s) {
+        axes_at(&target->boundaries[s], ((float)s - 0.5f) * M_PI * 2.0f / SLICE_COUNT);
+    }
+
+    return target;
+}
+
+void polar_destroy(polar_target_t* target) {
+    if (!target) {
+        return;
+    }
+
+    for (int s = 0; s < SLICE_COUNT; ++s) {
+        array_destroy(&target->slices[s]);
+    }
+    free(target);
+}
+
+void polar_clear(polar_target_t* target) {
+    for (int s = 0; s < SLICE_COUNT; ++s) {
+        array_clear(&target->slices[s]);
+    }
+}
+
+static inline void plot(polar_target_t* target, int slice, int panel, int column, int z, pixel_t colour) {
+    if ((uint)column < PANEL_WIDTH && (uint)z < VOXELS_Z) {
+        *(polar_voxel_t*)array_push(&target->slices[slice]) = (polar_voxel_t){.column = column, .panel = panel, .z = z, .colour = colour};
+    }
+}
+
+// how far either side of a point's bearing a panel eccentricity off the axis passes over it. zero for panels on
+// the axis, which would otherwise make 0/0 of a point on it
+static inline float panel_skew(float eccentricity, float radius) {
+    return (eccentricity > 0) ? asinf(eccentricity / max(radius, eccentricity)) : 0.0f;
+}
+
+static inline float column_of(const slice_axes_t* axes, int panel, const float* offset) {
+    return (offset[0] * axes->u[0] + offset[1] * axes->u[1]) * PANEL_FACING(panel) + COLUMN_CENTRE;
+}
+
+void polar_draw_point(polar_target_t* target, const float* position, pixel_t colour) {
+    float offset[VEC2_SIZE] = {position[0] - (VOXELS_X - 1) * 0.5f, position[1] - (VOXELS_Y - 1) * 0.5f};
+    float radius = sqrtf(offset[0] * offset[0] + offset[1] * offset[1]);
+    float bearing = atan2f(offset[1], offset[0]);
+    int z = (int)floorf(position[2] + 0.5f);
+
+    for (int p = 0; p < PANEL_COUNT; ++p) {
+        if (radius < panel_eccentricity[p]) {
+            // inside the circle the panel's edge sweeps out
+            continue;
+        }
+
+        // the panel passes over the point where offset.n == eccentricity, twice a revolution
+        float skew = panel_skew(panel_eccentricity[p], radius);
+        float angles[2] = {bearing + skew, bearing + M_PI - skew};
+        for (int i = 0; i < count_of(angles); ++i) {
+            int slice = modulo((int)floorf(angles[i] * SLICE_COUNT / (M_PI * 2.0f) + 0.5f), SLICE_COUNT);
+            int column = (int)floorf(column_of(&target->axes[slice], p, offset) + 0.5f);
+            plot(target, slice, p, column, z, colour);
+        }
+    }
+}
+
+static bool clip_range(float* lo, float* hi, float from, float to, float limit) {
+    // narrow [lo, hi] down to where from + (to - from) * t lies within [-0.5, limit - 0.5]
+    float delta = to - from;
+    if (delta == 0) {
+        return from >= -0.5f && from <= limit - 0.5f;
+    }
+    float t0 = (-0.5f - from) / delta;
+    float t1 = (limit - 0.5f - from) / delta;
+    *lo = max(*lo, min(t0, t1));
+    *hi = min(*hi, max(t0, t1));
+    return *lo <= *hi;
+}
+
+static void draw_run(polar_target_t* target, int slice, int panel, const float* one, const float* two, pixel_t colour) {
+    // the part of the line the slice sweeps over, stepped through the panel's columns and rows
+    float c0 = column_of(&target->axes[slice], panel, one);
+    float c1 = column_of(&target->axes[slice], panel, two);
+    float z0 = one[2];
+    float z1 = two[2];
+
+    float lo = 0, hi = 1;
+    if (!clip_range(&lo, &hi, c0, c1, PANEL_WIDTH) || !clip_range(&lo, &hi, z0, z1, VOXELS_Z)) {
+        return;
+    }
+    float dc = c1 - c0, dz = z1 - z0;
+    c1 = c0 + dc * hi;
+    z1 = z0 + dz * hi;
+    c0 += dc * lo;
+    z0 += dz * lo;
+
+    int steps = (int)ceilf(max(fabsf(c1 - c0), fabsf(z1 - z0)));
+    dc = steps ? (c1 - c0) / steps : 0;
+    dz = steps ? (z1 - z0) / steps : 0;
+
+    int last_column = -1, last_z = -1;
+    for (int i = 0; i <= steps; ++i) {
+        int column = (int)floorf(c0 + dc * i + 0.5f);
+        int z = (int)floorf(z0 + dz * i + 0.5f);
+        if (column != last_column || z != last_z) {
+            plot(target, slice, panel, column, z, colour);
+            last_column = column;
+            last_z = z;
+        }
+    }
+}
+
+static inline float panel_distance(const slice_axes_t* axes, int panel, const float* offset) {
+    return offset[0] * axes->n[0] + offset[1] * axes->n[1] - panel_eccentricity[panel];
+}
+
+static void draw_slice(polar_target_t* target, int slice, int panel, const float* a, const float* b, pixel_t colour) {
+    // the panel sweeps over a point of the line during the slice if its distance from the point changes sign
+    // between the slice's boundaries. both distances are linear along the line, so their product is a
+    // quadratic in t, negative on at most two intervals between its roots
+    float lead[2] = {panel_distance(&target->boundaries[slice], panel, a), 0};
+    float trail[2] = {panel_distance(&target->boundaries[slice+1], panel, a), 0};
+    lead[1] = panel_distance(&target->boundaries[slice], panel, b) - lead[0];
+    trail[1] = panel_distance(&target->boundaries[slice+1], panel, b) - trail[0];
+
+    float ts[4] = {0};
+    int tn = 1;
+    if (lead[1] != 0) {
+        float t = -lead[0] / lead[1];
+        if (t > 0 && t < 1) {
+            ts[tn++] = t;
+        }
+    }
+    if (trail[1] != 0) {
+        float t = -trail[0] / trail[1];
+        if (t > 0 && t < 1) {
+            ts[tn++] = t;
+        }
+    }
+    if (tn == 3 && ts[1] > ts[2]) {
+        float swap = ts[1];
+        ts[1] = ts[2];
+        ts[2] = swap;
+    }
+    ts[tn++] = 1;
+
+    float start = -1;
+    for (int i = 0; i + 1 < tn; ++i) {
+        float mid = (ts[i] + ts[i+1]) * 0.5f;
+        bool swept = (lead[0] + lead[1] * mid) * (trail[0] + trail[1] * mid) <= 0;
+        if (swept && start < 0) {
+            start = ts[i];
+        }
+        if (start >= 0 && (!swept || i + 2 == tn)) {
+            float end = swept ? ts[i+1] : ts[i];
+            float from[VEC3_SIZE], to[VEC3_SIZE];
+            for (int c = 0; c < VEC3_SIZE; ++c) {
+                from[c] = a[c] + (b[c] - a[c]) * start;
+                to[c] = a[c] + (b[c] - a[c]) * end;
+            }
+            draw_run(target, slice, panel, from, to, colour);
+            start = -1;
+        }
+    }
+}
+
+void polar_draw_line(polar_target_t* target, const float* one, const float* two, pixel_t colour) {
+    // offsets from the axis, with z carried along for the runs
+    const float a[VEC3_SIZE] = {one[0] - (VOXELS_X - 1) * 0.5f, one[1] - (VOXELS_Y - 1) * 0.5f, one[2]};
+    const float b[VEC3_SIZE] = {two[0] - (VOXELS_X - 1) * 0.5f, two[1] - (VOXELS_Y - 1) * 0.5f, two[2]};
+
+    if ((a[2] < 0 && b[2] < 0) || (a[2] > VOXELS_Z - 1 && b[2] > VOXELS_Z - 1)) {
+        return;
+    }
+
+    // the bearings the line covers, measured from its far end in case the near one is on the axis
+    float ra = sqrtf(a[0] * a[0] + a[1] * a[1]);
+    float rb = sqrtf(b[0] * b[0] + b[1] * b[1]);
+    const float* far = (ra > rb) ? a : b;
+    const float* near = (ra > rb) ? b : a;
+    float bearing = atan2f(far[1], far[0]);
+    float turn = atan2f(far[0] * near[1] - far[1] * near[0], far[0] * near[0] + far[1] * near[1]);
+    float bearing_lo = bearing + min(turn, 0.0f);
+    float bearing_hi = bearing + max(turn, 0.0f);
+
+    // and how close it gets to the axis
+    float delta[VEC2_SIZE] = {b[0] - a[0], b[1] - a[1]};
+    float length_sq = delta[0] * delta[0] + delta[1] * delta[1];
+    float t = (length_sq > 0) ? clamp(-(a[0] * delta[0] + a[1] * delta[1]) / length_sq, 0.0f, 1.0f) : 0;
+    float radius_lo = sqrtf(sqr(a[0] + delta[0] * t) + sqr(a[1] + delta[1] * t));
+    float radius_hi = max(ra, rb);
+
+    const float slices_per_radian = SLICE_COUNT / (M_PI * 2.0f);
+
+    for (int p = 0; p < PANEL_COUNT; ++p) {
+        float eccentricity = panel_eccentricity[p];
+        if (radius_hi < eccentricity) {
+            continue;
+        }
+
+        // the panel passes over each point twice a revolution, at its bearing plus skew and opposite that,
+        // where skew shrinks with the point's distance from the axis. only slices around those are looked at
+        float skew_lo = panel_skew(eccentricity, radius_hi);
+        float skew_hi = panel_skew(eccentricity, radius_lo);
+        int first[2] = {
+            (int)floorf((bearing_lo + skew_lo) * slices_per_radian + 0.5f) - 1,
+            (int)floorf((bearing_lo + M_PI - skew_hi) * slices_per_radian + 0.5f) - 1
+        };
+        int last[2] = {
+            (int)floorf((bearing_hi + skew_hi) * slices_per_radian + 0.5f) + 1,
+            (int)floorf((bearing_hi + M_PI - skew_lo) * slices_per_radian + 0.5f) + 1
+        };
+
+        int ranges = 2;
+        if (last[0] >= first[1]) {
+            last[0] = last[1];
+            ranges = 1;
+        }
+        if (last[ranges-1] - first[0] >= SLICE_COUNT) {
+            last[0] = first[0] + SLICE_COUNT - 1;
+            ranges = 1;
+        }
+
+        for (int r = 0; r < ranges; ++r) {
+            for (int s = first[r]; s <= last[r]; ++s) {
+                draw_slice(target, modulo(s, SLICE_COUNT), p, a, b, colour);
+            }
+        }
+    }
+}
+
+void polar_draw_edges(polar_target_t* target, const float* positions, const uint8_t* outcodes, const edge_t* edges, uint32_t edge_count) {
+    for (uint32_t i = 0; i < edge_count; ++i) {
+        if (outcodes && (outcodes[edges[i].index[0]] & outcodes[edges[i].index[1]])) {
+            continue;
+        }
+        polar_draw_line(target, &positions[edges[i].index[0] * VEC3_SIZE], &positions[edges[i].index[1] * VEC3_SIZE], edges[i].colour);
+    }
+}
+
+void polar_submit(polar_target_t* target, voxel_polar_t* layer, voxel_polar_mode_t mode) {
+    uint32_t count = 0;
+    for (int s = 0; s < SLICE_COUNT; ++s) {
+        uint32_t length = min((uint32_t)target->slices[s].count, VOXEL_POLAR_CAPACITY - count);
+        layer->slices[s] = count;
+        memcpy(&layer->voxels[count], target->slices[s].data, length * sizeof(polar_voxel_t));
+        count += length;
+    }
+    layer->slices[SLICE_COUNT] = count;
+    layer->mode = mode;
+}
+
+void polar_position(float* position, int slice, int panel, int column) {
+    float angle = (float)slice * M_PI * 2.0f / SLICE_COUNT;
+    slice_axes_t axes;
+    axes_at(&axes, angle);
+
+    slicemap_column_offset(position, axes.u[0], axes.u[1], panel, panel_eccentricity[panel], (float)column - COLUMN_CENTRE);
+    position[0] += (VOXELS_X - 1) * 0.5f;
+    position[1] += (VOXELS_Y - 1) * 0.5f;
+}
+
+void polar_resolve(pixel_t* volume, const voxel_polar_t* layer) {
+    for (int s = 0; s < SLICE_COUNT; ++s) {
+        for (uint32_t i = layer->slices[s]; i < min(layer->slices[s+1], VOXEL_POLAR_CAPACITY); ++i) {
+            const polar_voxel_t* voxel = &layer->voxels[i];
+            float position[VEC2_SIZE];
+            polar_position(position, s, voxel->panel % PANEL_COUNT, voxel->column);
+
+            int x = (int)floorf(position[0] + 0.5f);
+            int y = (int)floorf(position[1] + 0.5f);
+            if ((uint)x < VOXELS_X && (uint)y < VOXELS_Y && voxel->z < VOXELS_Z) {
+                volume[VOXEL_INDEX(x, y, voxel->z)] = voxel->colour;
+            }
+        }
+    }
+}
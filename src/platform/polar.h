@@ -0,0 +1,32 @@
+#ifndef _POLAR_H_
+#define _POLAR_H_
+
+#include "voxel.h"
+#include "graphics.h"
+
+// draws points and lines straight into the display's slices rather than into the volume.
+// each slice gets the part of a line its panels sweep past, so thin lines don't alias through the
+// volume on the way, and the driver copies the result out without gathering every voxel of every slice.
+// positions are in the same voxel space the volume is drawn in.
+
+typedef struct polar_target_s polar_target_t;
+
+polar_target_t* polar_create(void);
+void polar_destroy(polar_target_t* target);
+
+void polar_clear(polar_target_t* target);
+void polar_draw_point(polar_target_t* target, const float* position, pixel_t colour);
+void polar_draw_line(polar_target_t* target, const float* one, const float* two, pixel_t colour);
+void polar_draw_edges(polar_target_t* target, const float* positions, const uint8_t* outcodes, const edge_t* edges, uint32_t edge_count);
+
+// copies everything drawn since the last clear into a layer of the voxel buffer.
+// anything past VOXEL_POLAR_CAPACITY voxels is dropped
+void polar_submit(polar_target_t* target, voxel_polar_t* layer, voxel_polar_mode_t mode);
+
+// where a panel's column is at a slice, in voxel space
+void polar_position(float* position, int slice, int panel, int column);
+
+// draws a layer into the volume at the nearest voxels, for displays without slices of their own
+void polar_resolve(pixel_t* volume, const voxel_polar_t* layer);
+
+#endif
@@ -0,0 +1,86 @@
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "primitives.h"
+#include "rammel.h"
+
+static int isqrt(int n) {
+    int r = (int)sqrtf((float)n);
+    while (r * r > n) {
+        --r;
+    }
+    while ((r + 1) * (r + 1) <= n) {
+        ++r;
+    }
+    return r;
+}
+
+void graphics_fill_box(pixel_t* volume, const graphics_box_t* box, pixel_t colour) {
+    int lo[3], hi[3];
+    const int extent[3] = {VOXELS_X, VOXELS_Y, VOXELS_Z};
+    for (int i = 0; i < 3; ++i) {
+        lo[i] = max(box->min[i], 0);
+        hi[i] = min(box->max[i], extent[i]);
+        if (lo[i] >= hi[i]) {
+            return;
+        }
+    }
+
+#if VOXEL_Z_CONTIGUOUS && VOXEL_X_STRIDE == VOXELS_Z
+    if (sizeof(pixel_t) == 1 && lo[2] == 0 && hi[2] == VOXELS_Z) {
+        // whole columns next to each other in x are one run
+        for (int y = lo[1]; y < hi[1]; ++y) {
+            memset(&volume[VOXEL_INDEX(lo[0], y, 0)], colour, (hi[0] - lo[0]) * VOXELS_Z);
+        }
+        return;
+    }
+#endif
+
+    for (int y = lo[1]; y < hi[1]; ++y) {
+        for (int x = lo[0]; x < hi[0]; ++x) {
+            graphics_fill_column(volume, x, y, lo[2], hi[2], colour);
+        }
+    }
+}
+
+void graphics_fill_sphere(pixel_t* volume, const int* centre, int radius_sq, pixel_t colour) {
+    if (radius_sq < 0) {
+        return;
+    }
+
+    int radius = isqrt(radius_sq);
+    int y0 = max(centre[1] - radius, 0), y1 = min(centre[1] + radius, VOXELS_Y-1);
+
+    for (int y = y0; y <= y1; ++y) {
+        int dy = y - centre[1];
+        int row_sq = radius_sq - dy * dy;
+        int half_width = isqrt(row_sq);
+        int x0 = max(centre[0] - half_width, 0), x1 = min(centre[0] + half_width, VOXELS_X-1);
+
+        for (int x = x0; x <= x1; ++x) {
+            int dx = x - centre[0];
+            int half_height = isqrt(row_sq - dx * dx);
+            graphics_fill_column(volume, x, y, centre[2] - half_height, centre[2] + half_height + 1, colour);
+        }
+    }
+}
+
+void graphics_fill_cylinder(pixel_t* volume, int x, int y, int radius_sq, int z0, int z1, pixel_t colour) {
+    if (radius_sq < 0) {
+        return;
+    }
+
+    int radius = isqrt(radius_sq);
+    int ya = max(y - radius, 0), yb = min(y + radius, VOXELS_Y-1);
+
+    for (int vy = ya; vy <= yb; ++vy) {
+        int dy = vy - y;
+        int half_width = isqrt(radius_sq - dy * dy);
+        int xa = max(x - half_width, 0), xb = min(x + half_width, VOXELS_X-1);
+
+        for (int vx = xa; vx <= xb; ++vx) {
+            graphics_fill_column(volume, vx, vy, z0, z1, colour);
+        }
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef _PRIMITIVES_H_
+#define _PRIMITIVES_H_
+
+#include <string.h>
+
+#include "graphics.h"
+
+// solid shapes, written a z column at a time and clipped to the volume.
+// z ranges are half-open like graphics_box_t, radii are squared so integer shapes stay exact.
+
+static inline void graphics_fill_column(pixel_t* volume, int x, int y, int z0, int z1, pixel_t colour) {
+    if ((uint32_t)x >= VOXELS_X || (uint32_t)y >= VOXELS_Y) {
+        return;
+    }
+    z0 = z0 < 0 ? 0 : z0;
+    z1 = z1 > VOXELS_Z ? VOXELS_Z : z1;
+
+#if VOXEL_Z_CONTIGUOUS
+    if (sizeof(pixel_t) == 1) {
+        if (z0 < z1) {
+            memset(&volume[VOXEL_INDEX(x, y, z0)], colour, z1 - z0);
+        }
+        return;
+    }
+#endif
+    for (int z = z0; z < z1; ++z) {
+        volume[VOXEL_INDEX(x, y, z)] = colour;
+    }
+}
+
+void graphics_fill_box(pixel_t* volume, const graphics_box_t* box, pixel_t colour);
+
+// every voxel within sqrt(radius_sq) of the centre voxel
+void graphics_fill_sphere(pixel_t* volume, const int* centre, int radius_sq, pixel_t colour);
+
+// an upright cylinder around the column at x, y, from z0 up to z1
+void graphics_fill_cylinder(pixel_t* volume, int x, int y, int radius_sq, int z0, int z1, pixel_t colour);
+
+#endif
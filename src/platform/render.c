@@ -0,0 +1,212 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "render.h"
+#include "mathc.h"
+#include "rammel.h"
+#include "array.h"
+#include "arena.h"
+#include "workers.h"
+
+typedef enum {
+    BATCH_EDGES,
+    BATCH_TRIANGLES
+} batch_type_t;
+
+typedef struct {
+    batch_type_t type;
+    uint32_t positions;
+    const float* texcoords;
+    uint32_t texcoord_stride;
+    const index_t* indices;
+    const edge_t* edges;
+    graphics_box_t clip;
+    graphics_material_t material;
+} batch_t;
+
+typedef struct {
+    uint32_t batch;
+    uint32_t element;
+} item_t;
+
+// each tile's items are chunks from the submitting thread's arena, so binning a frame never reallocates
+#define RENDER_BIN_CHUNK 256
+
+typedef struct bin_chunk_s {
+    struct bin_chunk_s* next;
+    uint32_t count;
+    item_t items[RENDER_BIN_CHUNK];
+} bin_chunk_t;
+
+typedef struct {
+    bin_chunk_t* first;
+    bin_chunk_t* last;
+} bin_t;
+
+struct render_context_s {
+    workers_t* workers;
+    pixel_t* volume;
+    array_t positions;
+    array_t batches;
+    bin_t bins[RENDER_TILE_COUNT];
+};
+
+render_context_t* render_create(int thread_count) {
+    render_context_t* context = calloc(1, sizeof(render_context_t));
+    if (!context) {
+        return NULL;
+    }
+
+    context->workers = workers_create(thread_count);
+    context->positions.size = sizeof(float) * VEC3_SIZE;
+    context->batches.size = sizeof(batch_t);
+
+    return context;
+}
+
+void render_destroy(render_context_t* context) {
+    if (!context) {
+        return;
+    }
+
+    workers_destroy(context->workers);
+    array_destroy(&context->positions);
+    array_destroy(&context->batches);
+    free(context);
+}
+
+void render_begin(render_context_t* context, pixel_t* volume) {
+    context->volume = volume;
+    array_clear(&context->positions);
+    array_clear(&context->batches);
+    memset(context->bins, 0, sizeof(context->bins));
+}
+
+uint32_t render_positions(render_context_t* context, const float* positions, uint32_t count) {
+    uint32_t first = context->positions.count;
+    array_resize(&context->positions, first + count);
+    memcpy(array_get(&context->positions, first), positions, count * context->positions.size);
+    return first;
+}
+
+static inline const float* get_position(const render_context_t* context, uint32_t index) {
+    return (const float*)context->positions.data + index * VEC3_SIZE;
+}
+
+static void push_item(bin_t* bin, item_t item) {
+    if (!bin->last || bin->last->count == RENDER_BIN_CHUNK) {
+        bin_chunk_t* chunk = arena_alloc(sizeof(bin_chunk_t));
+        chunk->next = NULL;
+        chunk->count = 0;
+        if (bin->last) {
+            bin->last->next = chunk;
+        } else {
+            bin->first = chunk;
+        }
+        bin->last = chunk;
+    }
+    bin->last->items[bin->last->count++] = item;
+}
+
+static void bin_item(render_context_t* context, item_t item, const uint32_t* vertices, int vertex_count) {
+    const float* first = get_position(context, vertices[0]);
+    float lo[2] = {first[0], first[1]};
+    float hi[2] = {first[0], first[1]};
+    for (int v = 1; v < vertex_count; ++v) {
+        const float* position = get_position(context, vertices[v]);
+        for (int c = 0; c < 2; ++c) {
+            lo[c] = min(lo[c], position[c]);
+            hi[c] = max(hi[c], position[c]);
+        }
+    }
+
+    // a voxel of slack, the rasterisers clip exactly
+    int x0 = (int)floorf(max(lo[0], -2.0f)) - 1, x1 = (int)ceilf(min(hi[0], (float)VOXELS_X)) + 1;
+    int y0 = (int)floorf(max(lo[1], -2.0f)) - 1, y1 = (int)ceilf(min(hi[1], (float)VOXELS_Y)) + 1;
+    if (x1 < 0 || y1 < 0 || x0 >= VOXELS_X || y0 >= VOXELS_Y) {
+        return;
+    }
+
+    x0 = max(x0, 0) / RENDER_TILE_SIZE;
+    y0 = max(y0, 0) / RENDER_TILE_SIZE;
+    x1 = min(x1, VOXELS_X-1) / RENDER_TILE_SIZE;
+    y1 = min(y1, VOXELS_Y-1) / RENDER_TILE_SIZE;
+
+    for (int ty = y0; ty <= y1; ++ty) {
+        for (int tx = x0; tx <= x1; ++tx) {
+            push_item(&context->bins[ty * RENDER_TILES_X + tx], item);
+        }
+    }
+}
+
+void render_edges(render_context_t* context, uint32_t positions, const edge_t* edges, uint32_t edge_count) {
+    uint32_t index = context->batches.count;
+    batch_t* batch = array_push(&context->batches);
+    batch->type = BATCH_EDGES;
+    batch->positions = positions;
+    batch->edges = edges;
+
+    for (uint32_t e = 0; e < edge_count; ++e) {
+        bin_item(context, (item_t){index, e}, (uint32_t[2]){positions + edges[e].index[0], positions + edges[e].index[1]}, 2);
+    }
+}
+
+void render_triangles(render_context_t* context, uint32_t positions, const float* texcoords, uint32_t texcoord_stride, const index_t* indices, uint32_t index_count, const graphics_material_t* material) {
+    render_triangles_clipped(context, positions, texcoords, texcoord_stride, indices, index_count, material, &graphics_volume_box);
+}
+
+void render_triangles_clipped(render_context_t* context, uint32_t positions, const float* texcoords, uint32_t texcoord_stride, const index_t* indices, uint32_t index_count, const graphics_material_t* material, const graphics_box_t* clip) {
+    uint32_t index = context->batches.count;
+    batch_t* batch = array_push(&context->batches);
+    batch->type = BATCH_TRIANGLES;
+    batch->positions = positions;
+    batch->texcoords = texcoords;
+    batch->texcoord_stride = texcoord_stride;
+    batch->indices = indices;
+    batch->material = *material;
+    batch->clip = *clip;
+
+    for (uint32_t t = 0; t + 2 < index_count; t += 3) {
+        bin_item(context, (item_t){index, t}, (uint32_t[3]){positions + indices[t], positions + indices[t+1], positions + indices[t+2]}, 3);
+    }
+}
+
+static void draw_tile(void* arg, int tile) {
+    render_context_t* context = arg;
+
+    int tx = tile % RENDER_TILES_X;
+    int ty = tile / RENDER_TILES_X;
+    graphics_box_t box = {
+        {tx * RENDER_TILE_SIZE, ty * RENDER_TILE_SIZE, 0},
+        {min((tx + 1) * RENDER_TILE_SIZE, VOXELS_X), min((ty + 1) * RENDER_TILE_SIZE, VOXELS_Y), VOXELS_Z}
+    };
+
+    const batch_t* batches = context->batches.data;
+
+    for (const bin_chunk_t* chunk = context->bins[tile].first; chunk; chunk = chunk->next) {
+        for (uint32_t i = 0; i < chunk->count; ++i) {
+            const item_t* item = &chunk->items[i];
+            const batch_t* batch = &batches[item->batch];
+            const float* positions = get_position(context, batch->positions);
+            switch (batch->type) {
+                case BATCH_EDGES:
+                    graphics_draw_edges_clipped(context->volume, positions, NULL, &batch->edges[item->element], 1, &box);
+                    break;
+                case BATCH_TRIANGLES: {
+                    graphics_box_t clip = batch->clip;
+                    for (int c = 0; c < 3; ++c) {
+                        clip.min[c] = max(clip.min[c], box.min[c]);
+                        clip.max[c] = min(clip.max[c], box.max[c]);
+                    }
+                    graphics_draw_triangles_clipped(context->volume, positions, NULL, batch->texcoords, batch->texcoord_stride, &batch->indices[item->element], 3, &batch->material, &clip);
+                } break;
+            }
+        }
+    }
+}
+
+void render_end(render_context_t* context) {
+    workers_run(context->workers, draw_tile, context, RENDER_TILE_COUNT);
+}
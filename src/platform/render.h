@@ -0,0 +1,32 @@
+#ifndef _RENDER_H_
+#define _RENDER_H_
+
+#include "graphics.h"
+
+// collects primitives for a frame, bins them into XY tiles of the volume and rasterises the tiles in parallel.
+// every voxel belongs to exactly one tile and each tile draws its primitives in submission order,
+// so the result is the same as drawing them serially.
+// shaders may run on any thread, but only ever touch the columns of the span they're given.
+// the bins come from the submitting thread's arena, so a frame's primitives must be drawn before it swaps or resets.
+
+#define RENDER_TILE_SIZE 32
+#define RENDER_TILES_X ((VOXELS_X + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE)
+#define RENDER_TILES_Y ((VOXELS_Y + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE)
+#define RENDER_TILE_COUNT (RENDER_TILES_X * RENDER_TILES_Y)
+
+typedef struct render_context_s render_context_t;
+
+render_context_t* render_create(int thread_count);
+void render_destroy(render_context_t* context);
+
+void render_begin(render_context_t* context, pixel_t* volume);
+
+// positions are copied and referred to by the returned handle, texcoords, indices and edges must stay put until render_end
+uint32_t render_positions(render_context_t* context, const float* positions, uint32_t count);
+void render_edges(render_context_t* context, uint32_t positions, const edge_t* edges, uint32_t edge_count);
+void render_triangles(render_context_t* context, uint32_t positions, const float* texcoords, uint32_t texcoord_stride, const index_t* indices, uint32_t index_count, const graphics_material_t* material);
+void render_triangles_clipped(render_context_t* context, uint32_t positions, const float* texcoords, uint32_t texcoord_stride, const index_t* indices, uint32_t index_count, const graphics_material_t* material, const graphics_box_t* clip);
+
+void render_end(render_context_t* context);
+
+#endif
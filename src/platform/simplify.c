@@ -0,0 +1,473 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "simplify.h"
+
+#include "mathc.h"
+#include "rammel.h"
+#include "array.h"
+
+// collapses are made in passes, each taking any edge cheaper than a threshold that rises pass by pass,
+// with the adjacency rebuilt every few passes rather than kept exact
+#define SIMPLIFY_MAX_PASSES 100
+#define SIMPLIFY_REBUILD_PASSES 5
+#define SIMPLIFY_AGGRESSION 7
+#define SIMPLIFY_BORDER_WEIGHT 1000.0
+#define SIMPLIFY_FLIP_DOT 0.2
+
+// worth keeping only if at least this much smaller than the model it came from
+#define SIMPLIFY_MIN_REDUCTION 0.75f
+
+// the symmetric 4x4 matrix of a sum of squared plane distances
+typedef struct {
+    double m[10];
+} quadric_t;
+
+typedef struct {
+    double position[3];
+    quadric_t quadric;
+    uint32_t first_ref;
+    uint32_t ref_count;
+    bool border;
+} simplify_vertex_t;
+
+typedef struct {
+    uint32_t v[3];
+    uint32_t surface;
+    double error[4];        // collapsing each edge, then the least of them
+    double normal[3];
+    bool deleted;
+    bool dirty;
+} simplify_triangle_t;
+
+// a triangle touching a vertex, and which of its corners the vertex is
+typedef struct {
+    uint32_t triangle;
+    uint32_t corner;
+} simplify_ref_t;
+
+static array_t scratch_vertices = {sizeof(simplify_vertex_t)};
+static array_t scratch_triangles = {sizeof(simplify_triangle_t)};
+static array_t scratch_refs = {sizeof(simplify_ref_t)};
+static array_t scratch_neighbours = {sizeof(uint32_t) * 2};     // a vertex, and the ref it was found through
+static array_t scratch_remap = {sizeof(uint32_t)};
+
+static void quadric_add_plane(quadric_t* q, const double* n, double d, double weight) {
+    double a = n[0], b = n[1], c = n[2];
+    const double plane[10] = {a*a, a*b, a*c, a*d, b*b, b*c, b*d, c*c, c*d, d*d};
+    for (int i = 0; i < 10; ++i) {
+        q->m[i] += plane[i] * weight;
+    }
+}
+
+static double quadric_error(const quadric_t* q, const double* p) {
+    const double* m = q->m;
+    double x = p[0], y = p[1], z = p[2];
+    return m[0]*x*x + 2*m[1]*x*y + 2*m[2]*x*z + 2*m[3]*x
+         + m[4]*y*y + 2*m[5]*y*z + 2*m[6]*y
+         + m[7]*z*z + 2*m[8]*z
+         + m[9];
+}
+
+static void dvec3_subtract(double* result, const double* a, const double* b) {
+    for (int i = 0; i < 3; ++i) {
+        result[i] = a[i] - b[i];
+    }
+}
+
+static void dvec3_cross(double* result, const double* a, const double* b) {
+    double x = a[1] * b[2] - a[2] * b[1];
+    double y = a[2] * b[0] - a[0] * b[2];
+    double z = a[0] * b[1] - a[1] * b[0];
+    result[0] = x;
+    result[1] = y;
+    result[2] = z;
+}
+
+static double dvec3_dot(const double* a, const double* b) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static bool dvec3_normalise(double* v) {
+    double length = sqrt(dvec3_dot(v, v));
+    if (length <= 0) {
+        return false;
+    }
+    for (int i = 0; i < 3; ++i) {
+        v[i] /= length;
+    }
+    return true;
+}
+
+static simplify_vertex_t* vertex_at(uint32_t index) {
+    return &((simplify_vertex_t*)scratch_vertices.data)[index];
+}
+
+static simplify_triangle_t* triangle_at(uint32_t index) {
+    return &((simplify_triangle_t*)scratch_triangles.data)[index];
+}
+
+static simplify_ref_t* ref_at(uint32_t index) {
+    return &((simplify_ref_t*)scratch_refs.data)[index];
+}
+
+static void triangle_normal(simplify_triangle_t* triangle) {
+    double one[3], two[3];
+    dvec3_subtract(one, vertex_at(triangle->v[1])->position, vertex_at(triangle->v[0])->position);
+    dvec3_subtract(two, vertex_at(triangle->v[2])->position, vertex_at(triangle->v[0])->position);
+    dvec3_cross(triangle->normal, one, two);
+    dvec3_normalise(triangle->normal);
+}
+
+// the cost of merging two vertices, and which of them survives
+static double edge_error(uint32_t i0, uint32_t i1, uint32_t* keep) {
+    quadric_t q = vertex_at(i0)->quadric;
+    const quadric_t* q1 = &vertex_at(i1)->quadric;
+    for (int i = 0; i < 10; ++i) {
+        q.m[i] += q1->m[i];
+    }
+
+    double e0 = quadric_error(&q, vertex_at(i0)->position);
+    double e1 = quadric_error(&q, vertex_at(i1)->position);
+    *keep = (e1 < e0) ? i1 : i0;
+    return min(e0, e1);
+}
+
+static void triangle_errors(simplify_triangle_t* triangle) {
+    uint32_t keep;
+    for (int j = 0; j < 3; ++j) {
+        triangle->error[j] = edge_error(triangle->v[j], triangle->v[(j + 1) % 3], &keep);
+    }
+    triangle->error[3] = min(triangle->error[0], min(triangle->error[1], triangle->error[2]));
+}
+
+static void build_refs(void) {
+    simplify_vertex_t* vertices = scratch_vertices.data;
+    for (uint32_t i = 0; i < scratch_vertices.count; ++i) {
+        vertices[i].first_ref = 0;
+        vertices[i].ref_count = 0;
+    }
+
+    for (uint32_t t = 0; t < scratch_triangles.count; ++t) {
+        for (int j = 0; j < 3; ++j) {
+            vertices[triangle_at(t)->v[j]].ref_count += 1;
+        }
+    }
+
+    uint32_t first = 0;
+    for (uint32_t i = 0; i < scratch_vertices.count; ++i) {
+        vertices[i].first_ref = first;
+        first += vertices[i].ref_count;
+        vertices[i].ref_count = 0;
+    }
+
+    array_resize(&scratch_refs, first);
+    for (uint32_t t = 0; t < scratch_triangles.count; ++t) {
+        for (uint32_t j = 0; j < 3; ++j) {
+            simplify_vertex_t* vertex = &vertices[triangle_at(t)->v[j]];
+            *ref_at(vertex->first_ref + vertex->ref_count++) = (simplify_ref_t){t, j};
+        }
+    }
+}
+
+// an edge used by only one triangle is a border, held in place by a plane through it square to the triangle
+static void find_borders(void) {
+    for (uint32_t i = 0; i < scratch_vertices.count; ++i) {
+        simplify_vertex_t* vertex = vertex_at(i);
+
+        array_clear(&scratch_neighbours);
+        for (uint32_t r = 0; r < vertex->ref_count; ++r) {
+            const simplify_triangle_t* triangle = triangle_at(ref_at(vertex->first_ref + r)->triangle);
+            for (int j = 0; j < 3; ++j) {
+                if (triangle->v[j] != i) {
+                    uint32_t* neighbour = array_push(&scratch_neighbours);
+                    neighbour[0] = triangle->v[j];
+                    neighbour[1] = vertex->first_ref + r;
+                }
+            }
+        }
+
+        const uint32_t (*neighbours)[2] = scratch_neighbours.data;
+        for (uint32_t n = 0; n < scratch_neighbours.count; ++n) {
+            uint32_t uses = 0;
+            for (uint32_t m = 0; m < scratch_neighbours.count; ++m) {
+                uses += (neighbours[m][0] == neighbours[n][0]);
+            }
+            if (uses != 1) {
+                continue;
+            }
+
+            vertex->border = true;
+
+            const simplify_triangle_t* triangle = triangle_at(ref_at(neighbours[n][1])->triangle);
+            double along[3], across[3];
+            dvec3_subtract(along, vertex_at(neighbours[n][0])->position, vertex->position);
+            dvec3_cross(across, along, triangle->normal);
+            if (dvec3_normalise(across)) {
+                double d = -dvec3_dot(across, vertex->position);
+                quadric_add_plane(&vertex->quadric, across, d, SIMPLIFY_BORDER_WEIGHT);
+            }
+        }
+    }
+}
+
+static void update_mesh(int pass) {
+    if (pass > 0) {
+        uint32_t live = 0;
+        for (uint32_t t = 0; t < scratch_triangles.count; ++t) {
+            if (!triangle_at(t)->deleted) {
+                *triangle_at(live++) = *triangle_at(t);
+            }
+        }
+        scratch_triangles.count = live;
+    }
+
+    if (pass == 0) {
+        for (uint32_t t = 0; t < scratch_triangles.count; ++t) {
+            simplify_triangle_t* triangle = triangle_at(t);
+            triangle_normal(triangle);
+            double d = -dvec3_dot(triangle->normal, vertex_at(triangle->v[0])->position);
+            for (int j = 0; j < 3; ++j) {
+                quadric_add_plane(&vertex_at(triangle->v[j])->quadric, triangle->normal, d, 1.0);
+            }
+        }
+    }
+
+    build_refs();
+
+    if (pass == 0) {
+        find_borders();
+        for (uint32_t t = 0; t < scratch_triangles.count; ++t) {
+            triangle_errors(triangle_at(t));
+        }
+    }
+}
+
+// whether moving removed onto keep would fold any of removed's other triangles over
+static bool collapse_flips(uint32_t removed, uint32_t keep) {
+    const simplify_vertex_t* vertex = vertex_at(removed);
+    const double* target = vertex_at(keep)->position;
+
+    for (uint32_t r = 0; r < vertex->ref_count; ++r) {
+        const simplify_ref_t* ref = ref_at(vertex->first_ref + r);
+        const simplify_triangle_t* triangle = triangle_at(ref->triangle);
+        if (triangle->deleted) {
+            continue;
+        }
+
+        uint32_t id1 = triangle->v[(ref->corner + 1) % 3];
+        uint32_t id2 = triangle->v[(ref->corner + 2) % 3];
+        if (id1 == keep || id2 == keep) {
+            continue;
+        }
+
+        double d1[3], d2[3], normal[3];
+        dvec3_subtract(d1, vertex_at(id1)->position, target);
+        dvec3_subtract(d2, vertex_at(id2)->position, target);
+        if (!dvec3_normalise(d1) || !dvec3_normalise(d2) || fabs(dvec3_dot(d1, d2)) > 0.999) {
+            return true;
+        }
+
+        dvec3_cross(normal, d1, d2);
+        if (!dvec3_normalise(normal) || dvec3_dot(normal, triangle->normal) < SIMPLIFY_FLIP_DOT) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// points removed's triangles at keep, dropping those that had both, and gives keep a fresh run of refs
+static uint32_t collapse(uint32_t removed, uint32_t keep) {
+    uint32_t deleted = 0;
+    uint32_t first = scratch_refs.count;
+
+    const uint32_t vertices[2] = {keep, removed};
+    for (int k = 0; k < 2; ++k) {
+        simplify_vertex_t* vertex = vertex_at(vertices[k]);
+        for (uint32_t r = 0; r < vertex->ref_count; ++r) {
+            simplify_ref_t ref = *ref_at(vertex->first_ref + r);
+            simplify_triangle_t* triangle = triangle_at(ref.triangle);
+            if (triangle->deleted) {
+                continue;
+            }
+
+            if (vertices[k] == removed) {
+                uint32_t id1 = triangle->v[(ref.corner + 1) % 3];
+                uint32_t id2 = triangle->v[(ref.corner + 2) % 3];
+                if (id1 == keep || id2 == keep) {
+                    triangle->deleted = true;
+                    ++deleted;
+                    continue;
+                }
+                triangle->v[ref.corner] = keep;
+                triangle_normal(triangle);
+            }
+
+            triangle->dirty = true;
+            triangle_errors(triangle);
+            *(simplify_ref_t*)array_push(&scratch_refs) = ref;
+        }
+    }
+
+    simplify_vertex_t* kept = vertex_at(keep);
+    kept->first_ref = first;
+    kept->ref_count = scratch_refs.count - first;
+    return deleted;
+}
+
+static void simplify(uint32_t target_triangles) {
+    uint32_t triangle_count = scratch_triangles.count;
+    uint32_t deleted = 0;
+
+    for (int pass = 0; pass < SIMPLIFY_MAX_PASSES && triangle_count - deleted > target_triangles; ++pass) {
+        if (pass % SIMPLIFY_REBUILD_PASSES == 0) {
+            update_mesh(pass);
+            triangle_count = scratch_triangles.count;
+            deleted = 0;
+        }
+
+        for (uint32_t t = 0; t < scratch_triangles.count; ++t) {
+            triangle_at(t)->dirty = false;
+        }
+
+        const double threshold = 1e-9 * pow(pass + 3, SIMPLIFY_AGGRESSION);
+
+        for (uint32_t t = 0; t < scratch_triangles.count && triangle_count - deleted > target_triangles; ++t) {
+            simplify_triangle_t* triangle = triangle_at(t);
+            if (triangle->error[3] > threshold || triangle->deleted || triangle->dirty) {
+                continue;
+            }
+
+            for (int j = 0; j < 3; ++j) {
+                if (triangle->error[j] > threshold) {
+                    continue;
+                }
+
+                uint32_t i0 = triangle->v[j];
+                uint32_t i1 = triangle->v[(j + 1) % 3];
+                if (vertex_at(i0)->border != vertex_at(i1)->border) {
+                    continue;
+                }
+
+                uint32_t keep;
+                edge_error(i0, i1, &keep);
+                uint32_t removed = (keep == i0) ? i1 : i0;
+                if (collapse_flips(removed, keep)) {
+                    continue;
+                }
+
+                quadric_t* quadric = &vertex_at(keep)->quadric;
+                for (int i = 0; i < 10; ++i) {
+                    quadric->m[i] += vertex_at(removed)->quadric.m[i];
+                }
+
+                deleted += collapse(removed, keep);
+                break;
+            }
+        }
+    }
+
+    uint32_t live = 0;
+    for (uint32_t t = 0; t < scratch_triangles.count; ++t) {
+        if (!triangle_at(t)->deleted) {
+            *triangle_at(live++) = *triangle_at(t);
+        }
+    }
+    scratch_triangles.count = live;
+}
+
+model_t* simplify_model(const model_t* model, uint32_t target_triangles) {
+    uint32_t triangle_count = 0;
+    for (uint32_t s = 0; s < model->surface_count; ++s) {
+        triangle_count += model->surfaces[s].index_count / 3;
+    }
+    if (!triangle_count || target_triangles >= triangle_count) {
+        return NULL;
+    }
+
+    // quadric errors are compared against fixed thresholds, so work at a fixed size
+    const float* centre = model->bounds.centre;
+    double scale = (model->bounds.radius > 0) ? 1.0 / model->bounds.radius : 1.0;
+
+    array_resize(&scratch_vertices, model->vertex_count);
+    memset(scratch_vertices.data, 0, model->vertex_count * sizeof(simplify_vertex_t));
+    for (uint32_t i = 0; i < model->vertex_count; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            vertex_at(i)->position[c] = (model->vertices[i].position.v[c] - centre[c]) * scale;
+        }
+    }
+
+    array_resize(&scratch_triangles, triangle_count);
+    memset(scratch_triangles.data, 0, triangle_count * sizeof(simplify_triangle_t));
+    uint32_t t = 0;
+    for (uint32_t s = 0; s < model->surface_count; ++s) {
+        const surface_t* surface = &model->surfaces[s];
+        for (uint32_t i = 0; i + 2 < surface->index_count; i += 3) {
+            simplify_triangle_t* triangle = triangle_at(t++);
+            memcpy(triangle->v, &surface->indices[i], sizeof(triangle->v));
+            triangle->surface = s;
+        }
+    }
+
+    simplify(target_triangles);
+
+    if (scratch_triangles.count > triangle_count * SIMPLIFY_MIN_REDUCTION) {
+        return NULL;
+    }
+
+    // keep the vertices that are still used, in their original order
+    const uint32_t none = ~0u;
+    array_resize(&scratch_remap, model->vertex_count);
+    uint32_t* remap = scratch_remap.data;
+    memset(remap, 0xff, model->vertex_count * sizeof(uint32_t));
+    for (t = 0; t < scratch_triangles.count; ++t) {
+        for (int j = 0; j < 3; ++j) {
+            remap[triangle_at(t)->v[j]] = 0;
+        }
+    }
+
+    model_t* coarse = calloc(1, sizeof(model_t));
+    for (uint32_t i = 0; i < model->vertex_count; ++i) {
+        if (remap[i] != none) {
+            remap[i] = coarse->vertex_count++;
+        }
+    }
+
+    coarse->vertices = malloc(max(coarse->vertex_count, 1u) * sizeof(vertex_t));
+    for (uint32_t i = 0; i < model->vertex_count; ++i) {
+        if (remap[i] != none) {
+            coarse->vertices[remap[i]] = model->vertices[i];
+        }
+    }
+
+    coarse->surface_count = model->surface_count;
+    coarse->surfaces = calloc(coarse->surface_count, sizeof(surface_t));
+    for (uint32_t s = 0; s < model->surface_count; ++s) {
+        coarse->surfaces[s].colour = model->surfaces[s].colour;
+        coarse->surfaces[s].image = model->surfaces[s].image;
+    }
+
+    for (t = 0; t < scratch_triangles.count; ++t) {
+        coarse->surfaces[triangle_at(t)->surface].index_count += 3;
+    }
+    for (uint32_t s = 0; s < coarse->surface_count; ++s) {
+        coarse->surfaces[s].indices = malloc(max(coarse->surfaces[s].index_count, 1u) * sizeof(index_t));
+        coarse->surfaces[s].index_count = 0;
+    }
+    for (t = 0; t < scratch_triangles.count; ++t) {
+        const simplify_triangle_t* triangle = triangle_at(t);
+        surface_t* surface = &coarse->surfaces[triangle->surface];
+        for (int j = 0; j < 3; ++j) {
+            surface->indices[surface->index_count++] = remap[triangle->v[j]];
+        }
+    }
+
+    array_clear(&scratch_vertices);
+    array_clear(&scratch_triangles);
+    array_clear(&scratch_refs);
+
+    return coarse;
+}
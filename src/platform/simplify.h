@@ -0,0 +1,14 @@
+#ifndef _SIMPLIFY_H_
+#define _SIMPLIFY_H_
+
+#include "model.h"
+
+// quadric edge collapse, for building coarser copies of detailed models.
+// vertices are only ever merged into one of their neighbours, never moved, so texture coordinates and surface
+// colours carry over unchanged. borders, texture seams among them, are weighted to stay put and only collapse along themselves.
+
+// a copy of model's surfaces cut down to about target_triangles triangles. surfaces stay in the same order and share
+// the model's images, edges aren't copied, and nothing is clustered. NULL if too little could be collapsed to be worth it
+model_t* simplify_model(const model_t* model, uint32_t target_triangles);
+
+#endif
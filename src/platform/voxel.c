@@ -7,6 +7,9 @@
 #include <fcntl.h>
 #include <sys/mman.h>
 
+#include "rammel.h"
+#include "arena.h"
+
 voxel_double_buffer_t* voxel_buffer = NULL;
 static int voxel_fd = -1;
 
@@ -24,6 +27,11 @@ bool voxel_buffer_map(void) {
         return false;
     }
 
+    // polar layers left behind by the last client would be drawn over this one's volume
+    for (int i = 0; i < count_of(voxel_buffer->polar); ++i) {
+        voxel_buffer->polar[i].mode = VOXEL_POLAR_OFF;
+    }
+
     return true;
 }
 
@@ -36,11 +44,97 @@ pixel_t* voxel_buffer_get(VOXEL_BUFFER_T buffer) {
     return voxel_buffer->volume[(!voxel_buffer->page) == (buffer == VOXEL_BUFFER_BACK)];
 }
 
+voxel_polar_t* voxel_buffer_get_polar(VOXEL_BUFFER_T buffer) {
+    return &voxel_buffer->polar[(!voxel_buffer->page) == (buffer == VOXEL_BUFFER_BACK)];
+}
+
 void voxel_buffer_clear(pixel_t* volume) {
     memset(volume, 0, sizeof(*voxel_buffer->volume));
 }
 
 void voxel_buffer_swap(void) {
     voxel_buffer->page = !voxel_buffer->page;
+    arena_reset();
+}
+
+#ifdef HIGH_COLOUR
+#define SPLAT_CHANNEL_MASKS {0xf800, 0x07e0, 0x001f}
+#else
+#define SPLAT_CHANNEL_MASKS {0xe0, 0x1c, 0x03}
+#endif
+
+static inline pixel_t splat_colour(uint8_t colour) {
+#ifdef HIGH_COLOUR
+    return RGBPIX(R332(colour), G332(colour), B332(colour));
+#else
+    return colour;
+#endif
+}
+
+static inline pixel_t splat_max(pixel_t one, pixel_t two) {
+    const pixel_t masks[] = SPLAT_CHANNEL_MASKS;
+    pixel_t result = 0;
+    for (int c = 0; c < count_of(masks); ++c) {
+        result |= max((pixel_t)(one & masks[c]), (pixel_t)(two & masks[c]));
+    }
+    return result;
 }
 
+_Static_assert((VOXEL_SPLAT_RADIUS_MASK >> 8) <= VOXEL_SPLAT_MAX_RADIUS, "splat offsets are sized for the largest radius the flags hold");
+
+static void splat_radius(pixel_t* volume, const uint8_t* xyzc, size_t count, uint32_t flags, int radius) {
+    int offsets[(VOXEL_SPLAT_MAX_RADIUS*2+1)*(VOXEL_SPLAT_MAX_RADIUS*2+1)*(VOXEL_SPLAT_MAX_RADIUS*2+1)][3];
+    int offset_count = 0;
+    for (int z = -radius; z <= radius; ++z) {
+        for (int y = -radius; y <= radius; ++y) {
+            for (int x = -radius; x <= radius; ++x) {
+                if (x*x + y*y + z*z <= radius*radius) {
+                    offsets[offset_count][0] = x;
+                    offsets[offset_count][1] = y;
+                    offsets[offset_count][2] = z;
+                    ++offset_count;
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        const uint8_t* point = &xyzc[i*4];
+        pixel_t colour = splat_colour(point[3]);
+        for (int o = 0; o < offset_count; ++o) {
+            int x = point[0] + offsets[o][0];
+            int y = point[1] + offsets[o][1];
+            int z = point[2] + offsets[o][2];
+            if ((uint)x < VOXELS_X && (uint)y < VOXELS_Y && (uint)z < VOXELS_Z) {
+                pixel_t* voxel = &volume[VOXEL_INDEX(x, y, z)];
+                *voxel = (flags & VOXEL_SPLAT_MAX) ? splat_max(*voxel, colour) : colour;
+            }
+        }
+    }
+}
+
+void voxel_splat_points(pixel_t* volume, const uint8_t* xyzc, size_t count, uint32_t flags) {
+    int radius = (flags & VOXEL_SPLAT_RADIUS_MASK) >> 8;
+    if (radius > 0) {
+        splat_radius(volume, xyzc, count, flags, radius);
+        return;
+    }
+
+    // a plain loop per mode, with the branch on flags kept out of it
+    if (flags & VOXEL_SPLAT_MAX) {
+        for (size_t i = 0; i < count; ++i) {
+            const uint8_t* point = &xyzc[i*4];
+            if (point[0] < VOXELS_X && point[1] < VOXELS_Y && point[2] < VOXELS_Z) {
+                pixel_t* voxel = &volume[VOXEL_INDEX(point[0], point[1], point[2])];
+                *voxel = splat_max(*voxel, splat_colour(point[3]));
+            }
+        }
+    } else {
+        for (size_t i = 0; i < count; ++i) {
+            const uint8_t* point = &xyzc[i*4];
+            if (point[0] < VOXELS_X && point[1] < VOXELS_Y && point[2] < VOXELS_Z) {
+                volume[VOXEL_INDEX(point[0], point[1], point[2])] = splat_colour(point[3]);
+            }
+        }
+    }
+}
@@ -5,6 +5,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include "gadget.h"
 
 #define R565(p) (((p)>>8) & 0xf8)
@@ -68,6 +69,7 @@ static inline int VOXEL_INDEX(int x, int y, int z) {
     return (x*VOXEL_X_STRIDE + y*VOXEL_Y_STRIDE + (z&((VOXELS_Z/2)-1))*VOXEL_Z_STRIDE) * 2 + ((z/(VOXELS_Z/2))&1);
 }
 #define VOXEL_FIELD_STRIDE 1
+#define VOXEL_Z_CONTIGUOUS 0
 
 #elif defined (VOXEL_INDEX_MORTON)
 static inline int VOXEL_INDEX(int x, int y, int z) {
@@ -82,10 +84,29 @@ static inline int VOXEL_INDEX(int x, int y, int z) {
     int morton = x | (y << 1);
     return (morton + (z&(VOXELS_Z/2-1))*VOXEL_Z_STRIDE) * 2 + ((z / (VOXELS_Z/2)) & 1);
 }
+#define VOXEL_Z_CONTIGUOUS 0
 #else
 
 #define VOXEL_INDEX(x,y,z) ((x)*VOXEL_X_STRIDE + (y)*VOXEL_Y_STRIDE + (z)*VOXEL_Z_STRIDE)
 #define VOXEL_FIELD_STRIDE (PANEL_FIELD_HEIGHT * VOXEL_Z_STRIDE)
+
+// a run of voxels up a column is a run in memory, so it can be set or copied in one go
+#define VOXEL_Z_CONTIGUOUS (VOXEL_Z_STRIDE == 1)
+#endif
+
+#define SLICE_COUNT 360
+#define SLICE_QUADRANT (SLICE_COUNT / 4)
+#define SLICE_WRAP(slice) ((slice) % (SLICE_COUNT))
+
+#if SLICE_COUNT <= 256
+    typedef uint8_t slice_index_t;
+#else
+    typedef uint16_t slice_index_t;
+#endif
+
+#ifndef VERTICAL_SCAN
+// the driver draws polar layers straight into its slices. gadgets that scan out of the volume directly don't have slices
+#define VOXEL_POLAR_LAYER
 #endif
 
 enum {
@@ -100,6 +121,30 @@ enum {
     VORTEX_ROTISSERIE =           0x0040
 };
 
+#define VOXEL_POLAR_CAPACITY (1<<18)
+
+typedef enum {
+    VOXEL_POLAR_OFF,
+    VOXEL_POLAR_OVERLAY,    // drawn over the volume
+    VOXEL_POLAR_ONLY        // the volume isn't shown, so needn't be cleared
+} voxel_polar_mode_t;
+
+// a voxel in the driver's own space: the panel column it lights, at the slice it's filed under
+typedef struct {
+    uint8_t column;
+    uint8_t panel;
+    voxel_index_t z;
+    pixel_t colour;
+} polar_voxel_t;
+
+// voxels drawn directly into slices, which the driver copies through without resampling the volume.
+// the voxels of slice s run from voxels[slices[s]] up to voxels[slices[s+1]]. while the display is stopped only the volume is shown
+typedef struct {
+    uint32_t mode;
+    uint32_t slices[SLICE_COUNT + 1];
+    polar_voxel_t voxels[VOXEL_POLAR_CAPACITY];
+} voxel_polar_t;
+
 typedef struct {
     pixel_t volume[2][VOXELS_COUNT];
     uint8_t page;
@@ -107,6 +152,7 @@ typedef struct {
     uint16_t debug_flags;
     uint16_t revolutions_per_minute;
     uint16_t microseconds_per_frame;
+    voxel_polar_t polar[2];
 } voxel_double_buffer_t;
 
 typedef enum {
@@ -122,11 +168,25 @@ static inline bool voxel_in_cylinder(int x, int y) {
     return (x * x + y * y) <= (((VOXELS_X + VOXELS_Y) / 2) * ((VOXELS_X + VOXELS_Y) / 2));
 }
 
+enum {
+    VOXEL_SPLAT_LAST =          0x0000,     // later points overwrite earlier ones
+    VOXEL_SPLAT_MAX =           0x0001,     // each channel keeps the brightest of the points landing on it
+    VOXEL_SPLAT_RADIUS_MASK =   0x0300      // points cover a ball of up to VOXEL_SPLAT_MAX_RADIUS voxels radius
+};
+
+#define VOXEL_SPLAT_MAX_RADIUS 3
+
+#define VOXEL_SPLAT_RADIUS(r) (((r) << 8) & VOXEL_SPLAT_RADIUS_MASK)
+
 bool voxel_buffer_map(void);
 void voxel_buffer_unmap(void);
 
 pixel_t* voxel_buffer_get(VOXEL_BUFFER_T buffer);
+voxel_polar_t* voxel_buffer_get_polar(VOXEL_BUFFER_T buffer);
 void voxel_buffer_clear(pixel_t* volume);
 void voxel_buffer_swap(void);
 
+// draws count points packed as x, y, z, RGB332 colour bytes. points outside the volume are dropped
+void voxel_splat_points(pixel_t* volume, const uint8_t* xyzc, size_t count, uint32_t flags);
+
 #endif
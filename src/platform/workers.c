@@ -0,0 +1,159 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "rammel.h"
+
+#include "workers.h"
+
+struct workers_s {
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t finish;
+
+    int thread_count;
+    pthread_t* threads;
+    bool quit;
+
+    uint generation;
+    workers_job_cb_t job;
+    void* context;
+    int job_count;
+    int job_next;
+    int job_done;
+    int active;
+};
+
+static void do_jobs(workers_t* workers, workers_job_cb_t job, void* context, int job_count) {
+    int done = 0;
+    int claimed;
+    while ((claimed = __atomic_fetch_add(&workers->job_next, 1, __ATOMIC_RELAXED)) < job_count) {
+        job(context, claimed);
+        ++done;
+    }
+
+    if (done) {
+        pthread_mutex_lock(&workers->lock);
+        workers->job_done += done;
+        if (workers->job_done == job_count) {
+            pthread_cond_broadcast(&workers->finish);
+        }
+        pthread_mutex_unlock(&workers->lock);
+    }
+}
+
+static void* worker_thread(void* arg) {
+    workers_t* workers = arg;
+    uint generation = 0;
+
+    pthread_mutex_lock(&workers->lock);
+    while (true) {
+        while (!workers->quit && workers->generation == generation) {
+            pthread_cond_wait(&workers->start, &workers->lock);
+        }
+        if (workers->quit) {
+            break;
+        }
+        generation = workers->generation;
+
+        workers_job_cb_t job = workers->job;
+        void* context = workers->context;
+        int job_count = workers->job_count;
+        ++workers->active;
+        pthread_mutex_unlock(&workers->lock);
+
+        do_jobs(workers, job, context, job_count);
+
+        pthread_mutex_lock(&workers->lock);
+        if (--workers->active == 0) {
+            pthread_cond_broadcast(&workers->finish);
+        }
+    }
+    pthread_mutex_unlock(&workers->lock);
+
+    return NULL;
+}
+
+workers_t* workers_create(int thread_count) {
+    workers_t* workers = calloc(1, sizeof(workers_t));
+    if (!workers) {
+        return NULL;
+    }
+
+    pthread_mutex_init(&workers->lock, NULL);
+    pthread_cond_init(&workers->start, NULL);
+    pthread_cond_init(&workers->finish, NULL);
+
+    workers->thread_count = 1;
+    if (thread_count > 1) {
+        workers->threads = calloc(thread_count - 1, sizeof(pthread_t));
+        for (int i = 0; workers->threads && i < thread_count - 1; ++i) {
+            if (pthread_create(&workers->threads[i], NULL, worker_thread, workers) != 0) {
+                break;
+            }
+            ++workers->thread_count;
+        }
+    }
+
+    return workers;
+}
+
+void workers_destroy(workers_t* workers) {
+    if (!workers) {
+        return;
+    }
+
+    pthread_mutex_lock(&workers->lock);
+    workers->quit = true;
+    pthread_cond_broadcast(&workers->start);
+    pthread_mutex_unlock(&workers->lock);
+
+    for (int i = 0; i < workers->thread_count - 1; ++i) {
+        pthread_join(workers->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&workers->finish);
+    pthread_cond_destroy(&workers->start);
+    pthread_mutex_destroy(&workers->lock);
+    free(workers->threads);
+    free(workers);
+}
+
+int workers_thread_count(const workers_t* workers) {
+    return workers ? workers->thread_count : 1;
+}
+
+void workers_run(workers_t* workers, workers_job_cb_t job, void* context, int job_count) {
+    if (job_count <= 0) {
+        return;
+    }
+
+    if (!workers || workers->thread_count < 2 || job_count < 2) {
+        for (int i = 0; i < job_count; ++i) {
+            job(context, i);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&workers->lock);
+    // stragglers from the last run must be out of do_jobs before the counters are reused
+    while (workers->active > 0) {
+        pthread_cond_wait(&workers->finish, &workers->lock);
+    }
+    workers->job = job;
+    workers->context = context;
+    workers->job_count = job_count;
+    workers->job_next = 0;
+    workers->job_done = 0;
+    ++workers->generation;
+    pthread_cond_broadcast(&workers->start);
+    pthread_mutex_unlock(&workers->lock);
+
+    do_jobs(workers, job, context, job_count);
+
+    pthread_mutex_lock(&workers->lock);
+    while (workers->job_done < job_count) {
+        pthread_cond_wait(&workers->finish, &workers->lock);
+    }
+    pthread_mutex_unlock(&workers->lock);
+}
@@ -0,0 +1,18 @@
+#ifndef _WORKERS_H_
+#define _WORKERS_H_
+
+// a small pool of threads for fanning independent jobs out across cores
+
+typedef struct workers_s workers_t;
+
+typedef void (*workers_job_cb_t)(void* context, int job);
+
+// thread_count includes the caller, which joins in while it waits
+workers_t* workers_create(int thread_count);
+void workers_destroy(workers_t* workers);
+int workers_thread_count(const workers_t* workers);
+
+// runs job(context, 0..job_count-1) and returns once they've all finished
+void workers_run(workers_t* workers, workers_job_cb_t job, void* context, int job_count);
+
+#endif
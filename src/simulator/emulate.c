@@ -0,0 +1,146 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "emulate.h"
+
+#include "mathc.h"
+#include "rammel.h"
+#include "gadget.h"
+
+// the driver's horizontal scan keeps the current slice and one trailing it
+#define TRAIL_STACK 2
+
+sim_emulation_t sim_emulation = {
+    .enabled = false,
+    .uniformity = SLICE_BRIGHTNESS_BOOSTED,
+    .revolutions_per_minute = 1200,
+    .clock_mhz = 20.0f,
+    .sweep_trails = TRAIL_STACK - 1
+};
+
+static slice_rows_t gathered[SLICE_COUNT];
+static bool polar_drawn[SLICE_COUNT];
+
+void emulate_init(void) {
+    slicemap_init(sim_emulation.uniformity);
+
+    // columns the slice map leaves out are never gathered into, so must start dark
+    memset(gathered, 0, sizeof(gathered));
+    memset(polar_drawn, 0, sizeof(polar_drawn));
+}
+
+float emulate_frame_us(int bpc) {
+    // every row shifts out all its bit planes, a column per clock
+    return (float)(PANEL_FIELD_HEIGHT * clamp(bpc, 1, BPC_MAX) * PANEL_WIDTH) / sim_emulation.clock_mhz;
+}
+
+float emulate_slice_us(void) {
+    return 60000000.0f / ((float)max(sim_emulation.revolutions_per_minute, 1) * (float)SLICE_COUNT);
+}
+
+static int slice_at(double time, double slice_us) {
+    return modulo((int)floor(time / slice_us), SLICE_COUNT);
+}
+
+void emulate_revolution(emulated_slice_t* slices, const pixel_t* content, const voxel_polar_t* polar, int bpc) {
+    for (int s = 0; s < SLICE_COUNT; ++s) {
+        slicer_gather(gathered[s], &polar_drawn[s], content, polar, s);
+    }
+
+    const double slice_us = emulate_slice_us();
+    const double frame_us = emulate_frame_us(bpc);
+    const double line_us = frame_us / PANEL_FIELD_HEIGHT;
+    const int trails = clamp(sim_emulation.sweep_trails, 0, TRAIL_STACK - 1);
+
+    for (int s = 0; s < SLICE_COUNT; ++s) {
+        // each line shows what it latched at its last refresh, a frame after the one before. the slices in between
+        // went by unseen, which is what horizontal_slice's trails fill in
+        double shown = ((double)s + 0.5) * slice_us;
+
+        for (int line = 0; line < PANEL_FIELD_HEIGHT; ++line) {
+            double phase = line * line_us;
+            double refresh = floor((shown - phase) / frame_us) * frame_us + phase;
+            int angle = slice_at(refresh, slice_us);
+            int last_scanned = slice_at(refresh - frame_us, slice_us);
+
+            int skipped = clamp(SLICE_WRAP(angle - last_scanned + SLICE_COUNT) - 1, 0, trails);
+            const slice_rows_t* stack[TRAIL_STACK];
+            for (int t = 0; t < TRAIL_STACK; ++t) {
+                stack[t] = &gathered[SLICE_WRAP(angle + SLICE_COUNT - min(t, skipped))];
+            }
+
+            // the panels' column order is wiring, taken as matching the slice map
+            for (int p = 0; p < PANEL_COUNT; ++p) {
+                for (int f = 0; f < PANEL_MULTIPLEX; ++f) {
+                    pixel_t* row = slices[s][p][line + f * PANEL_FIELD_HEIGHT];
+                    for (int c = 0; c < PANEL_WIDTH; ++c) {
+                        pixel_t pix = 0;
+                        for (int t = 0; t < TRAIL_STACK; ++t) {
+                            pix |= (*stack[t])[line][p][f][c];
+                        }
+                        row[c] = pix;
+                    }
+                }
+            }
+        }
+    }
+}
+
+void emulate_palette(float palette[256][3], int bpc) {
+    bpc = clamp(bpc, 1, BPC_MAX);
+
+    int unblank[BPC_MAX];
+    slicer_unblank(1, unblank);
+    const float single = (float)(PANEL_WIDTH - unblank[0]) / (float)PANEL_WIDTH;
+
+    float lit[BPC_MAX];
+    slicer_unblank(bpc, unblank);
+    for (int b = 0; b < bpc; ++b) {
+        lit[b] = (float)(PANEL_WIDTH - unblank[(b+1)%bpc]) / (float)(bpc * PANEL_WIDTH) / single;
+    }
+
+    for (int pix = 0; pix < 256; ++pix) {
+        palette[pix][0] = palette[pix][1] = palette[pix][2] = 0.0f;
+        for (int b = 0; b < bpc; ++b) {
+            palette[pix][0] += R_MTH_BIT(pix, b) * lit[b];
+            palette[pix][1] += G_MTH_BIT(pix, b) * lit[b];
+            palette[pix][2] += B_MTH_BIT(pix, b) * lit[b];
+        }
+    }
+}
+
+size_t emulate_create_mesh(volume_vertex_t** mesh) {
+    size_t vertex_count = SLICE_COUNT * PANEL_COUNT * 6;
+    volume_vertex_t (*vertices)[PANEL_COUNT][6] = malloc(vertex_count * sizeof(volume_vertex_t));
+
+    const float z = (float)VOXELS_Z / (float)VOXELS_X;
+    const float scale = 2.0f / (float)VOXELS_X;
+
+    for (int s = 0; s < SLICE_COUNT; ++s) {
+        // placed as slicemap_init places the columns, edge to edge
+        float angle = (float)s * M_PI * 2.0f / SLICE_COUNT;
+        vec2_t slope = {.x = cosf(angle), .y = sinf(angle)};
+
+        for (int p = 0; p < PANEL_COUNT; ++p) {
+            vec2_t ends[2];
+            for (int e = 0; e < 2; ++e) {
+                float coff = (e ? 0.5f : -0.5f) * (float)PANEL_WIDTH;
+                slicemap_column_offset(ends[e].v, slope.x, slope.y, p, eccentricity[p], coff);
+                vec2_multiply_f(ends[e].v, ends[e].v, scale);
+            }
+
+            float layer = ((float)(s * PANEL_COUNT + p) + 0.5f) / (float)EMULATED_LAYERS;
+
+            vertices[s][p][0] = (volume_vertex_t){.position={ends[0].x, ends[0].y, -z}, .texcoord={0, 1, layer}, .dotcoord={0, (float)PANEL_HEIGHT}};
+            vertices[s][p][1] = (volume_vertex_t){.position={ends[1].x, ends[1].y, -z}, .texcoord={1, 1, layer}, .dotcoord={(float)PANEL_WIDTH, (float)PANEL_HEIGHT}};
+            vertices[s][p][2] = (volume_vertex_t){.position={ends[0].x, ends[0].y,  z}, .texcoord={0, 0, layer}, .dotcoord={0, 0}};
+            vertices[s][p][3] = (volume_vertex_t){.position={ends[1].x, ends[1].y,  z}, .texcoord={1, 0, layer}, .dotcoord={(float)PANEL_WIDTH, 0}};
+            vertices[s][p][4] = vertices[s][p][2];
+            vertices[s][p][5] = vertices[s][p][1];
+        }
+    }
+
+    *mesh = &vertices[0][0][0];
+    return vertex_count;
+}
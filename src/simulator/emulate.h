@@ -0,0 +1,51 @@
+#ifndef _EMULATE_H_
+#define _EMULATE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "voxel.h"
+#include "slicemap.h"
+#include "slicer.h"
+#include "simcore.h"
+
+// driver emulation: rather than sampling the volume wherever a screen passes, show what the driver would. the
+// slicer gathers every slice through the same slice map, and each panel row shows whichever slice it latched last,
+// with sweep trails, as the rotation and the row scan race each other at the given rpm and panel clock. bit
+// planes are weighted by their BCM on time.
+// it's a model of the timing rather than a bit accurate replay: the column wiring is taken to match the slice
+// map, and VERTICAL_SCAN's colscatter order isn't modelled at all, so simcore leaves emulation off for those gadgets
+
+typedef struct {
+    bool enabled;
+    slice_brightness_t uniformity;
+    int revolutions_per_minute;
+    float clock_mhz;                // column clock, which sets how long each row takes to scan out
+    int sweep_trails;
+} sim_emulation_t;
+
+extern sim_emulation_t sim_emulation;
+
+// the LEDs of both panels at each slice of a revolution, rows from the top, as pixels the driver clocked out
+typedef pixel_t emulated_slice_t[PANEL_COUNT][PANEL_HEIGHT][PANEL_WIDTH];
+
+#define EMULATED_LAYERS (SLICE_COUNT * PANEL_COUNT)
+
+void emulate_init(void);
+
+// one revolution of the given volume and its polar layer, into SLICE_COUNT slices
+void emulate_revolution(emulated_slice_t* slices, const pixel_t* content, const voxel_polar_t* polar, int bpc);
+
+// rgb brightness of each pixel value once its bit planes are lit for their share of the row time, relative
+// to the brightest a single bit plane gets
+void emulate_palette(float palette[256][3], int bpc);
+
+// a quad for each panel at each slice, where the slice map puts it. texcoord is column, row and layer
+// (slice * PANEL_COUNT + panel), each over its count
+size_t emulate_create_mesh(volume_vertex_t** vertices);
+
+// how the timing works out, for the banner
+float emulate_frame_us(int bpc);
+float emulate_slice_us(void);
+
+#endif
@@ -0,0 +1,550 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "simcore.h"
+#include "emulate.h"
+#include "mathc.h"
+#include "rammel.h"
+#include "timer.h"
+#include "workers.h"
+
+// the simulator without a display: the same slice mesh as virtex, rasterised in software and shaded as
+// volume_frag.glsl does, with frames written out as PNGs and a line of metrics for each.
+// blending is additive like the GPU's, each fragment rounded to 8 bits and the sum saturated.
+
+_Static_assert(sizeof(pixel_t)==1, "simulator only supports RGB332");
+
+#define BAND_HEIGHT 8
+#define NEAR_W 0.1f
+#define INTERPOLANTS 6              // 1/w, then texcoord and dotcoord over w
+
+typedef struct {
+    float x, y;                     // pixels, y down
+    float interpolants[INTERPOLANTS];
+} screen_vertex_t;
+
+typedef struct {
+    screen_vertex_t v[3];
+    float area;
+    int top, bottom;                // rows covered, inclusive
+} screen_triangle_t;
+
+typedef struct {
+    int width, height;
+    uint16_t* accumulated;          // rgb per pixel, 8 bit fragments summed, saturating at 255
+    uint8_t* image;
+    const pixel_t* volume;
+    int bpcmask;
+    float bpcscale[3];
+    bool dotlock;
+    const pixel_t* panels;          // when emulating the driver, sampled in place of the volume
+    float palette[256][3];
+    screen_triangle_t* triangles;
+    size_t triangle_count;
+} frame_t;
+
+static int frame_count = 1;
+static int frame_interval_ms = 100;
+static const char* frame_pattern = "virtex%04d.png";
+static const char* metrics_name = NULL;
+static int viewport_width = 800;
+static int viewport_height = 600;
+static int thread_count = 0;
+
+// the pattern is used as a printf format, so it may only hold the one integer conversion for the frame number
+static bool pattern_valid(const char* pattern) {
+    int conversions = 0;
+    for (const char* c = pattern; *c; ++c) {
+        if (*c != '%' || *++c == '%') {
+            continue;
+        }
+        c += strspn(c, "-+ #0");
+        c += strspn(c, "0123456789");
+        if (*c == '.') {
+            ++c;
+            c += strspn(c, "0123456789");
+        }
+        if (!*c || !strchr("diouxX", *c)) {
+            return false;
+        }
+        ++conversions;
+    }
+    return conversions == 1;
+}
+
+static void parse_option(int opt, int argc, char** argv) {
+    switch (opt) {
+        case 'n': frame_count = max(atoi(optarg), 1); break;
+        case 'i': frame_interval_ms = max(atoi(optarg), 0); break;
+        case 'p': {
+            if (*optarg && !pattern_valid(optarg)) {
+                fprintf(stderr, "-p needs exactly one integer conversion for the frame number, like virtex%%04d.png\n");
+                exit(1);
+            }
+            frame_pattern = optarg;
+        } break;
+        case 'm': metrics_name = optarg; break;
+        case 't': thread_count = max(atoi(optarg), 1); break;
+        case 'v': {
+            if (optind < argc) {
+                int w = atoi(optarg);
+                int h = atoi(argv[optind++]);
+                if (w > 0 && h > 0) {
+                    viewport_width = w;
+                    viewport_height = h;
+                }
+            }
+        } break;
+    }
+}
+
+static bool project_vertex(screen_vertex_t* out, const volume_vertex_t* vertex, const float* matrix, int width, int height) {
+    float clip[4];
+    vec4_multiply_mat4(clip, (float[4]){vertex->position[0], vertex->position[1], vertex->position[2], 1.0f}, matrix);
+    if (clip[3] < NEAR_W) {
+        return false;
+    }
+
+    float inv_w = 1.0f / clip[3];
+    out->x = (clip[0] * inv_w + 1.0f) * 0.5f * width;
+    out->y = (1.0f - clip[1] * inv_w) * 0.5f * height;
+    out->interpolants[0] = inv_w;
+    for (int a = 0; a < 3; ++a) {
+        out->interpolants[1 + a] = vertex->texcoord[a] * inv_w;
+    }
+    for (int a = 0; a < 2; ++a) {
+        out->interpolants[4 + a] = vertex->dotcoord[a] * inv_w;
+    }
+    return true;
+}
+
+// the mesh and camera never change, so the triangles are set up once. back faces are culled as virtex does,
+// and triangles reaching in front of the near plane are dropped rather than clipped
+static size_t setup_triangles(screen_triangle_t* triangles, const volume_vertex_t* vertices, size_t vertex_count, const float* matrix, int width, int height) {
+    size_t count = 0;
+    for (size_t i = 0; i + 2 < vertex_count; i += 3) {
+        screen_triangle_t* triangle = &triangles[count];
+        bool visible = true;
+        for (int v = 0; v < 3 && visible; ++v) {
+            visible = project_vertex(&triangle->v[v], &vertices[i + v], matrix, width, height);
+        }
+        if (!visible) {
+            continue;
+        }
+
+        // counter clockwise in GL's y up window is clockwise here
+        const screen_vertex_t* v = triangle->v;
+        float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+        if (!(area < 0.0f)) {
+            continue;
+        }
+
+        screen_vertex_t swap = triangle->v[1];
+        triangle->v[1] = triangle->v[2];
+        triangle->v[2] = swap;
+        triangle->area = -area;
+
+        float top = min(v[0].y, min(v[1].y, v[2].y));
+        float bottom = max(v[0].y, max(v[1].y, v[2].y));
+        triangle->top = max((int)floorf(top - 0.5f), 0);
+        triangle->bottom = min((int)ceilf(bottom - 0.5f), height - 1);
+        if (triangle->top <= triangle->bottom) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+static inline float edge_function(const screen_vertex_t* a, const screen_vertex_t* b, float x, float y) {
+    return (b->x - a->x) * (y - a->y) - (b->y - a->y) * (x - a->x);
+}
+
+// a pixel exactly on an edge belongs to only one of the triangles sharing it
+static inline bool edge_owns(float e, const screen_vertex_t* a, const screen_vertex_t* b) {
+    return e > 0.0f || (e == 0.0f && (b->y < a->y || (b->y == a->y && b->x > a->x)));
+}
+
+static inline int wrap_texel(float coordinate, int size) {
+    return modulo((int)floorf(coordinate * size), size);
+}
+
+static void shade_triangle(frame_t* frame, const screen_triangle_t* triangle, int row_min, int row_max) {
+    const screen_vertex_t* v = triangle->v;
+
+    int y0 = max(triangle->top, row_min);
+    int y1 = min(triangle->bottom, row_max);
+    int x0 = max((int)floorf(min(v[0].x, min(v[1].x, v[2].x)) - 0.5f), 0);
+    int x1 = min((int)ceilf(max(v[0].x, max(v[1].x, v[2].x)) - 0.5f), frame->width - 1);
+
+    // the interpolants are planes across the screen, so each row is set up once and stepped along.
+    // their steps across and down are the derivatives dFdx and dFdy would give
+    float inv_area = 1.0f / triangle->area;
+    float step_x[INTERPOLANTS] = {0}, step_y[INTERPOLANTS] = {0};
+    for (int e = 0; e < 3; ++e) {
+        const screen_vertex_t* a = &v[(e + 1) % 3];
+        const screen_vertex_t* b = &v[(e + 2) % 3];
+        for (int q = 0; q < INTERPOLANTS; ++q) {
+            step_x[q] += -(b->y - a->y) * inv_area * v[e].interpolants[q];
+            step_y[q] += (b->x - a->x) * inv_area * v[e].interpolants[q];
+        }
+    }
+    float step_dm_x = step_x[4] + step_x[5];
+    float step_dm_y = step_y[4] + step_y[5];
+
+    for (int y = y0; y <= y1; ++y) {
+        float py = y + 0.5f;
+
+        // slices seen edge on are slivers across wide boxes, so each row only walks the span its edges allow.
+        // a pixel either side is left to the exact test
+        int span_min = x0, span_max = x1;
+        for (int i = 0; i < 3; ++i) {
+            const screen_vertex_t* a = &v[(i + 1) % 3];
+            const screen_vertex_t* b = &v[(i + 2) % 3];
+            float slope = -(b->y - a->y);
+            if (slope == 0.0f) {
+                continue;
+            }
+            float crossing = a->x + (b->x - a->x) * (py - a->y) / (b->y - a->y) - 0.5f;
+            crossing = clampf(crossing, x0 - 1, x1 + 1);
+            if (slope > 0.0f) {
+                span_min = max(span_min, (int)floorf(crossing));
+            } else {
+                span_max = min(span_max, (int)ceilf(crossing));
+            }
+        }
+        if (span_min > span_max) {
+            continue;
+        }
+
+        float row[INTERPOLANTS] = {0};
+        for (int i = 0; i < 3; ++i) {
+            float weight = edge_function(&v[(i + 1) % 3], &v[(i + 2) % 3], span_min + 0.5f, py) * inv_area;
+            for (int q = 0; q < INTERPOLANTS; ++q) {
+                row[q] += weight * v[i].interpolants[q];
+            }
+        }
+
+        for (int x = span_min; x <= span_max; ++x) {
+            float px = x + 0.5f;
+
+            bool inside = true;
+            for (int i = 0; i < 3 && inside; ++i) {
+                const screen_vertex_t* a = &v[(i + 1) % 3];
+                const screen_vertex_t* b = &v[(i + 2) % 3];
+                inside = edge_owns(edge_function(a, b, px, py), a, b);
+            }
+            if (!inside) {
+                continue;
+            }
+
+            float along = (float)(x - span_min);
+            float interpolant[INTERPOLANTS];
+            for (int q = 0; q < INTERPOLANTS; ++q) {
+                interpolant[q] = row[q] + step_x[q] * along;
+            }
+            float w = 1.0f / interpolant[0];
+
+            float texcoord[3] = {interpolant[1] * w, interpolant[2] * w, interpolant[3] * w};
+            float dotcoord[2] = {interpolant[4] * w, interpolant[5] * w};
+
+            float colour[3];
+            if (frame->panels) {
+                int pix = frame->panels[(wrap_texel(texcoord[2], EMULATED_LAYERS) * PANEL_HEIGHT + wrap_texel(texcoord[1], PANEL_HEIGHT)) * PANEL_WIDTH + wrap_texel(texcoord[0], PANEL_WIDTH)];
+                if (!pix) {
+                    continue;
+                }
+                for (int c = 0; c < 3; ++c) {
+                    colour[c] = frame->palette[pix][c];
+                }
+            } else {
+                if (frame->dotlock) {
+                    float lock = (floorf(dotcoord[0]) + 0.5f) / dotcoord[0];
+                    texcoord[1] = (texcoord[1] - 0.5f) * lock + 0.5f;
+                    texcoord[2] = (texcoord[2] - 0.5f) * lock + 0.5f;
+                }
+
+                int pix = frame->volume[VOXEL_INDEX(wrap_texel(texcoord[1], VOXELS_X), wrap_texel(texcoord[2], VOXELS_Y), wrap_texel(texcoord[0], VOXELS_Z))] & frame->bpcmask;
+                if (!pix) {
+                    continue;
+                }
+                const int channel[3] = {pix & 0xe0, pix & 0x1c, pix & 0x03};
+                for (int c = 0; c < 3; ++c) {
+                    colour[c] = channel[c] * frame->bpcscale[c];
+                }
+            }
+
+            float fx = dotcoord[0] - floorf(dotcoord[0]) - 0.5f;
+            float fy = dotcoord[1] - floorf(dotcoord[1]) - 0.5f;
+            float lum = max(0.0f, 0.5f - (fx * fx + fy * fy) * 2.0f);
+
+            // how fast dotcoord.x + dotcoord.y changes across neighbouring pixels, fading dots too small to see to grey
+            float dm_over_w = interpolant[4] + interpolant[5];
+            float dm = dm_over_w * w;
+            float dm_x = (dm_over_w + step_dm_x) / (interpolant[0] + step_x[0]) - dm;
+            float dm_y = (dm_over_w + step_dm_y) / (interpolant[0] + step_y[0]) - dm;
+            float dd = min(1.0f, 0.125f / (dm_x * dm_x + dm_y * dm_y));
+            lum = 0.125f + (lum - 0.125f) * dd;
+
+            // enough overlapping slices would wrap a plain sum back round to dark
+            uint16_t* out = &frame->accumulated[(x + y * frame->width) * 3];
+            for (int c = 0; c < 3; ++c) {
+                out[c] = min(out[c] + (int)lroundf(clampf(colour[c] * lum, 0.0f, 1.0f) * 255.0f), 255);
+            }
+        }
+    }
+}
+
+static void draw_band(void* context, int band) {
+    frame_t* frame = context;
+    int row_min = band * BAND_HEIGHT;
+    int row_max = min(row_min + BAND_HEIGHT, frame->height) - 1;
+
+    memset(&frame->accumulated[row_min * frame->width * 3], 0, (row_max - row_min + 1) * frame->width * 3 * sizeof(uint16_t));
+
+    // submission order doesn't matter, the blend is a sum
+    for (size_t t = 0; t < frame->triangle_count; ++t) {
+        const screen_triangle_t* triangle = &frame->triangles[t];
+        if (triangle->top <= row_max && triangle->bottom >= row_min) {
+            shade_triangle(frame, triangle, row_min, row_max);
+        }
+    }
+
+    for (int i = row_min * frame->width * 3; i < (row_max + 1) * frame->width * 3; ++i) {
+        frame->image[i] = frame->accumulated[i];
+    }
+}
+
+static uint32_t crc_table[256];
+
+static void crc_init(void) {
+    for (uint32_t n = 0; n < 256; ++n) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; ++k) {
+            c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        }
+        crc_table[n] = c;
+    }
+}
+
+static uint32_t crc_update(uint32_t crc, const uint8_t* data, size_t length) {
+    crc = ~crc;
+    for (size_t i = 0; i < length; ++i) {
+        crc = crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void put_be32(uint8_t* out, uint32_t value) {
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+}
+
+static bool write_chunk(FILE* fd, const char* type, const uint8_t* data, size_t length) {
+    uint8_t header[8];
+    put_be32(header, length);
+    memcpy(&header[4], type, 4);
+
+    uint8_t footer[4];
+    put_be32(footer, crc_update(crc_update(0, &header[4], 4), data, length));
+
+    return fwrite(header, 1, 8, fd) == 8 && (!length || fwrite(data, 1, length, fd) == length) && fwrite(footer, 1, 4, fd) == 4;
+}
+
+// rgb, uncompressed: zlib's stored blocks need nothing but an adler32, and frames are for checking rather than keeping
+static bool write_png(const char* filename, const uint8_t* rgb, int width, int height) {
+    size_t row_length = 1 + width * 3;
+    size_t raw_length = row_length * height;
+    size_t block_count = (raw_length + 65534) / 65535;
+    size_t data_length = 2 + raw_length + block_count * 5 + 4;
+    uint8_t* data = malloc(data_length);
+
+    uint8_t* out = data;
+    *out++ = 0x78;
+    *out++ = 0x01;
+
+    uint32_t adler_a = 1, adler_b = 0;
+    size_t remaining = raw_length;
+    size_t row_offset = 0;
+    int row = 0;
+    while (remaining > 0) {
+        uint16_t length = min(remaining, (size_t)65535);
+        remaining -= length;
+        *out++ = (remaining == 0);
+        *out++ = length & 0xff;
+        *out++ = length >> 8;
+        *out++ = ~length & 0xff;
+        *out++ = (~length >> 8) & 0xff;
+
+        for (uint16_t i = 0; i < length; ++i) {
+            // each row starts with a filter byte of none
+            uint8_t byte = row_offset ? rgb[row * width * 3 + row_offset - 1] : 0;
+            if (++row_offset == row_length) {
+                row_offset = 0;
+                ++row;
+            }
+            *out++ = byte;
+            adler_a = (adler_a + byte) % 65521;
+            adler_b = (adler_b + adler_a) % 65521;
+        }
+    }
+    put_be32(out, (adler_b << 16) | adler_a);
+
+    uint8_t header[13];
+    put_be32(&header[0], width);
+    put_be32(&header[4], height);
+    header[8] = 8;      // bits per channel
+    header[9] = 2;      // rgb
+    header[10] = header[11] = header[12] = 0;
+
+    bool written = false;
+    FILE* fd = fopen(filename, "wb");
+    if (fd) {
+        written = fwrite("\x89PNG\r\n\x1a\n", 1, 8, fd) == 8
+               && write_chunk(fd, "IHDR", header, sizeof(header))
+               && write_chunk(fd, "IDAT", data, data_length)
+               && write_chunk(fd, "IEND", NULL, 0);
+        written = (fclose(fd) == 0) && written;
+    }
+
+    free(data);
+    return written;
+}
+
+int main(int argc, char** argv) {
+    sim_parse_args(argc, argv, "n:i:p:m:t:v:",
+                   " -n X     frame count\n"
+                   " -i X     milliseconds between frames\n"
+                   " -p X     image file pattern, taking the frame number, empty for none\n"
+                   " -m X     metrics file, stdout if not given\n"
+                   " -t X     thread count\n"
+                   " -v X X   image resolution (width, height)\n",
+                   parse_option);
+
+    if (!sim_map_volume()) {
+        return 1;
+    }
+    voxel_buffer->bits_per_channel = sim_bpc;
+
+    volume_vertex_t* vertices;
+    size_t vertex_count = sim_create_mesh(&vertices);
+
+    float view[MAT4_SIZE], proj[MAT4_SIZE], matrix[MAT4_SIZE];
+    sim_get_matrices(view, proj, (float)viewport_width / (float)viewport_height);
+    mat4_multiply(matrix, proj, view);
+
+    frame_t frame = {
+        .width = viewport_width,
+        .height = viewport_height,
+        .dotlock = sim_geometry.scan_geometry == SCAN_RADIAL && !sim_emulation.enabled,
+        .triangles = malloc(vertex_count / 3 * sizeof(screen_triangle_t))
+    };
+    frame.triangle_count = setup_triangles(frame.triangles, vertices, vertex_count, matrix, frame.width, frame.height);
+    frame.accumulated = malloc(frame.width * frame.height * 3 * sizeof(uint16_t));
+    frame.image = malloc(frame.width * frame.height * 3);
+    free(vertices);
+
+    pixel_t* volume = malloc(VOXELS_COUNT * sizeof(pixel_t));
+    frame.volume = volume;
+
+    emulated_slice_t* panels = NULL;
+    if (sim_emulation.enabled) {
+        panels = malloc(SLICE_COUNT * sizeof(emulated_slice_t));
+        frame.panels = &panels[0][0][0][0];
+    }
+
+    if (!thread_count) {
+        thread_count = max((int)sysconf(_SC_NPROCESSORS_ONLN), 1);
+    }
+    workers_t* workers = workers_create(thread_count);
+    int band_count = (frame.height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+
+    FILE* metrics = metrics_name ? fopen(metrics_name, "w") : stdout;
+    if (!metrics) {
+        perror("metrics");
+        return 1;
+    }
+    fprintf(metrics, "frame,emulate_us,render_us,lit_pixels,mean_level,crc\n");
+
+    crc_init();
+
+    for (int f = 0; f < frame_count; ++f) {
+        if (f > 0 && frame_interval_ms > 0) {
+            usleep(frame_interval_ms * 1000);
+        }
+
+        frame.bpcmask = sim_bpc_mask();
+        frame.bpcscale[0] = sim_brightness / (float)(frame.bpcmask & 0xe0);
+        frame.bpcscale[1] = sim_brightness / (float)(frame.bpcmask & 0x1c);
+        frame.bpcscale[2] = sim_brightness / (float)(frame.bpcmask & 0x03);
+
+        timespec_t start = timer_time_now();
+        uint32_t emulate_us = 0;
+        if (panels) {
+            // the driver reads the page and its polar layer as they are, and resolves nothing
+            int page = voxel_buffer->page;
+            int bpc = voxel_buffer->bits_per_channel;
+            memcpy(volume, voxel_buffer->volume[page], VOXELS_COUNT * sizeof(pixel_t));
+            emulate_revolution(panels, volume, &voxel_buffer->polar[page], bpc);
+
+            emulate_palette(frame.palette, bpc);
+            for (int i = 0; i < 256; ++i) {
+                for (int c = 0; c < 3; ++c) {
+                    frame.palette[i][c] *= sim_brightness;
+                }
+            }
+
+            timespec_t emulated = timer_time_now();
+            emulate_us = (emulated.tv_sec - start.tv_sec) * 1000000 + (emulated.tv_nsec - start.tv_nsec) / 1000;
+            start = emulated;
+        } else {
+            // copied first, so a client swapping mid-frame can't tear it
+            memcpy(volume, sim_get_volume(), VOXELS_COUNT * sizeof(pixel_t));
+        }
+
+        workers_run(workers, draw_band, &frame, band_count);
+        timespec_t end = timer_time_now();
+        uint32_t render_us = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+
+        size_t pixel_count = (size_t)frame.width * frame.height;
+        uint32_t lit = 0;
+        uint64_t level = 0;
+        for (size_t i = 0; i < pixel_count; ++i) {
+            const uint8_t* p = &frame.image[i * 3];
+            lit += (p[0] | p[1] | p[2]) != 0;
+            level += p[0] + p[1] + p[2];
+        }
+        uint32_t crc = crc_update(0, frame.image, pixel_count * 3);
+
+        fprintf(metrics, "%d,%u,%u,%u,%.3f,%08x\n", f, emulate_us, render_us, lit, (double)level / (pixel_count * 3), crc);
+        fflush(metrics);
+
+        if (frame_pattern && *frame_pattern) {
+            char filename[4096];
+            int length = snprintf(filename, sizeof(filename), frame_pattern, f);
+            if (length < 0 || length >= sizeof(filename) || !write_png(filename, frame.image, frame.width, frame.height)) {
+                fprintf(stderr, "couldn't write %s\n", filename);
+            }
+        }
+    }
+
+    if (metrics != stdout) {
+        fclose(metrics);
+    }
+
+    workers_destroy(workers);
+    free(panels);
+    free(volume);
+    free(frame.image);
+    free(frame.accumulated);
+    free(frame.triangles);
+
+    sim_unmap_volume();
+
+    return 0;
+}
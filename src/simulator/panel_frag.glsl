@@ -0,0 +1,34 @@
+#version 310 es
+
+precision mediump int;
+precision mediump float;
+precision mediump isampler3D;
+
+// the driver's emulated output: each layer is a panel at a slice, and the palette weighs each pixel's bit planes
+uniform isampler3D u_panels;
+uniform sampler2D u_palette;
+uniform highp float u_brightness;     // shared with the vertex shader, so its precision has to match
+
+in vec3 v_texcoord;
+in vec2 v_dotcoord;
+
+out vec4 ql_FragColor;
+
+float dot2(vec2 v) {return dot(v, v);}
+
+void main() {
+    float rsq = dot2(fract(v_dotcoord)-vec2(0.5, 0.5));
+    float lum = max(0.0, 0.5 - rsq * 2.0);
+
+#ifndef LOW_QUALITY
+    float dm = v_dotcoord.x + v_dotcoord.y;
+    float dd = min(1.0, 0.125 / dot2(vec2(dFdx(dm), dFdy(dm))));
+    lum = mix(0.125, lum, dd);
+#endif
+
+    int pix = texture(u_panels, v_texcoord).r & 0xff;
+    vec3 colour = texelFetch(u_palette, ivec2(pix, 0), 0).rgb * u_brightness;
+
+    ql_FragColor.rgb = colour * lum;
+    ql_FragColor.a = 1.0;
+}
@@ -1,14 +1,10 @@
 #include "sim.h"
 
-#include <stddef.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/mman.h>
-#include <sys/stat.h>
-#include <sys/file.h>
+#include <string.h>
 #include <unistd.h>
-#include <fcntl.h>
 
 #include <EGL/egl.h>
 #include <GLES3/gl3.h>
@@ -17,14 +13,40 @@
 #include "mathc.h"
 #include "voxel.h"
 #include "rammel.h"
-#include "slicemap.h"
+#include "timer.h"
 
+#include "slice_vert_glsl.h"
 #include "volume_vert_glsl.h"
 #include "volume_frag_glsl.h"
+#include "panel_frag_glsl.h"
+#include "emulate.h"
 
 _Static_assert(sizeof(pixel_t)==1, "simulator only supports RGB332");
 _Static_assert(VOXEL_Z_STRIDE==1, "simulator assumes z stride is 1");
+_Static_assert(VOXEL_Y_STRIDE==VOXELS_Z*VOXELS_X, "simulator assumes y slabs are contiguous");
+_Static_assert((VOXELS_Z*VOXELS_X) % (4*sizeof(uint64_t)) == 0, "slabs are hashed in four lanes of words");
+
+// the volume goes up a y slab at a time, and only the slabs that changed since the last upload
+#define SLAB_SIZE (VOXELS_Z * VOXELS_X)
+
+// clients flipping twice between draws, or drawing into the front page, don't look like a flip. so the
+// slabs are checked again after this many draws without one: such a client is shown at most this many draws
+// late, about half a second at 60Hz, and a check costs hashing the whole volume. build with it lower for
+// clients like that, or higher to spend less on volumes that mostly sit still
+#ifndef UPLOAD_RECHECK_DRAWS
+#define UPLOAD_RECHECK_DRAWS 30
+#endif
 
+// with more slabs than this changed the volume goes up straight from client memory rather than through an unpack
+// buffer. VOXELS_Y always uses the buffers. neither path has been timed on the pi, so this is a guess to revisit
+#ifndef UPLOAD_DIRECT_SLABS
+#define UPLOAD_DIRECT_SLABS (VOXELS_Y / 2)
+#endif
+
+// the adaptive slice count is reconsidered after this many draws, and left alone within this fraction of the target
+#define ADAPT_DRAWS 16
+#define ADAPT_TOLERANCE 0.1f
+#define ADAPT_MIN_SLICES 16
 
 
 typedef struct {
@@ -33,23 +55,41 @@ typedef struct {
     GLuint vbo;
     size_t vertex_count;
 
+    // outside emulation, the vbo holds a slice_instance_t per slice and the quads are made up in slice_vert
+    size_t slice_count;
+
     GLuint program;
     GLuint u_view;
     GLuint u_proj;
     GLuint u_bpcmask;
     GLuint u_brightness;
+
+    // when emulating the driver, the texture holds its panels rather than the volume
+    GLuint palette;
+    emulated_slice_t* panels;
 } draw_state_t;
 
 typedef struct {
-    GLfloat position[3];
-    GLfloat texcoord[3];
-    GLfloat dotcoord[2];
-} volume_vertex_t;
+    GLuint buffers[2];          // pixel unpack buffers, alternated so filling one never waits on the other's upload
+    int next;
+    int page;
+    int bpc;
+    bool valid;
+    int draws_since_check;
+    uint64_t hashes[VOXELS_Y];
+    sim_upload_stats_t stats;
+} upload_state_t;
+
+// with a target frame time, the slice count is scaled to suit how long frames actually take
+typedef struct {
+    int target_ms;
+    int draws;
+    timespec_t timer;
+} adapt_state_t;
 
 static draw_state_t volume;
-
-static int volume_fd;
-voxel_double_buffer_t* voxel_buffer;
+static upload_state_t upload;
+static adapt_state_t adapt;
 
 static int viewport_width = 800;
 static int viewport_height = 600;
@@ -57,181 +97,6 @@ static int viewport_height = 600;
 static float mat_view[MAT4_SIZE];
 static float mat_proj[MAT4_SIZE];
 
-static vec3_t view_position = {.x=0, .y=0, .z=-3};
-static vec3_t model_rotation = {.x=-M_PI_2, .y=0, .z=0};
-
-static float sim_brightness = 1.0f;
-
-
-typedef enum {
-    SCAN_RADIAL,
-    SCAN_LINEAR
-} scan_geometry_t;
-
-typedef struct {
-    int screen_width;
-    int screen_height;
-    float screen_offset[2];
-    size_t screen_count;
-    size_t slice_count;
-    scan_geometry_t scan_geometry;
-} sim_geometry_t;
-
-static sim_geometry_t sim_geometry = {
-
-#ifdef PANEL_0_ECCENTRICITY
-    #ifdef PANEL_1_ECCENTRICITY
-        .screen_offset = {(float)(PANEL_0_ECCENTRICITY)/(float)(PANEL_WIDTH/2), (float)(PANEL_1_ECCENTRICITY)/(float)(PANEL_WIDTH/2)},
-        .screen_count = ((PANEL_0_ECCENTRICITY) == (PANEL_1_ECCENTRICITY) ? 1 : 2),
-    #else
-        .screen_offset = {(float)(PANEL_0_ECCENTRICITY)/(float)(PANEL_WIDTH/2)},
-        .screen_count = 1,
-    #endif
-#else
-        .screen_offset = {0},
-        .screen_count = 1,
-#endif
-
-#ifdef VERTICAL_SCAN
-    .screen_width = PANEL_HEIGHT * 2,
-    .screen_height = PANEL_WIDTH,
-#else
-    .screen_width = PANEL_WIDTH,
-    .screen_height = PANEL_HEIGHT,
-#endif
-
-    .slice_count = 360,
-    .scan_geometry = SCAN_RADIAL
-};
-
-int sim_bpc = 2;
-
-static void parse_args(int argc, char** argv) {
-    bool help = false;
-    bool sset = false;
-    bool wset = false;
-
-    for (int opt = 0; opt != -1; opt = getopt(argc, argv, "o:s:w:g:b:")) {
-        switch(opt) {
-            case 'o': {
-                sim_geometry.screen_offset[0] = sim_geometry.screen_offset[1] = atof(optarg);
-                if (optind < argc) {
-                    sim_geometry.screen_offset[1] = atof(argv[optind]);
-                    if (sim_geometry.screen_offset[1] != 0) {
-                        ++optind;
-                    }
-                }
-                sim_geometry.screen_count = 1 + (sim_geometry.screen_offset[0] != sim_geometry.screen_offset[1]);
-            } break;
-
-            case 's': {
-                sim_geometry.slice_count = clampi(atoi(optarg), 1, 4096);
-                sset = true;
-            } break;
-
-            case 'w': {
-                if (optind < argc) {
-                    int w = atoi(optarg);
-                    int h = atoi(argv[optind++]);
-                    if (w > 0 && h > 0) {
-                        wset = true;
-                        sim_geometry.screen_width = w;
-                        sim_geometry.screen_height = h;
-                    }
-                }
-            } break;
-
-            case 'g': {
-                switch (*optarg) {
-                    case 'l': sim_geometry.scan_geometry = SCAN_LINEAR; break;
-                    case 'r': sim_geometry.scan_geometry = SCAN_RADIAL; break;
-                }
-            } break;
-
-            case 'b': {
-                sim_bpc = clampi(atoi(optarg), 1, 3);
-            } break;
-
-            case '?': {
-                help = true;
-            } break;
-        }
-    }
-
-    if (help) {
-        printf("%s - multivox volumetric display simulator.\n"
-               " -b X     bit depth\n"
-               " -s X     slice count\n"
-               " -w X X   panel resolution (width, height)\n"
-               " -o X X   panel offset (front, back)\n"
-               " -g X     geometry (radial, linear)\n\n",
-        argv[0]);
-    }
-
-    if (sim_geometry.scan_geometry == SCAN_LINEAR) {
-        if (!sset) {
-            sim_geometry.slice_count = VOXELS_Z;
-        }
-        if (!wset) {
-            sim_geometry.screen_width = VOXELS_X;
-            sim_geometry.screen_height = VOXELS_Y;
-        }
-    }
-
-    if (sim_geometry.screen_count > 1
-     && sim_geometry.scan_geometry == SCAN_RADIAL
-     && sim_geometry.screen_offset[0] != sim_geometry.screen_offset[1]
-     && sim_geometry.screen_offset[0] >= 0
-     && sim_geometry.screen_offset[1] >= 0) {
-        sim_geometry.screen_count = 2;
-    } else {
-        sim_geometry.screen_count = 1;
-    }
-
-    printf("      slice count: %ld\n panel resolution: %dx%d\n", sim_geometry.slice_count, sim_geometry.screen_width, sim_geometry.screen_height);
-    if (sim_geometry.screen_count > 1) {
-        printf("   screen offsets: %g %g\n", sim_geometry.screen_offset[0], sim_geometry.screen_offset[1]);
-    } else {
-        printf("    screen offset: %g\n", sim_geometry.screen_offset[0]);
-    }
-    switch (sim_geometry.scan_geometry) {
-        case SCAN_RADIAL: printf("         geometry: radial\n"); break;
-        case SCAN_LINEAR: printf("         geometry: linear\n"); break;
-    }
-    printf("     colour depth: %d bpc\n", sim_bpc);
-}
-
-
-
-
-static void* map_volume() {
-    mode_t old_umask = umask(0);
-    volume_fd = shm_open("/vortex_double_buffer", O_CREAT | O_RDWR, 0666);
-    umask(old_umask);
-    if (volume_fd == -1) {
-        perror("shm_open");
-        return NULL;
-    }
-
-    if (ftruncate(volume_fd, sizeof(voxel_double_buffer_t)) == -1) {
-        perror("ftruncate");
-        return NULL;
-    }
-
-    voxel_buffer = mmap(NULL, sizeof(voxel_double_buffer_t), PROT_READ | PROT_WRITE, MAP_SHARED, volume_fd, 0);
-    if (voxel_buffer == MAP_FAILED) {
-        perror("mmap");
-        return NULL;
-    }
-
-    return voxel_buffer;
-}
-
-static void unmap_volume() {
-    munmap(voxel_buffer, sizeof(voxel_double_buffer_t));
-    close(volume_fd);
-}
-
 
 GLuint compile_shader(GLenum type, const char* source) {
     GLuint shader = glCreateShader(type);
@@ -307,94 +172,172 @@ static void init_texture(void) {
     //glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     //glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
-    glTexImage3D(GL_TEXTURE_3D, 0, GL_R8UI, VOXELS_Z, VOXELS_X, VOXELS_Y, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, voxel_buffer->volume[voxel_buffer->page]);
+    // filled by the first draw
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_R8UI, VOXELS_Z, VOXELS_X, VOXELS_Y, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, NULL);
+
+    glGenBuffers(count_of(upload.buffers), upload.buffers);
+    for (int i = 0; i < count_of(upload.buffers); ++i) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.buffers[i]);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, VOXELS_COUNT, NULL, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    upload.valid = false;
 }
 
-static size_t create_mesh_radial() {
-    // create a mesh containing quads for every slice the screens rotate through
-
-    volume_vertex_t vertices[sim_geometry.slice_count][sim_geometry.screen_count][12];
-
-    int scatter[sim_geometry.slice_count];
-    slicemap_ebr(scatter, count_of(scatter));
-
-    const float z = (float)VOXELS_Z / (float)VOXELS_X;
-    const float radius = (float)sim_geometry.screen_width * 0.5f;
-
-    for (int s = 0; s < sim_geometry.slice_count; ++s) {
-        float angle = (float)s * M_PI * 2.0f / (float)sim_geometry.slice_count;
-        vec2_t slope = {.x = cosf(angle), .y = sinf(angle)};
-        
-        // throttle the inner columns
-        float hole = (float)scatter[s] / (float)sim_geometry.slice_count;
-        hole = floorf(hole * radius) / radius;
-
-        for (int p = 0; p < sim_geometry.screen_count; ++p) {
-            float side = (p ? -1 : 1);
-            vec2_t offset = {.x = slope.y * sim_geometry.screen_offset[p] * side, .y = -slope.x * sim_geometry.screen_offset[p] * side};
-
-            vec2_t inner, outer;
-            vec2_multiply_f(outer.v, slope.v, side);
-            vec2_multiply_f(inner.v, outer.v, hole);
-
-            vec2_t ends[4];
-            vec2_subtract(ends[0].v, offset.v, outer.v);
-            vec2_subtract(ends[1].v, offset.v, inner.v);
-            vec2_add(ends[2].v, offset.v, inner.v);
-            vec2_add(ends[3].v, offset.v, outer.v);
-
-            // clip to the voxel volume
-            float rim[2] = {1.0f, 1.0f};
-            for (int i = 0; i < 2; ++i) {
-                float box = max(fabsf(ends[3*i].x), fabsf(ends[3*i].y));
-                if (box > 1.0f) {
-                    rim[i] = floorf((1.0f / box) * radius) / radius;
-                    hole = min(hole, rim[i]);
-                    vec2_multiply_f(ends[3*i].v, ends[3*i].v, rim[i]);
-                }
-            }
+static void init_panels(void) {
+    glGenTextures(1, &volume.texture);
+    glBindTexture(GL_TEXTURE_3D, volume.texture);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_R8UI, PANEL_WIDTH, PANEL_HEIGHT, EMULATED_LAYERS, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, NULL);
+
+    glActiveTexture(GL_TEXTURE1);
+    glGenTextures(1, &volume.palette);
+    glBindTexture(GL_TEXTURE_2D, volume.palette);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 256, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glActiveTexture(GL_TEXTURE0);
+
+    volume.panels = malloc(SLICE_COUNT * sizeof(emulated_slice_t));
+    upload.valid = false;
+}
 
-            vertices[s][p][0] = (volume_vertex_t){.position={ends[0].x, ends[0].y, -z}, .texcoord={0, (1+ends[0].x)*0.5f, (1+ends[0].y)*0.5f}, .dotcoord={radius*rim[0], 0.0f}};
-            vertices[s][p][1] = (volume_vertex_t){.position={ends[1].x, ends[1].y, -z}, .texcoord={0, (1+ends[1].x)*0.5f, (1+ends[1].y)*0.5f}, .dotcoord={radius * hole, 0.0f}};
-            vertices[s][p][2] = (volume_vertex_t){.position={ends[0].x, ends[0].y,  z}, .texcoord={1, (1+ends[0].x)*0.5f, (1+ends[0].y)*0.5f}, .dotcoord={radius*rim[0], (float)sim_geometry.screen_height}};
-            vertices[s][p][3] = (volume_vertex_t){.position={ends[1].x, ends[1].y,  z}, .texcoord={1, (1+ends[1].x)*0.5f, (1+ends[1].y)*0.5f}, .dotcoord={radius * hole, (float)sim_geometry.screen_height}};
-            vertices[s][p][4] = vertices[s][p][2];
-            vertices[s][p][5] = vertices[s][p][1];
+// whether the page has flipped since the last upload, or it's time to look anyway
+static bool upload_due(void) {
+    bool flipped = voxel_buffer->page != upload.page || voxel_buffer->bits_per_channel != upload.bpc;
+    if (upload.valid && !flipped && ++upload.draws_since_check < UPLOAD_RECHECK_DRAWS) {
+        return false;
+    }
+    upload.page = voxel_buffer->page;
+    upload.bpc = voxel_buffer->bits_per_channel;
+    upload.draws_since_check = 0;
+    upload.stats.checks += 1;
+    return true;
+}
+
+// a whole revolution goes up at once, as the trails and timing can change any slice
+static void upload_panels(void) {
+    if (!upload_due()) {
+        return;
+    }
+
+    int page = upload.page;
+    emulate_revolution(volume.panels, voxel_buffer->volume[page], &voxel_buffer->polar[page], upload.bpc);
+    glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, PANEL_WIDTH, PANEL_HEIGHT, EMULATED_LAYERS, GL_RED_INTEGER, GL_UNSIGNED_BYTE, volume.panels);
+    upload.stats.bytes += SLICE_COUNT * sizeof(emulated_slice_t);
+    upload.stats.slabs += SLICE_COUNT;
+
+    float palette[256][3];
+    uint8_t rgba[256][4];
+    emulate_palette(palette, upload.bpc);
+    for (int i = 0; i < 256; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            rgba[i][c] = (uint8_t)lroundf(clampf(palette[i][c], 0.0f, 1.0f) * 255.0f);
+        }
+        rgba[i][3] = 255;
+    }
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, volume.palette);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 256, 1, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+    glActiveTexture(GL_TEXTURE0);
 
-            vertices[s][p][6] = (volume_vertex_t){.position={ends[2].x, ends[2].y, -z}, .texcoord={0, (1+ends[2].x)*0.5f, (1+ends[2].y)*0.5f}, .dotcoord={radius * hole, 0.0f}};
-            vertices[s][p][7] = (volume_vertex_t){.position={ends[3].x, ends[3].y, -z}, .texcoord={0, (1+ends[3].x)*0.5f, (1+ends[3].y)*0.5f}, .dotcoord={radius*rim[1], 0.0f}};
-            vertices[s][p][8] = (volume_vertex_t){.position={ends[2].x, ends[2].y,  z}, .texcoord={1, (1+ends[2].x)*0.5f, (1+ends[2].y)*0.5f}, .dotcoord={radius * hole, (float)sim_geometry.screen_height}};
-            vertices[s][p][9] = (volume_vertex_t){.position={ends[3].x, ends[3].y,  z}, .texcoord={1, (1+ends[3].x)*0.5f, (1+ends[3].y)*0.5f}, .dotcoord={radius*rim[1], (float)sim_geometry.screen_height}};
-            vertices[s][p][10] = vertices[s][p][8];
-            vertices[s][p][11] = vertices[s][p][7];
+    upload.valid = true;
+}
 
+// four lanes of FNV-1a over words, which keeps the multiplies from waiting on each other
+static uint64_t slab_hash(const pixel_t* slab) {
+    const uint64_t* words = (const uint64_t*)slab;
+    uint64_t lanes[4] = {0xcbf29ce484222325ull, 1, 2, 3};
+    for (size_t i = 0; i < SLAB_SIZE / sizeof(uint64_t); i += count_of(lanes)) {
+        for (int l = 0; l < count_of(lanes); ++l) {
+            lanes[l] = (lanes[l] ^ words[i + l]) * 0x100000001b3ull;
         }
     }
 
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    uint64_t hash = lanes[0];
+    for (int l = 1; l < count_of(lanes); ++l) {
+        hash = (hash ^ lanes[l] ^ (lanes[l] >> 29)) * 0x100000001b3ull;
+    }
+    return hash;
+}
 
-    return sizeof(vertices) / sizeof(volume_vertex_t);
+// a run of changed slabs is one upload, from the unpack buffer if it could be mapped and from the volume if not
+static void upload_slabs(const pixel_t* source, int first, int count) {
+    glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, first, VOXELS_Z, VOXELS_X, count, GL_RED_INTEGER, GL_UNSIGNED_BYTE, source);
+    upload.stats.bytes += (uint64_t)count * SLAB_SIZE;
+    upload.stats.slabs += count;
 }
 
-static size_t create_mesh_linear() {
-    volume_vertex_t vertices[sim_geometry.slice_count][6];
+static void upload_volume(void) {
+    if (!upload_due()) {
+        return;
+    }
 
-    const float zaspect = ((float)VOXELS_Z / (float)VOXELS_X);
+    const pixel_t* content = sim_get_volume();
 
-    for (int s = 0; s < sim_geometry.slice_count; ++s) {
-        float z = ((((float)s + 0.5f) / (float)(sim_geometry.slice_count)) * 2.0f - 1.0f);
+    bool dirty[VOXELS_Y];
+    int first = VOXELS_Y, last = -1, dirty_count = 0;
+    for (int y = 0; y < VOXELS_Y; ++y) {
+        uint64_t hash = slab_hash(&content[VOXEL_INDEX(0,y,0)]);
+        dirty[y] = !upload.valid || hash != upload.hashes[y];
+        upload.hashes[y] = hash;
+        if (dirty[y]) {
+            first = min(first, y);
+            last = y;
+            ++dirty_count;
+        }
+    }
+    upload.valid = true;
 
-        vertices[s][0] = (volume_vertex_t){.position={ -1, -1, z * zaspect}, .texcoord={(1+z)*0.5, 0, 0}, .dotcoord={-(float)sim_geometry.screen_width*0.5f,-(float)sim_geometry.screen_height*0.5f}};
-        vertices[s][1] = (volume_vertex_t){.position={  1, -1, z * zaspect}, .texcoord={(1+z)*0.5, 1, 0}, .dotcoord={ (float)sim_geometry.screen_width*0.5f,-(float)sim_geometry.screen_height*0.5f}};
-        vertices[s][2] = (volume_vertex_t){.position={ -1,  1, z * zaspect}, .texcoord={(1+z)*0.5, 0, 1}, .dotcoord={-(float)sim_geometry.screen_width*0.5f, (float)sim_geometry.screen_height*0.5f}};
-        vertices[s][3] = (volume_vertex_t){.position={  1,  1, z * zaspect}, .texcoord={(1+z)*0.5, 1, 1}, .dotcoord={ (float)sim_geometry.screen_width*0.5f, (float)sim_geometry.screen_height*0.5f}};
-        vertices[s][4] = vertices[s][2];
-        vertices[s][5] = vertices[s][1];
+    if (last < first) {
+        return;
     }
 
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    // with most of the volume changed, as it is for anything animated, staging is a second copy of nearly all of
+    // it, so the range goes up in one call straight from the volume
+    if (dirty_count > UPLOAD_DIRECT_SLABS) {
+        upload_slabs(&content[VOXEL_INDEX(0,first,0)], first, last - first + 1);
+        return;
+    }
 
-    return sizeof(vertices) / sizeof(volume_vertex_t);
+    // the changed slabs are copied into whichever unpack buffer is free, and the texture filled from there. this
+    // is meant to keep the driver from stalling on a texture still in use, but has only been timed on llvmpipe
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.buffers[upload.next]);
+    upload.next = (upload.next + 1) % count_of(upload.buffers);
+
+    size_t offset = (size_t)first * SLAB_SIZE;
+    uint8_t* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, (size_t)(last - first + 1) * SLAB_SIZE, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    if (mapped) {
+        for (int y = first; y <= last; ++y) {
+            if (dirty[y]) {
+                memcpy(&mapped[(size_t)(y - first) * SLAB_SIZE], &content[VOXEL_INDEX(0,y,0)], SLAB_SIZE);
+            }
+        }
+        if (!glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER)) {
+            mapped = NULL;
+        }
+    }
+    if (!mapped) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    for (int y = first; y <= last; ) {
+        if (!dirty[y]) {
+            ++y;
+            continue;
+        }
+        int run = 1;
+        while (y + run <= last && dirty[y + run]) {
+            ++run;
+        }
+        const pixel_t* source = mapped ? (const pixel_t*)(uintptr_t)((size_t)y * SLAB_SIZE) : &content[VOXEL_INDEX(0,y,0)];
+        upload_slabs(source, y, run);
+        y += run;
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 }
 
 static void init_mesh(void) {
@@ -405,11 +348,10 @@ static void init_mesh(void) {
 
     glBindBuffer(GL_ARRAY_BUFFER, volume.vbo);
 
-    if (sim_geometry.scan_geometry == SCAN_LINEAR) {
-        volume.vertex_count = create_mesh_linear();
-    } else {
-        volume.vertex_count = create_mesh_radial();
-    }
+    volume_vertex_t* vertices;
+    volume.vertex_count = sim_create_mesh(&vertices);
+    glBufferData(GL_ARRAY_BUFFER, volume.vertex_count * sizeof(volume_vertex_t), vertices, GL_STATIC_DRAW);
+    free(vertices);
 
     GLint a_position = glGetAttribLocation(volume.program, "a_position");
     glVertexAttribPointer(a_position, 3, GL_FLOAT, GL_FALSE, sizeof(volume_vertex_t), (void*)offsetof(volume_vertex_t, position));
@@ -424,16 +366,81 @@ static void init_mesh(void) {
     glEnableVertexAttribArray(a_dotcoord);
 }
 
+static void set_slice_count(size_t slice_count) {
+    slice_instance_t* slices = malloc(slice_count * sizeof(slice_instance_t));
+    sim_create_slices(slices, slice_count);
+    glBindBuffer(GL_ARRAY_BUFFER, volume.vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, slice_count * sizeof(slice_instance_t), slices);
+    free(slices);
+
+    volume.slice_count = slice_count;
+    volume.vertex_count = (sim_geometry.scan_geometry == SCAN_LINEAR) ? 6 : sim_geometry.screen_count * 12;
+}
+
+static void init_slices(void) {
+    glGenVertexArrays(1, &volume.vao);
+    glGenBuffers(1, &volume.vbo);
+
+    glBindVertexArray(volume.vao);
+
+    // room for as many slices as were asked for, which is as far as the adaptive count goes
+    glBindBuffer(GL_ARRAY_BUFFER, volume.vbo);
+    glBufferData(GL_ARRAY_BUFFER, sim_geometry.slice_count * sizeof(slice_instance_t), NULL, GL_DYNAMIC_DRAW);
+    set_slice_count(sim_geometry.slice_count);
+
+    GLint a_slice = glGetAttribLocation(volume.program, "a_slice");
+    glVertexAttribPointer(a_slice, 2, GL_FLOAT, GL_FALSE, sizeof(slice_instance_t), (void*)0);
+    glVertexAttribDivisor(a_slice, 1);
+    glEnableVertexAttribArray(a_slice);
+
+    glUniform1i(glGetUniformLocation(volume.program, "u_linear"), sim_geometry.scan_geometry == SCAN_LINEAR);
+    glUniform2f(glGetUniformLocation(volume.program, "u_screen"), (float)sim_geometry.screen_width, (float)sim_geometry.screen_height);
+    glUniform2f(glGetUniformLocation(volume.program, "u_offset"), sim_geometry.screen_offset[0], sim_geometry.screen_offset[1]);
+    glUniform1f(glGetUniformLocation(volume.program, "u_zaspect"), (float)VOXELS_Z / (float)VOXELS_X);
+}
+
+// fill rate goes roughly with the slice count, so scale it by how far off the target frames are. only halfway
+// each time though, as vsync and uploads blur the measurement
+static void adapt_slice_count(void) {
+    if (++adapt.draws < ADAPT_DRAWS) {
+        return;
+    }
+    float frame_ms = (float)max(timer_elapsed_ms(&adapt.timer), 1) / (float)adapt.draws;
+    adapt.draws = 0;
+
+    float ratio = (float)adapt.target_ms / frame_ms;
+    if (fabsf(ratio - 1.0f) < ADAPT_TOLERANCE) {
+        return;
+    }
+
+    size_t slice_count = (size_t)((float)volume.slice_count * (1.0f + (ratio - 1.0f) * 0.5f));
+    slice_count = clampi(slice_count, min(ADAPT_MIN_SLICES, (int)sim_geometry.slice_count), sim_geometry.slice_count);
+    if (slice_count != volume.slice_count) {
+        set_slice_count(slice_count);
+    }
+}
+
+static void parse_option(int opt, int argc, char** argv) {
+    switch (opt) {
+        case 'a': adapt.target_ms = max(atoi(optarg), 0); break;
+    }
+}
 
 bool sim_init(int argc, char** argv) {
-    parse_args(argc, argv);
+    sim_parse_args(argc, argv, "a:",
+                   " -a X     adapt the slice count to hold this many ms per frame, up to the -s count\n",
+                   parse_option);
 
-    if (!map_volume()) {
+    if (!sim_map_volume()) {
         return false;
     }
     voxel_buffer->bits_per_channel = sim_bpc;
 
-    volume.program = create_program(volume_vert, volume_frag);
+    if (sim_emulation.enabled) {
+        volume.program = create_program(volume_vert, panel_frag);
+    } else {
+        volume.program = create_program(slice_vert, volume_frag);
+    }
     if (!volume.program) {
         return false;
     }
@@ -442,12 +449,27 @@ bool sim_init(int argc, char** argv) {
     volume.u_bpcmask = glGetUniformLocation(volume.program, "u_bpcmask");
     volume.u_brightness = glGetUniformLocation(volume.program, "u_brightness");
 
-    GLuint u_dotlock = glGetUniformLocation(volume.program, "u_dotlock");
     glUseProgram(volume.program);
-    glUniform1i(u_dotlock, sim_geometry.scan_geometry == SCAN_RADIAL);
+    if (sim_emulation.enabled) {
+        glUniform1i(glGetUniformLocation(volume.program, "u_panels"), 0);
+        glUniform1i(glGetUniformLocation(volume.program, "u_palette"), 1);
+        init_panels();
+        init_mesh();
+    } else {
+        glUniform1i(glGetUniformLocation(volume.program, "u_dotlock"), sim_geometry.scan_geometry == SCAN_RADIAL);
+        init_texture();
+        init_slices();
+    }
 
-    init_texture();
-    init_mesh();
+    if (adapt.target_ms) {
+        if (sim_emulation.enabled) {
+            printf("the slice count can't adapt when emulating the driver\n");
+            adapt.target_ms = 0;
+        } else {
+            printf("       frame time: %d ms, adapting the slice count\n", adapt.target_ms);
+            adapt.timer = timer_time_now();
+        }
+    }
 
     glCullFace(GL_BACK);
     glEnable(GL_CULL_FACE);
@@ -466,8 +488,12 @@ bool sim_init(int argc, char** argv) {
     return true;
 }
 
+sim_upload_stats_t sim_get_upload_stats(void) {
+    return upload.stats;
+}
+
 void sim_close(void) {
-    unmap_volume();
+    sim_unmap_volume();
 }
 
 void sim_resize(int w, int h) {
@@ -476,44 +502,14 @@ void sim_resize(int w, int h) {
     glViewport(0, 0, viewport_width, viewport_height);
 }
 
-void sim_drag(int button, float dx, float dy) {
-    switch (button) {
-        case 1:
-            model_rotation.x = clampf(model_rotation.x + dy * 3, -M_PI*0.95f, -M_PI*0.05f);
-            model_rotation.z = fmodf(model_rotation.z + dx * 3, M_PI * 2);
-            break;
-
-        case 2:
-            view_position.x = clampf(view_position.x + dx, -1.0f, 1.0f);
-            view_position.y = clampf(view_position.y - dy, -1.0f, 1.0f);
-            break;
-        
-    }
-}
-
-void sim_zoom(float d) {
-    view_position.z = clampf(view_position.z + d, -10.0f, -0.1f);
-}
-
 void sim_draw(void) {
-    float matrix[MAT4_SIZE];
-    
-    mat4_identity(matrix);
-    mat4_rotation_z(matrix, model_rotation.z);
-
-    mat4_identity(mat_view);
-    mat4_rotation_x(mat_view, model_rotation.x);
-    mat4_multiply(mat_view, mat_view, matrix);
-
-    mat4_translate(mat_view, mat_view, view_position.v);
-
-    mat4_perspective(mat_proj, to_radians(35), (float)viewport_width / (float)viewport_height, 0.1f, 100.0f);
+    sim_get_matrices(mat_view, mat_proj, (float)viewport_width / (float)viewport_height);
 
     glBindTexture(GL_TEXTURE_3D, volume.texture);
-
-    for (int y = 0; y < VOXELS_Y; ++y) {
-        // splitting up the texture upload causes less flicker with simultaneous page flips
-        glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, y, VOXELS_Z, VOXELS_X, 1, GL_RED_INTEGER, GL_UNSIGNED_BYTE, &voxel_buffer->volume[voxel_buffer->page][VOXEL_INDEX(0,y,0)]);
+    if (sim_emulation.enabled) {
+        upload_panels();
+    } else {
+        upload_volume();
     }
 
     glUseProgram(volume.program);
@@ -521,14 +517,23 @@ void sim_draw(void) {
     glUniformMatrix4fv(volume.u_proj, 1, GL_FALSE, (float*)&mat_proj);
     glUniformMatrix4fv(volume.u_view, 1, GL_FALSE, (float*)&mat_view);
 
-    const int bpcmask[4] = {0b11111111, 0b10010010, 0b11011011, 0b11111111};
-    glUniform1i(volume.u_bpcmask, bpcmask[voxel_buffer->bits_per_channel & 3]);
+    glUniform1i(volume.u_bpcmask, sim_bpc_mask());
 
     glUniform1f(volume.u_brightness, sim_brightness);
 
     glBindVertexArray(volume.vao);
     glBindBuffer(GL_ARRAY_BUFFER, volume.vbo);
 
-    glDrawArrays(GL_TRIANGLES, 0, volume.vertex_count);
+    if (sim_emulation.enabled) {
+        glDrawArrays(GL_TRIANGLES, 0, volume.vertex_count);
+    } else {
+        glDrawArraysInstanced(GL_TRIANGLES, 0, volume.vertex_count, volume.slice_count);
+        if (adapt.target_ms) {
+            adapt_slice_count();
+        }
+    }
 }
 
+size_t sim_get_slice_count(void) {
+    return sim_emulation.enabled ? sim_geometry.slice_count : volume.slice_count;
+}
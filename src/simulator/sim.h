@@ -2,11 +2,24 @@
 #define _SIM_H_
 
 #include <stdbool.h>
+#include <stdint.h>
+
+#include "simcore.h"
 
 bool sim_init(int argc, char** argv);
 void sim_resize(int w, int h);
-void sim_drag(int button, float dx, float dy);
-void sim_zoom(float d);
 void sim_draw(void);
 
+// totals since sim_init. the volume is only checked for changes when the page flips
+typedef struct {
+    uint64_t bytes;
+    uint32_t slabs;
+    uint32_t checks;
+} sim_upload_stats_t;
+
+sim_upload_stats_t sim_get_upload_stats(void);
+
+// how many slices are being drawn, which the -a option changes as it goes
+size_t sim_get_slice_count(void);
+
 #endif
@@ -0,0 +1,422 @@
+#include "simcore.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <math.h>
+
+#include "mathc.h"
+#include "rammel.h"
+#include "slicemap.h"
+#include "polar.h"
+#include "emulate.h"
+
+static int volume_fd;
+voxel_double_buffer_t* voxel_buffer;
+
+static vec3_t view_position = {.x=0, .y=0, .z=-3};
+static vec3_t model_rotation = {.x=-M_PI_2, .y=0, .z=0};
+
+float sim_brightness = 1.0f;
+
+sim_geometry_t sim_geometry = {
+
+#ifdef PANEL_0_ECCENTRICITY
+    #ifdef PANEL_1_ECCENTRICITY
+        .screen_offset = {(float)(PANEL_0_ECCENTRICITY)/(float)(PANEL_WIDTH/2), (float)(PANEL_1_ECCENTRICITY)/(float)(PANEL_WIDTH/2)},
+        .screen_count = ((PANEL_0_ECCENTRICITY) == (PANEL_1_ECCENTRICITY) ? 1 : 2),
+    #else
+        .screen_offset = {(float)(PANEL_0_ECCENTRICITY)/(float)(PANEL_WIDTH/2)},
+        .screen_count = 1,
+    #endif
+#else
+        .screen_offset = {0},
+        .screen_count = 1,
+#endif
+
+#ifdef VERTICAL_SCAN
+    .screen_width = PANEL_HEIGHT * 2,
+    .screen_height = PANEL_WIDTH,
+#else
+    .screen_width = PANEL_WIDTH,
+    .screen_height = PANEL_HEIGHT,
+#endif
+
+    .slice_count = 360,
+    .scan_geometry = SCAN_RADIAL
+};
+
+int sim_bpc = 2;
+
+void sim_parse_args(int argc, char** argv, const char* extra_options, const char* extra_help, sim_option_cb_t extra) {
+    bool help = false;
+    bool sset = false;
+    bool wset = false;
+
+    char options[64];
+    snprintf(options, sizeof(options), "o:s:w:g:b:e:r:c:l:%s", extra_options ? extra_options : "");
+
+    for (int opt = 0; opt != -1; opt = getopt(argc, argv, options)) {
+        switch(opt) {
+            case 'o': {
+                sim_geometry.screen_offset[0] = sim_geometry.screen_offset[1] = atof(optarg);
+                if (optind < argc) {
+                    sim_geometry.screen_offset[1] = atof(argv[optind]);
+                    if (sim_geometry.screen_offset[1] != 0) {
+                        ++optind;
+                    }
+                }
+                sim_geometry.screen_count = 1 + (sim_geometry.screen_offset[0] != sim_geometry.screen_offset[1]);
+            } break;
+
+            case 's': {
+                sim_geometry.slice_count = clampi(atoi(optarg), 1, 4096);
+                sset = true;
+            } break;
+
+            case 'w': {
+                if (optind < argc) {
+                    int w = atoi(optarg);
+                    int h = atoi(argv[optind++]);
+                    if (w > 0 && h > 0) {
+                        wset = true;
+                        sim_geometry.screen_width = w;
+                        sim_geometry.screen_height = h;
+                    }
+                }
+            } break;
+
+            case 'g': {
+                switch (*optarg) {
+                    case 'l': sim_geometry.scan_geometry = SCAN_LINEAR; break;
+                    case 'r': sim_geometry.scan_geometry = SCAN_RADIAL; break;
+                }
+            } break;
+
+            case 'b': {
+                sim_bpc = clampi(atoi(optarg), 1, 3);
+            } break;
+
+            case 'e': {
+                sim_emulation.enabled = true;
+                switch (*optarg) {
+                    case 'u': sim_emulation.uniformity = SLICE_BRIGHTNESS_UNIFORM; break;
+                    case 'b': sim_emulation.uniformity = SLICE_BRIGHTNESS_BOOSTED; break;
+                    case 'x': sim_emulation.uniformity = SLICE_BRIGHTNESS_UNLIMITED; break;
+                }
+            } break;
+
+            case 'r': {
+                sim_emulation.revolutions_per_minute = clampi(atoi(optarg), 1, 100000);
+            } break;
+
+            case 'c': {
+                sim_emulation.clock_mhz = clampf(atof(optarg), 0.1f, 1000.0f);
+            } break;
+
+            case 'l': {
+                sim_emulation.sweep_trails = clampi(atoi(optarg), 0, 1);
+            } break;
+
+            case '?': {
+                help = true;
+            } break;
+
+            default: {
+                if (opt && extra) {
+                    extra(opt, argc, argv);
+                }
+            } break;
+        }
+    }
+
+    if (help) {
+        printf("%s - multivox volumetric display simulator.\n"
+               " -b X     bit depth\n"
+               " -s X     slice count\n"
+               " -w X X   panel resolution (width, height)\n"
+               " -o X X   panel offset (front, back)\n"
+               " -g X     geometry (radial, linear)\n"
+               " -e X     model the driver's timing, with slice uniformity (uniform, boosted, x unlimited)\n"
+               " -r X     revolutions per minute, when emulating\n"
+               " -c X     panel clock in MHz, when emulating\n"
+               " -l X     sweep trail length (0, 1), when emulating\n"
+               "%s\n",
+        argv[0], extra_help ? extra_help : "");
+    }
+
+#ifdef VERTICAL_SCAN
+    if (sim_emulation.enabled) {
+        printf("driver emulation only covers horizontally scanned gadgets\n");
+        sim_emulation.enabled = false;
+    }
+#endif
+
+    if (sim_emulation.enabled) {
+        // the driver's geometry, with the offsets standing in for the panels' eccentricity
+        sim_geometry.scan_geometry = SCAN_RADIAL;
+        sim_geometry.slice_count = SLICE_COUNT;
+        sim_geometry.screen_width = PANEL_WIDTH;
+        sim_geometry.screen_height = PANEL_HEIGHT;
+        for (int p = 0; p < PANEL_COUNT; ++p) {
+            eccentricity[p] = sim_geometry.screen_offset[p] * (float)(PANEL_WIDTH / 2);
+        }
+        sim_geometry.screen_count = PANEL_COUNT;
+        emulate_init();
+    }
+
+    if (sim_geometry.scan_geometry == SCAN_LINEAR) {
+        if (!sset) {
+            sim_geometry.slice_count = VOXELS_Z;
+        }
+        if (!wset) {
+            sim_geometry.screen_width = VOXELS_X;
+            sim_geometry.screen_height = VOXELS_Y;
+        }
+    }
+
+    if (sim_emulation.enabled) {
+        // as many as the driver has
+    } else if (sim_geometry.screen_count > 1
+     && sim_geometry.scan_geometry == SCAN_RADIAL
+     && sim_geometry.screen_offset[0] != sim_geometry.screen_offset[1]
+     && sim_geometry.screen_offset[0] >= 0
+     && sim_geometry.screen_offset[1] >= 0) {
+        sim_geometry.screen_count = 2;
+    } else {
+        sim_geometry.screen_count = 1;
+    }
+
+    printf("      slice count: %ld\n panel resolution: %dx%d\n", sim_geometry.slice_count, sim_geometry.screen_width, sim_geometry.screen_height);
+    if (sim_geometry.screen_count > 1) {
+        printf("   screen offsets: %g %g\n", sim_geometry.screen_offset[0], sim_geometry.screen_offset[1]);
+    } else {
+        printf("    screen offset: %g\n", sim_geometry.screen_offset[0]);
+    }
+    switch (sim_geometry.scan_geometry) {
+        case SCAN_RADIAL: printf("         geometry: radial\n"); break;
+        case SCAN_LINEAR: printf("         geometry: linear\n"); break;
+    }
+    printf("     colour depth: %d bpc\n", sim_bpc);
+    if (sim_emulation.enabled) {
+        const char* uniformity[] = {"uniform", "boosted", "unlimited"};
+        printf("        emulation: %s, %d rpm, %g MHz, %d trail\n", uniformity[sim_emulation.uniformity], sim_emulation.revolutions_per_minute, sim_emulation.clock_mhz, sim_emulation.sweep_trails);
+        printf("     slice period: %.1f uS, frame period %.1f uS\n", emulate_slice_us(), emulate_frame_us(sim_bpc));
+    }
+}
+
+bool sim_map_volume(void) {
+    mode_t old_umask = umask(0);
+    volume_fd = shm_open("/vortex_double_buffer", O_CREAT | O_RDWR, 0666);
+    umask(old_umask);
+    if (volume_fd == -1) {
+        perror("shm_open");
+        return false;
+    }
+
+    if (ftruncate(volume_fd, sizeof(voxel_double_buffer_t)) == -1) {
+        perror("ftruncate");
+        return false;
+    }
+
+    voxel_buffer = mmap(NULL, sizeof(voxel_double_buffer_t), PROT_READ | PROT_WRITE, MAP_SHARED, volume_fd, 0);
+    if (voxel_buffer == MAP_FAILED) {
+        perror("mmap");
+        return false;
+    }
+
+    return true;
+}
+
+void sim_unmap_volume(void) {
+    munmap(voxel_buffer, sizeof(voxel_double_buffer_t));
+    close(volume_fd);
+}
+
+
+const pixel_t* sim_get_volume(void) {
+    // read once, as a client flipping in between would pair one page's volume with the other's polar layer
+    int page = voxel_buffer->page;
+    const pixel_t* content = voxel_buffer->volume[page];
+
+    const voxel_polar_t* polar = &voxel_buffer->polar[page];
+    if (polar->mode != VOXEL_POLAR_OFF) {
+        // the simulated display draws from a volume, so polar layers are put back into one
+        static pixel_t resolved[VOXELS_COUNT];
+        if (polar->mode == VOXEL_POLAR_ONLY) {
+            memset(resolved, 0, sizeof(resolved));
+        } else {
+            memcpy(resolved, content, sizeof(resolved));
+        }
+        polar_resolve(resolved, polar);
+        content = resolved;
+    }
+
+    return content;
+}
+
+int sim_bpc_mask(void) {
+    const int bpcmask[4] = {0b11111111, 0b10010010, 0b11011011, 0b11111111};
+    return bpcmask[voxel_buffer->bits_per_channel & 3];
+}
+
+void sim_create_slices(slice_instance_t* slices, size_t slice_count) {
+    if (sim_geometry.scan_geometry == SCAN_LINEAR) {
+        for (int s = 0; s < slice_count; ++s) {
+            slices[s] = (slice_instance_t){.position = (((float)s + 0.5f) / (float)slice_count) * 2.0f - 1.0f};
+        }
+        return;
+    }
+
+    int* scatter = malloc(slice_count * sizeof(int));
+    slicemap_ebr(scatter, slice_count);
+
+    const float radius = (float)sim_geometry.screen_width * 0.5f;
+
+    for (int s = 0; s < slice_count; ++s) {
+        // throttle the inner columns
+        float hole = (float)scatter[s] / (float)slice_count;
+        slices[s] = (slice_instance_t){.position = (float)s * M_PI * 2.0f / (float)slice_count, .hole = floorf(hole * radius) / radius};
+    }
+
+    free(scatter);
+}
+
+static size_t create_mesh_radial(volume_vertex_t** mesh) {
+    // create a mesh containing quads for every slice the screens rotate through
+
+    size_t vertex_count = sim_geometry.slice_count * sim_geometry.screen_count * 12;
+    volume_vertex_t (*vertices)[sim_geometry.screen_count][12] = malloc(vertex_count * sizeof(volume_vertex_t));
+
+    slice_instance_t* slices = malloc(sim_geometry.slice_count * sizeof(slice_instance_t));
+    sim_create_slices(slices, sim_geometry.slice_count);
+
+    const float z = (float)VOXELS_Z / (float)VOXELS_X;
+    const float radius = (float)sim_geometry.screen_width * 0.5f;
+
+    for (int s = 0; s < sim_geometry.slice_count; ++s) {
+        vec2_t slope = {.x = cosf(slices[s].position), .y = sinf(slices[s].position)};
+
+        for (int p = 0; p < sim_geometry.screen_count; ++p) {
+            // each screen clips its own hole to its rim, as slice_vert does
+            float hole = slices[s].hole;
+            float side = (p ? -1 : 1);
+            vec2_t offset = {.x = slope.y * sim_geometry.screen_offset[p] * side, .y = -slope.x * sim_geometry.screen_offset[p] * side};
+
+            vec2_t inner, outer;
+            vec2_multiply_f(outer.v, slope.v, side);
+            vec2_multiply_f(inner.v, outer.v, hole);
+
+            vec2_t ends[4];
+            vec2_subtract(ends[0].v, offset.v, outer.v);
+            vec2_subtract(ends[1].v, offset.v, inner.v);
+            vec2_add(ends[2].v, offset.v, inner.v);
+            vec2_add(ends[3].v, offset.v, outer.v);
+
+            // clip to the voxel volume
+            float rim[2] = {1.0f, 1.0f};
+            for (int i = 0; i < 2; ++i) {
+                float box = max(fabsf(ends[3*i].x), fabsf(ends[3*i].y));
+                if (box > 1.0f) {
+                    rim[i] = floorf((1.0f / box) * radius) / radius;
+                    hole = min(hole, rim[i]);
+                    vec2_multiply_f(ends[3*i].v, ends[3*i].v, rim[i]);
+                }
+            }
+
+            vertices[s][p][0] = (volume_vertex_t){.position={ends[0].x, ends[0].y, -z}, .texcoord={0, (1+ends[0].x)*0.5f, (1+ends[0].y)*0.5f}, .dotcoord={radius*rim[0], 0.0f}};
+            vertices[s][p][1] = (volume_vertex_t){.position={ends[1].x, ends[1].y, -z}, .texcoord={0, (1+ends[1].x)*0.5f, (1+ends[1].y)*0.5f}, .dotcoord={radius * hole, 0.0f}};
+            vertices[s][p][2] = (volume_vertex_t){.position={ends[0].x, ends[0].y,  z}, .texcoord={1, (1+ends[0].x)*0.5f, (1+ends[0].y)*0.5f}, .dotcoord={radius*rim[0], (float)sim_geometry.screen_height}};
+            vertices[s][p][3] = (volume_vertex_t){.position={ends[1].x, ends[1].y,  z}, .texcoord={1, (1+ends[1].x)*0.5f, (1+ends[1].y)*0.5f}, .dotcoord={radius * hole, (float)sim_geometry.screen_height}};
+            vertices[s][p][4] = vertices[s][p][2];
+            vertices[s][p][5] = vertices[s][p][1];
+
+            vertices[s][p][6] = (volume_vertex_t){.position={ends[2].x, ends[2].y, -z}, .texcoord={0, (1+ends[2].x)*0.5f, (1+ends[2].y)*0.5f}, .dotcoord={radius * hole, 0.0f}};
+            vertices[s][p][7] = (volume_vertex_t){.position={ends[3].x, ends[3].y, -z}, .texcoord={0, (1+ends[3].x)*0.5f, (1+ends[3].y)*0.5f}, .dotcoord={radius*rim[1], 0.0f}};
+            vertices[s][p][8] = (volume_vertex_t){.position={ends[2].x, ends[2].y,  z}, .texcoord={1, (1+ends[2].x)*0.5f, (1+ends[2].y)*0.5f}, .dotcoord={radius * hole, (float)sim_geometry.screen_height}};
+            vertices[s][p][9] = (volume_vertex_t){.position={ends[3].x, ends[3].y,  z}, .texcoord={1, (1+ends[3].x)*0.5f, (1+ends[3].y)*0.5f}, .dotcoord={radius*rim[1], (float)sim_geometry.screen_height}};
+            vertices[s][p][10] = vertices[s][p][8];
+            vertices[s][p][11] = vertices[s][p][7];
+
+        }
+    }
+
+    free(slices);
+
+    *mesh = &vertices[0][0][0];
+    return vertex_count;
+}
+
+static size_t create_mesh_linear(volume_vertex_t** mesh) {
+    size_t vertex_count = sim_geometry.slice_count * 6;
+    volume_vertex_t (*vertices)[6] = malloc(vertex_count * sizeof(volume_vertex_t));
+
+    slice_instance_t* slices = malloc(sim_geometry.slice_count * sizeof(slice_instance_t));
+    sim_create_slices(slices, sim_geometry.slice_count);
+
+    const float zaspect = ((float)VOXELS_Z / (float)VOXELS_X);
+
+    for (int s = 0; s < sim_geometry.slice_count; ++s) {
+        float z = slices[s].position;
+
+        vertices[s][0] = (volume_vertex_t){.position={ -1, -1, z * zaspect}, .texcoord={(1+z)*0.5, 0, 0}, .dotcoord={-(float)sim_geometry.screen_width*0.5f,-(float)sim_geometry.screen_height*0.5f}};
+        vertices[s][1] = (volume_vertex_t){.position={  1, -1, z * zaspect}, .texcoord={(1+z)*0.5, 1, 0}, .dotcoord={ (float)sim_geometry.screen_width*0.5f,-(float)sim_geometry.screen_height*0.5f}};
+        vertices[s][2] = (volume_vertex_t){.position={ -1,  1, z * zaspect}, .texcoord={(1+z)*0.5, 0, 1}, .dotcoord={-(float)sim_geometry.screen_width*0.5f, (float)sim_geometry.screen_height*0.5f}};
+        vertices[s][3] = (volume_vertex_t){.position={  1,  1, z * zaspect}, .texcoord={(1+z)*0.5, 1, 1}, .dotcoord={ (float)sim_geometry.screen_width*0.5f, (float)sim_geometry.screen_height*0.5f}};
+        vertices[s][4] = vertices[s][2];
+        vertices[s][5] = vertices[s][1];
+    }
+
+    free(slices);
+
+    *mesh = &vertices[0][0];
+    return vertex_count;
+}
+
+size_t sim_create_mesh(volume_vertex_t** vertices) {
+    if (sim_emulation.enabled) {
+        return emulate_create_mesh(vertices);
+    }
+    if (sim_geometry.scan_geometry == SCAN_LINEAR) {
+        return create_mesh_linear(vertices);
+    }
+    return create_mesh_radial(vertices);
+}
+
+void sim_drag(int button, float dx, float dy) {
+    switch (button) {
+        case 1:
+            model_rotation.x = clampf(model_rotation.x + dy * 3, -M_PI*0.95f, -M_PI*0.05f);
+            model_rotation.z = fmodf(model_rotation.z + dx * 3, M_PI * 2);
+            break;
+
+        case 2:
+            view_position.x = clampf(view_position.x + dx, -1.0f, 1.0f);
+            view_position.y = clampf(view_position.y - dy, -1.0f, 1.0f);
+            break;
+        
+    }
+}
+
+void sim_zoom(float d) {
+    view_position.z = clampf(view_position.z + d, -10.0f, -0.1f);
+}
+
+void sim_get_matrices(float* view, float* proj, float aspect) {
+    float matrix[MAT4_SIZE];
+
+    mat4_identity(matrix);
+    mat4_rotation_z(matrix, model_rotation.z);
+
+    mat4_identity(view);
+    mat4_rotation_x(view, model_rotation.x);
+    mat4_multiply(view, view, matrix);
+
+    mat4_translate(view, view, view_position.v);
+
+    mat4_perspective(proj, to_radians(35), aspect, 0.1f, 100.0f);
+}
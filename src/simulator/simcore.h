@@ -0,0 +1,67 @@
+#ifndef _SIMCORE_H_
+#define _SIMCORE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "voxel.h"
+
+// the parts of the simulator that don't need a GPU: the display's scan geometry as a mesh of slice quads,
+// the camera looking at it and the shared voxel buffer. sim.c draws them with GLES, headless.c in software.
+
+typedef enum {
+    SCAN_RADIAL,
+    SCAN_LINEAR
+} scan_geometry_t;
+
+typedef struct {
+    int screen_width;
+    int screen_height;
+    float screen_offset[2];
+    size_t screen_count;
+    size_t slice_count;
+    scan_geometry_t scan_geometry;
+} sim_geometry_t;
+
+// texcoord is into the volume as z, x, y. dotcoord counts LEDs across and up the panel, dots sit at their centres
+typedef struct {
+    float position[3];
+    float texcoord[3];
+    float dotcoord[2];
+} volume_vertex_t;
+
+// what sets each slice apart from the others, for generating its quads. radial slices have their angle and how
+// far out from the axis the inner columns start, linear ones their depth through the volume, -1 to 1
+typedef struct {
+    float position;
+    float hole;
+} slice_instance_t;
+
+extern sim_geometry_t sim_geometry;
+extern int sim_bpc;
+extern float sim_brightness;
+
+// options in extra_options go to extra, with optarg and optind as getopt left them. extra_help is added to the usage
+typedef void (*sim_option_cb_t)(int opt, int argc, char** argv);
+void sim_parse_args(int argc, char** argv, const char* extra_options, const char* extra_help, sim_option_cb_t extra);
+
+// slice_count of them, spread around a revolution or through the volume
+void sim_create_slices(slice_instance_t* slices, size_t slice_count);
+
+// triangles covering every slice the screens sweep through, for the caller to free
+size_t sim_create_mesh(volume_vertex_t** vertices);
+
+bool sim_map_volume(void);
+void sim_unmap_volume(void);
+
+// the front page as the display would show it, with any polar layer put back into the volume
+const pixel_t* sim_get_volume(void);
+
+// which bits of each voxel the display's colour depth keeps
+int sim_bpc_mask(void);
+
+void sim_drag(int button, float dx, float dy);
+void sim_zoom(float d);
+void sim_get_matrices(float* view, float* proj, float aspect);
+
+#endif
@@ -0,0 +1,80 @@
+#version 310 es
+
+precision mediump int;
+
+// the slice quads, made up from the vertex id rather than stored. each instance is a slice, and the same as
+// sim_create_mesh makes: radial slices have two quads per screen, one either side of the axis, linear ones
+// a single quad
+in vec2 a_slice;                // angle and hole when radial, depth when linear
+
+uniform mat4 u_view;
+uniform mat4 u_proj;
+uniform int u_bpcmask;
+uniform float u_brightness;
+
+uniform bool u_linear;
+uniform vec2 u_screen;          // panel resolution
+uniform vec2 u_offset;          // front and back screen offsets, as a fraction of the radius
+uniform float u_zaspect;        // height of the volume over its width
+
+out vec3 v_texcoord;
+out vec2 v_dotcoord;
+out vec3 v_bpcscale;
+
+void main() {
+    highp int vertex = gl_VertexID;
+
+    // each quad is bottom left, bottom right, top left, then top right, top left, bottom right
+    highp int corner = vertex % 6;
+    bool right = (corner & 1) != 0;
+    bool top = corner >= 2 && corner <= 4;
+
+    vec3 position;
+    if (u_linear) {
+        vec2 xy = vec2(right ? 1.0 : -1.0, top ? 1.0 : -1.0);
+        position = vec3(xy, a_slice.x * u_zaspect);
+        v_texcoord = vec3((1.0 + a_slice.x) * 0.5, (1.0 + xy) * 0.5);
+        v_dotcoord = xy * u_screen * 0.5;
+    } else {
+        bool back = vertex >= 12;
+        bool outside = (vertex % 12) >= 6;
+        float side = back ? -1.0 : 1.0;
+        float radius = u_screen.x * 0.5;
+
+        vec2 slope = vec2(cos(a_slice.x), sin(a_slice.x));
+        vec2 offset = vec2(slope.y, -slope.x) * (back ? u_offset.y : u_offset.x) * side;
+        vec2 outer = slope * side;
+        vec2 inner = outer * a_slice.y;
+        float hole = a_slice.y;
+
+        // clip to the voxel volume
+        vec2 ends[2] = vec2[2](offset - outer, offset + outer);
+        float rim[2] = float[2](1.0, 1.0);
+        for (int i = 0; i < 2; ++i) {
+            float box = max(abs(ends[i].x), abs(ends[i].y));
+            if (box > 1.0) {
+                rim[i] = floor((1.0 / box) * radius) / radius;
+                hole = min(hole, rim[i]);
+                ends[i] *= rim[i];
+            }
+        }
+
+        vec2 end;
+        float dots;
+        if (outside) {
+            end = right ? ends[1] : offset + inner;
+            dots = right ? rim[1] : hole;
+        } else {
+            end = right ? offset - inner : ends[0];
+            dots = right ? hole : rim[0];
+        }
+
+        position = vec3(end, top ? u_zaspect : -u_zaspect);
+        v_texcoord = vec3(top ? 1.0 : 0.0, (1.0 + end) * 0.5);
+        v_dotcoord = vec2(radius * dots, top ? u_screen.y : 0.0);
+    }
+
+    gl_Position = u_proj * u_view * vec4(position, 1.0);
+
+    v_bpcscale = u_brightness / vec3(float(u_bpcmask & 0xe0), float(u_bpcmask & 0x1c), float(u_bpcmask & 0x03));
+}
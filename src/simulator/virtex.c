@@ -236,6 +236,7 @@ int main(int argc, char** argv) {
 #ifdef PROFILE
     timespec_t timer = timer_time_now();
     int perf = 0;
+    sim_upload_stats_t uploaded = sim_get_upload_stats();
 #endif
 
     do {
@@ -247,7 +248,12 @@ int main(int argc, char** argv) {
 
 #ifdef PROFILE
         if (++perf >= 16) {
-            printf("%d ms\n", timer_elapsed_ms(&timer) / perf);
+            int elapsed = timer_elapsed_ms(&timer);
+            sim_upload_stats_t stats = sim_get_upload_stats();
+            printf("%d ms, %zu slices, upload %.2f MB/s in %u slabs over %u checks\n", elapsed / perf, sim_get_slice_count(),
+                   (double)(stats.bytes - uploaded.bytes) / (1024.0 * 1024.0) / (max(elapsed, 1) * 0.001),
+                   stats.slabs - uploaded.slabs, stats.checks - uploaded.checks);
+            uploaded = stats;
             perf = 0;
         }
 #endif
@@ -6,6 +6,7 @@
 #include "mathc.h"
 #include "timer.h"
 #include "rammel.h"
+#include "primitives.h"
 
 enum {
     OCCUPANT_EMPTY,
@@ -154,36 +155,21 @@ void grid_draw(pixel_t* volume) {
                 int vy = ((y - (GRID_HEIGHT/2))* GRID_SPACING) + (VOXELS_Y/2) + (GRID_SPACING/2);
 
                 if (cell->walls & 0x10) {
-                    int vxi = vx - (GRID_SPACING/2 - 1);
-                    int vxs = vx + (GRID_SPACING/2 - 1);
-                    int vyi = vy - (GRID_SPACING/2 - 1);
-                    int vys = vy + (GRID_SPACING/2 - 1);
-                
-                    for (int fvy = vyi; fvy <= vys; ++fvy) {
-                        for (int fvx = vxi; fvx <= vxs; ++fvx) {
-                            for (int z = 0; z < height; ++z) {
-                                pixel_t colour = z ? o.colour : basecol;
-                                volume[VOXEL_INDEX(fvx, fvy, z + z0)] = colour;
-                            }
-                        }
-                    }
+                    graphics_box_t block = {
+                        {vx - (GRID_SPACING/2 - 1), vy - (GRID_SPACING/2 - 1), z0},
+                        {vx + (GRID_SPACING/2), vy + (GRID_SPACING/2), z0 + 1}
+                    };
+                    graphics_fill_box(volume, &block, basecol);
+                    block.min[2] = z0 + 1;
+                    block.max[2] = z0 + height;
+                    graphics_fill_box(volume, &block, o.colour);
                 } else {
-                    if (cell->walls & 0x0f) {
-                        for (int i = 0; i < GRID_SPACING/2; ++i) {
-                            for (int z = 0; z < height; ++z) {
-                                pixel_t colour = z ? o.colour : basecol;
-                                if (cell->walls & 1) {
-                                    volume[VOXEL_INDEX(vx+i, vy, z + z0)] = colour;
-                                }
-                                if (cell->walls & 2) {
-                                    volume[VOXEL_INDEX(vx, vy+i, z + z0)] = colour;
-                                }
-                                if (cell->walls & 4) {
-                                    volume[VOXEL_INDEX(vx-i-1, vy, z + z0)] = colour;
-                                }
-                                if (cell->walls & 8) {
-                                    volume[VOXEL_INDEX(vx, vy-i-1, z + z0)] = colour;
-                                }
+                    for (int i = 0; i < GRID_SPACING/2; ++i) {
+                        const int wall[4][2] = {{vx+i, vy}, {vx, vy+i}, {vx-i-1, vy}, {vx, vy-i-1}};
+                        for (int w = 0; w < 4; ++w) {
+                            if (cell->walls & (1 << w)) {
+                                graphics_fill_column(volume, wall[w][0], wall[w][1], z0, z0 + 1, basecol);
+                                graphics_fill_column(volume, wall[w][0], wall[w][1], z0 + 1, z0 + height, o.colour);
                             }
                         }
                     }
@@ -89,36 +89,45 @@ static uint32_t prbs31(uint32_t curr) {
     return next;
 }
 
-static void draw_voxel(pixel_t* volume, const int* coordinate, const float* barycentric, const triangle_state_t* triangle) {
+static void draw_span(pixel_t* volume, const graphics_span_t* span, const triangle_state_t* triangle) {
     static uint32_t fuzz = 0;
-    fuzz = prbs31(fuzz);
-
-    pixel_t colour = triangle->colour;
-
-    if (triangle->texture) {
-        float texcoord[2] = {
-            triangle->texcoord[0][0] * barycentric[0] + triangle->texcoord[1][0] * barycentric[1] + triangle->texcoord[2][0] * barycentric[2],
-            triangle->texcoord[0][1] * barycentric[0] + triangle->texcoord[1][1] * barycentric[1] + triangle->texcoord[2][1] * barycentric[2]
-        };
-        
-        bool masked = false;
-        colour = image_sample(triangle->texture, texcoord, &masked);
-        if (masked) {
-            return;
+
+    float barycentric[VEC3_SIZE];
+    vec3_assign(barycentric, span->barycentric);
+
+    for (int i = 0; i < span->length; ++i, vec3_add(barycentric, barycentric, span->step)) {
+        fuzz = prbs31(fuzz);
+
+        pixel_t colour = triangle->colour;
+
+        if (triangle->texture) {
+            float texcoord[2] = {
+                triangle->texcoord[0][0] * barycentric[0] + triangle->texcoord[1][0] * barycentric[1] + triangle->texcoord[2][0] * barycentric[2],
+                triangle->texcoord[0][1] * barycentric[0] + triangle->texcoord[1][1] * barycentric[1] + triangle->texcoord[2][1] * barycentric[2]
+            };
+            
+            bool masked = false;
+            colour = image_sample(triangle->texture, texcoord, &masked);
+            if (masked) {
+                continue;
+            }
         }
-    }
 
-    uint8_t shine = tubeface_shine + ((colour & 0x7f)*2);// + ((coordinate[0]^coordinate[1]^coordinate[2])&4)*109;
+        int coordinate[VEC3_SIZE];
+        graphics_span_voxel(span, i, coordinate);
 
-    int32_t x = coordinate[0] +  ((int)min((fuzz>>4)&0xff, 255-shine)*((fuzz&1)?1:-1)) / 80;
-    int32_t y = coordinate[1] +  ((int)min((fuzz>>12)&0xff, shine)*((fuzz&1)?1:-1)) / 80;
-    int32_t z = coordinate[2];
-    if ((uint32_t)x >= VOXELS_X || (uint32_t)y >= VOXELS_Y || (uint32_t)z >= VOXELS_Z) {
-        return;
-    }
+        uint8_t shine = tubeface_shine + ((colour & 0x7f)*2);// + ((coordinate[0]^coordinate[1]^coordinate[2])&4)*109;
 
-    uint8_t face = colour & 0x80;
-    volume[VOXEL_INDEX(x, y, z)] = face ? HEXPIX(AA5555) : RGBPIX(shine, 0xAA, 0xFF);
+        int32_t x = coordinate[0] +  ((int)min((fuzz>>4)&0xff, 255-shine)*((fuzz&1)?1:-1)) / 80;
+        int32_t y = coordinate[1] +  ((int)min((fuzz>>12)&0xff, shine)*((fuzz&1)?1:-1)) / 80;
+        int32_t z = coordinate[2];
+        if ((uint32_t)x >= VOXELS_X || (uint32_t)y >= VOXELS_Y || (uint32_t)z >= VOXELS_Z) {
+            continue;
+        }
+
+        uint8_t face = colour & 0x80;
+        volume[VOXEL_INDEX(x, y, z)] = face ? HEXPIX(AA5555) : RGBPIX(shine, 0xAA, 0xFF);
+    }
 }
 
 void tubeface_init(void) {
@@ -135,11 +144,8 @@ void tubeface_draw(pixel_t* volume) {
     float matrix[MAT4_SIZE];
 
     tubeface_shine = timer_frame_time / 4;
-    graphics_triangle_shader_cb = draw_voxel;
 
     mat4_identity(matrix);
     mat4_translation(matrix, matrix, (float[3]){VOXELS_X*0.5f, VOXELS_Y*0.5f, 32});
-    model_draw(volume, &model_tubeface, matrix);
-
-    graphics_triangle_shader_cb = NULL;
+    model_draw_shaded(volume, &model_tubeface, matrix, draw_span);
 }
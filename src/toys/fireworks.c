@@ -9,57 +9,23 @@
 #include "rammel.h"
 #include "input.h"
 #include "voxel.h"
+#include "primitives.h"
 
 
 void draw_sphere(int x, int y, int z, int radius, uint8_t colour) {
     pixel_t* volume = voxel_buffer_get(VOXEL_BUFFER_FRONT);
-
-    int xi = (x - radius < 0) ? -x : -radius;
-    int xs = (x + radius >= VOXELS_X) ? (VOXELS_X-1 - x) : radius;
-    int yi = (y - radius < 0) ? -y : -radius;
-    int ys = (y + radius >= VOXELS_Y) ? (VOXELS_Y-1 - y) : radius;
-    int zi = (z - radius < 0) ? -z : -radius;
-    int zs = (z + radius >= VOXELS_Z) ? (VOXELS_Z-1 - z) : radius;
-
-    int rosq = radius * radius / 4;
-
-    for (int xx = xi; xx <= xs; ++xx) {
-        for (int yy = yi; yy <= ys; ++yy) {
-            for (int zz = zi; zz <= zs; ++zz) {
-                int lsq = xx*xx + yy*yy + zz*zz;
-                if (lsq <= rosq) {
-                    volume[VOXEL_INDEX(x+xx, y+yy, z+zz)] = colour;
-                }
-            }
-        }
-    }
+    graphics_fill_sphere(volume, (int[3]){x, y, z}, radius * radius / 4, colour);
 }
 
 void draw_sphereaa(int x, int y, int z, int radius, uint8_t colour) {
     pixel_t* volume = voxel_buffer_get(VOXEL_BUFFER_FRONT);
 
-    int xi = (x - radius < 0) ? -x : -radius;
-    int xs = (x + radius >= VOXELS_X) ? (VOXELS_X-1 - x) : radius;
-    int yi = (y - radius < 0) ? -y : -radius;
-    int ys = (y + radius >= VOXELS_Y) ? (VOXELS_Y-1 - y) : radius;
-    int zi = (z - radius < 0) ? -z : -radius;
-    int zs = (z + radius >= VOXELS_Z) ? (VOXELS_Z-1 - z) : radius;
-
     int rosq = radius * radius;
     int risq = (radius-1) * (radius-1);
     uint8_t ci = (colour&0b10010010)>>1;
 
-    for (int xx = xi; xx <= xs; ++xx) {
-        for (int yy = yi; yy <= ys; ++yy) {
-            for (int zz = zi; zz <= zs; ++zz) {
-                int lsq = xx*xx + yy*yy + zz*zz;
-                if (lsq <= rosq) {
-                    uint c = lsq > risq ? ci : colour;
-                    volume[VOXEL_INDEX(x+xx, y+yy, z+zz)] = c;
-                }
-            }
-        }
-    }
+    graphics_fill_sphere(volume, (int[3]){x, y, z}, rosq, ci);
+    graphics_fill_sphere(volume, (int[3]){x, y, z}, min(risq, rosq), colour);
 }
 
 typedef struct {
@@ -0,0 +1,195 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <zlib.h>
+
+#include "rammel.h"
+#include "input.h"
+#include "voxel.h"
+#include "array.h"
+
+// receives frames of points from python/pointvision.py's senders and draws them.
+// each frame is a 0xffffffff marker, a big endian length, then that many bytes of gzipped x, y, z, colour points
+
+#define POINTVISION_PORT 0x5658
+#define POINTVISION_MARKER 0xffffffffu
+
+// far more points than the volume has voxels, but a length past this is a broken or hostile sender, not a frame.
+// gzip never grows a frame by more than a few bytes, so the packet is held to the same
+#define POINTVISION_MAX_POINTS (1 << 22)
+#define POINTVISION_MAX_BYTES (POINTVISION_MAX_POINTS * 4)
+
+static array_t packet = {sizeof(uint8_t)};
+static array_t points = {sizeof(uint8_t)};
+
+static int open_server(void) {
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+    if (server < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    int reuse = 1;
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_port = htons(POINTVISION_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY)
+    };
+
+    if (bind(server, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(server, 1) < 0) {
+        perror("bind");
+        close(server);
+        return -1;
+    }
+
+    return server;
+}
+
+static bool receive_exactly(int fd, void* data, size_t length) {
+    while (length > 0) {
+        ssize_t received = recv(fd, data, length, MSG_WAITALL);
+        if (received <= 0) {
+            return false;
+        }
+        data += received;
+        length -= received;
+    }
+    return true;
+}
+
+static bool inflate_points(const uint8_t* data, size_t length) {
+    z_stream stream = {.next_in = (Bytef*)data, .avail_in = length};
+    if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+        return false;
+    }
+
+    // the points usually take several times the packet, so start there and grow as needed, up to the limit
+    array_resize(&points, min(max(points.capacity, max(length * 4, (size_t)4096)), (size_t)POINTVISION_MAX_BYTES));
+
+    int result = Z_OK;
+    size_t total = 0;
+    while (result == Z_OK) {
+        if (total == points.count) {
+            if (points.count >= POINTVISION_MAX_BYTES) {
+                break;
+            }
+            array_resize(&points, min(points.count * 2, (size_t)POINTVISION_MAX_BYTES));
+        }
+        stream.next_out = (Bytef*)points.data + total;
+        stream.avail_out = points.count - total;
+        result = inflate(&stream, Z_NO_FLUSH);
+        total = stream.total_out;
+    }
+
+    inflateEnd(&stream);
+    points.count = total;
+    return result == Z_STREAM_END;
+}
+
+static bool receive_frame(int client, uint32_t flags) {
+    uint32_t header[2];
+    if (!receive_exactly(client, header, sizeof(header))) {
+        return false;
+    }
+
+    if (header[0] != POINTVISION_MARKER) {
+        fprintf(stderr, "invalid header\n");
+        return false;
+    }
+
+    uint32_t length = ntohl(header[1]);
+    if (length > POINTVISION_MAX_BYTES) {
+        fprintf(stderr, "packet too long\n");
+        return false;
+    }
+
+    array_resize(&packet, length);
+    if (!receive_exactly(client, packet.data, packet.count)) {
+        return false;
+    }
+
+    if (!inflate_points(packet.data, packet.count)) {
+        fprintf(stderr, "bad packet\n");
+        return true;
+    }
+
+    pixel_t* volume = voxel_buffer_get(VOXEL_BUFFER_BACK);
+    voxel_buffer_clear(volume);
+    voxel_splat_points(volume, points.data, points.count / 4, flags);
+    voxel_buffer_swap();
+
+    return true;
+}
+
+int main(int argc, char** argv) {
+    uint32_t flags = VOXEL_SPLAT_LAST;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-m") == 0) {
+            flags |= VOXEL_SPLAT_MAX;
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc && (uint)atoi(argv[i + 1]) <= VOXEL_SPLAT_MAX_RADIUS) {
+            flags |= VOXEL_SPLAT_RADIUS(atoi(argv[++i]));
+        } else {
+            fprintf(stderr, "usage: %s [-m] [-r radius 0-%d]\n", argv[0], VOXEL_SPLAT_MAX_RADIUS);
+            exit(1);
+        }
+    }
+
+    if (!voxel_buffer_map()) {
+        exit(1);
+    }
+
+    int server = open_server();
+    if (server < 0) {
+        exit(1);
+    }
+
+    input_set_nonblocking();
+
+    struct pollfd fds[] = {
+        {.fd = STDIN_FILENO, .events = POLLIN},
+        {.fd = server, .events = POLLIN},
+        {.fd = -1, .events = POLLIN}
+    };
+
+    for (int ch = 0; ch != 27; ch = getchar()) {
+        // only one sender at a time. a second one waiting would keep the server readable, so it isn't
+        // polled until the first has gone, rather than waking the loop straight back up
+        fds[1].fd = (fds[2].fd < 0) ? server : -1;
+
+        if (poll(fds, count_of(fds), 100) <= 0) {
+            continue;
+        }
+
+        if ((fds[1].revents & POLLIN) && fds[2].fd < 0) {
+            fds[2].fd = accept(server, NULL, NULL);
+        }
+
+        if (fds[2].revents & (POLLIN | POLLHUP)) {
+            if (!receive_frame(fds[2].fd, flags)) {
+                close(fds[2].fd);
+                fds[2].fd = -1;
+            }
+        }
+    }
+
+    if (fds[2].fd >= 0) {
+        close(fds[2].fd);
+    }
+    close(server);
+
+    array_destroy(&packet);
+    array_destroy(&points);
+
+    voxel_buffer_unmap();
+
+    return 0;
+}
@@ -16,6 +16,7 @@
 #include "input.h"
 #include "graphics.h"
 #include "model.h"
+#include "polar.h"
 #include "voxel.h"
 
 static float tess_vertices[16][VEC4_SIZE] = {
@@ -92,14 +93,36 @@ int main(int argc, char** argv) {
 
     bool show_faces = false;
 
+#ifdef VOXEL_POLAR_LAYER
+    // the edges are drawn straight into the display's slices
+    polar_target_t* polar = polar_create();
+
+    // pages that may still hold something other than the current faces: whatever was there before the toy
+    // started, or faces that have since been turned off
+    int stale_pages = count_of(((voxel_double_buffer_t*)0)->volume);
+#endif
+
     for (int ch = 0; ch != 27; ch = getchar()) {
         pixel_t* volume = voxel_buffer_get(VOXEL_BUFFER_BACK);
-        voxel_buffer_clear(volume);
 
         if (ch == 'f') {
             show_faces = !show_faces;
         }
 
+#ifdef VOXEL_POLAR_LAYER
+        // only the faces go in the volume. once they're off the display ignores it while spinning, but shows it
+        // when stopped, so each page is cleared one last time rather than left with the old faces
+        if (show_faces) {
+            voxel_buffer_clear(volume);
+            stale_pages = count_of(((voxel_double_buffer_t*)0)->volume);
+        } else if (stale_pages > 0) {
+            voxel_buffer_clear(volume);
+            --stale_pages;
+        }
+#else
+        voxel_buffer_clear(volume);
+#endif
+
         model_rotation[0] = fmodf(model_rotation[0] + 0.013f, 2 * M_PI);
         model_rotation[2] = fmodf(model_rotation[2] + 0.017f, 2 * M_PI);
 
@@ -118,22 +141,31 @@ int main(int argc, char** argv) {
 
         if (show_faces) {
             for (uint i = 0; i < count_of(tess_faces); ++i) {
-                pixel_t colour = colours[i % count_of(colours)] & 0b01101101;
-                graphics_triangle_colour(colour);
-                graphics_draw_triangle(volume, transformed[tess_faces[i][0]].v, transformed[tess_faces[i][1]].v, transformed[tess_faces[i][2]].v);
-                graphics_draw_triangle(volume, transformed[tess_faces[i][0]].v, transformed[tess_faces[i][2]].v, transformed[tess_faces[i][3]].v);
+                const int* face = tess_faces[i];
+                graphics_material_t material = {.colour = colours[i % count_of(colours)] & 0b01101101};
+                graphics_draw_triangles(volume, transformed[0].v, NULL, 0, (index_t[6]){face[0], face[1], face[2], face[0], face[2], face[3]}, 6, &material);
             }
         }
 
+        edge_t edges[count_of(tess_edges)];
         for (uint i = 0; i < count_of(tess_edges); ++i) {
-            pixel_t colour = colours[i % count_of(colours)];
-            graphics_draw_line(volume, transformed[tess_edges[i][0]].v, transformed[tess_edges[i][1]].v, colour);
+            edges[i] = (edge_t){.index = {tess_edges[i][0], tess_edges[i][1]}, .colour = colours[i % count_of(colours)]};
         }
+#ifdef VOXEL_POLAR_LAYER
+        polar_clear(polar);
+        polar_draw_edges(polar, transformed[0].v, NULL, edges, count_of(edges));
+        polar_submit(polar, voxel_buffer_get_polar(VOXEL_BUFFER_BACK), show_faces ? VOXEL_POLAR_OVERLAY : VOXEL_POLAR_ONLY);
+#else
+        graphics_draw_edges(volume, transformed[0].v, edges, count_of(edges));
+#endif
 
         voxel_buffer_swap();
         usleep(50000);
     }
 
+#ifdef VOXEL_POLAR_LAYER
+    polar_destroy(polar);
+#endif
     voxel_buffer_unmap();
 
     return 0;
@@ -23,6 +23,8 @@
 #include "graphics.h"
 #include "model.h"
 #include "voxel.h"
+#include "timer.h"
+#include "arena.h"
 
 #define SHOW_STATS 1
 
@@ -116,34 +118,175 @@ static void zoom_to_fit() {
     printf("zoom %g, offset %g,%g,%g\n", model_scale, model_position[0], model_position[1], model_position[2]);
 }
 
-static model_t* load_scene(char* scene) {
-    model_t* model = NULL;
+// scenes load on a thread of their own, the current one first and then its neighbours either side,
+// so that stepping through the list rarely has to wait
+#define SCENE_SLOTS 3
 
+typedef struct {
+    int index;              // into scene_list, -1 when the slot is free
+    model_style_t style;
+    model_t* model;
+    pixel_t* volume;        // raw voxel data, copied into the buffer once it's shown
+} scene_slot_t;
+
+static scene_slot_t scene_slots[SCENE_SLOTS] = {{-1}, {-1}, {-1}};
+static int scene_wanted[SCENE_SLOTS] = {-1, -1, -1};   // the order to load them in, current first
+static model_style_t scene_wanted_style = STYLE_DEFAULT;
+static bool scene_pending = false;
+
+static bool scene_loader_running = false;
+static pthread_t scene_loader_thread;
+static pthread_mutex_t scene_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t scene_wake = PTHREAD_COND_INITIALIZER;
+
+static void load_scene(const char* scene, scene_slot_t* slot) {
     printf("loading %s\n", scene);
 
     if (is_model(scene)) {
-        model = model_load(scene, wireframe);
+        slot->model = model_load(scene, slot->style);
     } else if (is_image(scene)) {
-        model = model_load_image(scene);
+        slot->model = model_load_image(scene);
     } else {
         //assume it's raw voxel data
-        pixel_t* volume = voxel_buffer_get(VOXEL_BUFFER_BACK);
+        slot->volume = malloc(sizeof(*voxel_buffer->volume));
 
         bool read = false;
         FILE* fd = fopen(scene, "rb");
         if (fd) {
-            read = (fread(volume, 1, sizeof(*voxel_buffer->volume), fd) == sizeof(*voxel_buffer->volume));
+            read = (fread(slot->volume, 1, sizeof(*voxel_buffer->volume), fd) == sizeof(*voxel_buffer->volume));
             fclose(fd);
         }
 
         if (!read) {
-            voxel_buffer_clear(volume);
+            voxel_buffer_clear(slot->volume);
+        }
+    }
+}
+
+static void free_slot(scene_slot_t* slot) {
+    model_free(slot->model);
+    free(slot->volume);
+    *slot = (scene_slot_t){.index = -1};
+}
+
+// only models change with the wireframe style, images and raw voxels load the same either way.
+// these all need scene_lock held
+static model_style_t wanted_style(int index) {
+    return is_model(scene_list[index]) ? scene_wanted_style : STYLE_DEFAULT;
+}
+
+static bool is_wanted(int index, model_style_t style) {
+    for (int i = 0; i < SCENE_SLOTS; ++i) {
+        if (scene_wanted[i] == index && index >= 0) {
+            return style == wanted_style(index);
         }
-        voxel_buffer_swap();
-        memcpy(voxel_buffer_get(VOXEL_BUFFER_BACK), voxel_buffer_get(VOXEL_BUFFER_FRONT), sizeof(*voxel_buffer->volume));
     }
+    return false;
+}
 
-    return model;
+static scene_slot_t* find_slot(int index, model_style_t style) {
+    for (int i = 0; i < SCENE_SLOTS; ++i) {
+        if (scene_slots[i].index == index && (index < 0 || scene_slots[i].style == style)) {
+            return &scene_slots[i];
+        }
+    }
+    return NULL;
+}
+
+static void* scene_loader(void* vargp) {
+    pthread_mutex_lock(&scene_lock);
+    while (scene_loader_running) {
+        scene_slot_t loaded = {.index = -1};
+        for (int i = 0; i < SCENE_SLOTS && loaded.index < 0; ++i) {
+            int index = scene_wanted[i];
+            if (index >= 0 && !find_slot(index, wanted_style(index))) {
+                loaded.index = index;
+                loaded.style = wanted_style(index);
+            }
+        }
+
+        if (loaded.index < 0) {
+            pthread_cond_wait(&scene_wake, &scene_lock);
+            continue;
+        }
+
+        pthread_mutex_unlock(&scene_lock);
+        load_scene(scene_list[loaded.index], &loaded);
+        pthread_mutex_lock(&scene_lock);
+
+        // the viewer may have moved on while it loaded
+        scene_slot_t* slot = is_wanted(loaded.index, loaded.style) ? find_slot(-1, STYLE_DEFAULT) : NULL;
+        if (slot) {
+            *slot = loaded;
+        } else {
+            free_slot(&loaded);
+        }
+    }
+    pthread_mutex_unlock(&scene_lock);
+
+    return NULL;
+}
+
+// asks for current and its neighbours, freeing whatever else was loaded. this includes the scene being shown
+// if it's no longer wanted, so it mustn't be drawn again
+static void scene_request(int current) {
+    pthread_mutex_lock(&scene_lock);
+
+    scene_wanted[0] = current;
+    scene_wanted[1] = modulo(current + 1, scene_count);
+    scene_wanted[2] = modulo(current - 1, scene_count);
+    scene_wanted_style = wireframe;
+
+    for (int i = 0; i < SCENE_SLOTS; ++i) {
+        if (scene_slots[i].index >= 0 && !is_wanted(scene_slots[i].index, scene_slots[i].style)) {
+            free_slot(&scene_slots[i]);
+        }
+    }
+
+    pthread_cond_signal(&scene_wake);
+    pthread_mutex_unlock(&scene_lock);
+}
+
+// the current scene once it's loaded. it stays owned by its slot until the next scene_request
+static bool scene_ready(scene_slot_t* ready) {
+    pthread_mutex_lock(&scene_lock);
+    scene_slot_t* slot = find_slot(scene_wanted[0], wanted_style(scene_wanted[0]));
+    if (slot) {
+        *ready = *slot;
+    }
+    pthread_mutex_unlock(&scene_lock);
+
+    return slot != NULL;
+}
+
+static void show_volume(const pixel_t* source) {
+    pixel_t* volume = voxel_buffer_get(VOXEL_BUFFER_BACK);
+    if (source) {
+        memcpy(volume, source, sizeof(*voxel_buffer->volume));
+    } else {
+        voxel_buffer_clear(volume);
+    }
+    voxel_buffer_swap();
+    memcpy(voxel_buffer_get(VOXEL_BUFFER_BACK), voxel_buffer_get(VOXEL_BUFFER_FRONT), sizeof(*voxel_buffer->volume));
+}
+
+// a ring of dots chasing each other round the middle of the volume, while a scene that wasn't ready loads
+static void draw_spinner(pixel_t* volume, uint32_t frame) {
+    const int dots = 8;
+    const float radius = 8.0f;
+
+    for (int i = 0; i < dots; ++i) {
+        float angle = (float)(frame + i) * (float)(M_PI * 2.0 / dots);
+        int x = lroundf((VOXELS_X-1) * 0.5f + cosf(angle) * radius);
+        int y = lroundf((VOXELS_Y-1) * 0.5f + sinf(angle) * radius);
+        int z = VOXELS_Z / 2;
+        int level = 255 * (i + 1) / dots;
+        pixel_t colour = RGBPIX(level, level, level);
+
+        for (int d = 0; d < 8; ++d) {
+            volume[VOXEL_INDEX(x - (d & 1), y - ((d >> 1) & 1), z - (d >> 2))] = colour;
+        }
+    }
 }
 
 
@@ -183,6 +326,13 @@ static void vox_rotate_z(float angle) {
     }
 }
 
+#ifdef SHOW_STATS
+static uint32_t elapsed_us(const timespec_t* from) {
+    timespec_t now = timer_time_now();
+    return (now.tv_sec - from->tv_sec) * 1000000 + (now.tv_nsec - from->tv_nsec) / 1000;
+}
+#endif
+
 static int temperature_base = 0;
 static int temperature_cpu = 0;
 static bool monitor_temperature = true;
@@ -273,18 +423,27 @@ int main(int argc, char** argv) {
 
     scene_current = 0;
     if (scene_count > 0) {
-        scene_model = load_scene(scene_list[scene_current]);
+        scene_model = NULL;
+        scene_pending = true;
+        scene_loader_running = true;
+        scene_request(scene_current);
+        pthread_create(&scene_loader_thread, NULL, scene_loader, NULL);
     }
     home_pose();
 
     mfloat_t centre[VEC3_SIZE] = {(VOXELS_X-1)*0.5f, (VOXELS_Y-1)*0.5f, (VOXELS_Z-1)*0.5f};
 
+    // leave a core for the driver
+    render_context_t* render = render_create(max(1, (int)sysconf(_SC_NPROCESSORS_ONLN) - 1));
+
     float dscale = 0.0f;
     float deuler[VEC3_SIZE] = {0, 0, 0};
     float doffset[VEC3_SIZE] = {0, 0, 0};
     float matrix[MAT4_SIZE];
 #ifdef SHOW_STATS
     int perf = 0;
+    uint32_t draw_us = 0;
+    uint32_t draw_count = 0;
 
     monitor_temperature = true;
     pthread_t temperature_thread;
@@ -295,6 +454,7 @@ int main(int argc, char** argv) {
     input_set_nonblocking();
 
     int scene_target = scene_current;
+    uint32_t spinner_frame = 0;
 
     for (int ch = 0; ch != 27; ch = getchar()) {
         bool scene_reload = false;
@@ -385,8 +545,18 @@ int main(int argc, char** argv) {
             if (scene_current != scene_target || scene_reload) {
                 scene_current = scene_target;
 
-                model_free(scene_model);
-                scene_model = load_scene(scene_list[scene_current]);
+                scene_model = NULL;
+                scene_pending = true;
+                scene_request(scene_current);
+            }
+
+            scene_slot_t ready;
+            if (scene_pending && scene_ready(&ready)) {
+                scene_pending = false;
+                scene_model = ready.model;
+                if (!scene_model) {
+                    show_volume(ready.volume);
+                }
                 home_pose();
             }
         }
@@ -455,8 +625,22 @@ int main(int argc, char** argv) {
             pixel_t* volume = voxel_buffer_get(VOXEL_BUFFER_BACK);
             voxel_buffer_clear(volume);
 
-            model_draw(volume, scene_model, matrix);
+#ifdef SHOW_STATS
+            timespec_t draw_start = timer_time_now();
+#endif
+            render_begin(render, volume);
+            model_render(render, scene_model, matrix);
+            render_end(render);
+#ifdef SHOW_STATS
+            draw_us += elapsed_us(&draw_start);
+            draw_count += 1;
+#endif
 
+            voxel_buffer_swap();
+        } else if (scene_pending) {
+            pixel_t* volume = voxel_buffer_get(VOXEL_BUFFER_BACK);
+            voxel_buffer_clear(volume);
+            draw_spinner(volume, spinner_frame++);
             voxel_buffer_swap();
         } else {
             if (fabsf(model_rotation[2]) > 0.001f) {
@@ -468,17 +652,43 @@ int main(int argc, char** argv) {
         int tbase = temperature_base;
         int tproc = temperature_cpu;
         if (++perf > 60) {
+            // averaged over the frames that drew the model, not all of them while a scene loads
+            uint32_t average_us = draw_count ? draw_us / draw_count : 0;
+            printf("%u fps   %u rpm    %d.%03d° (%d.%03d°)   draw %u.%02u ms\n", 1000000 / (uint)voxel_buffer->microseconds_per_frame, (uint)voxel_buffer->revolutions_per_minute, tbase / 1000, tbase % 1000, tproc / 1000, tproc % 1000, average_us / 1000, (average_us / 10) % 100);
+            draw_us = 0;
+
+            model_cull_stats_t* cull = &model_cull_stats;
+            if (cull->primitives) {
+                printf("   culled %u%% of %u primitives, %u%% of clusters clipped, %u%% of vertices transformed\n",
+                       (uint)((uint64_t)cull->primitives_culled * 100 / cull->primitives), cull->primitives / max(draw_count, 1),
+                       cull->clusters ? (uint)((uint64_t)cull->clusters_clipped * 100 / cull->clusters) : 0,
+                       cull->vertices ? (uint)((uint64_t)cull->vertices_transformed * 100 / cull->vertices) : 0);
+            }
+            memset(cull, 0, sizeof(*cull));
+            draw_count = 0;
             perf = 0;
-            printf("%u fps   %u rpm    %d.%03d° (%d.%03d°)\n", 1000000 / (uint)voxel_buffer->microseconds_per_frame, (uint)voxel_buffer->revolutions_per_minute, tbase / 1000, tbase % 1000, tproc / 1000, tproc % 1000);
+
+            arena_stats_t scratch = arena_get_stats();
+            printf("   scratch %u KB high water, %u allocations\n", (uint)(scratch.high_water / 1024), scratch.mallocs);
             //printf("x:%g y:%g z:%g s:%g p:%g r:%g y:%g\n", model_position[0], model_position[1], model_position[2], model_scale, model_rotation[0], model_rotation[1], model_rotation[2]);
         }
 #endif
 
         usleep(50000);
     }
+    if (scene_loader_running) {
+        pthread_mutex_lock(&scene_lock);
+        scene_loader_running = false;
+        pthread_cond_signal(&scene_wake);
+        pthread_mutex_unlock(&scene_lock);
+        pthread_join(scene_loader_thread, NULL);
+    }
 #ifdef VALGRIND_HAPPY
-    model_free(scene_model);
+    for (int i = 0; i < SCENE_SLOTS; ++i) {
+        free_slot(&scene_slots[i]);
+    }
 #endif
+    render_destroy(render);
 
 #ifdef SHOW_STATS
     monitor_temperature = false;
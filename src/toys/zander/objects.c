@@ -6,6 +6,7 @@
 #include "rammel.h"
 #include "graphics.h"
 #include "model.h"
+#include "instance.h"
 #include "zander.h"
 #include "particles.h"
 #include "terrain.h"
@@ -222,6 +223,7 @@ typedef struct {
     const model_t* model;
     float hitbox_height;
     float hitbox_radius;
+    graphics_sphere_t bounds;
 } object_t;
 
 static object_t object_models[24] = {
@@ -266,6 +268,8 @@ static void calculate_hitbox(object_t* object) {
         return;
     }
 
+    object->bounds = model_get_sphere(object->model);
+
     for (int i = 0; i < object->model->vertex_count; ++i) {
         object->hitbox_height = max(object->hitbox_height, object->model->vertices[i].position.z);
         object->hitbox_radius = max(object->hitbox_radius, vec2_length(object->model->vertices[i].position.v));
@@ -360,28 +364,73 @@ bool objects_hit_and_destroy(float* position) {
 void objects_update(float dt) {
 }
 
-static void draw_voxel(pixel_t* volume, const int* coordinate, const float* barycentric, const triangle_state_t* triangle) {
-    if (coordinate[2] > HEIGHT_MAP_OBJECT(coordinate[0], coordinate[1])) {
-        HEIGHT_MAP_OBJECT(coordinate[0], coordinate[1]) = coordinate[2];
+static void draw_span(pixel_t* volume, const graphics_span_t* span, const triangle_state_t* triangle) {
+    int coordinate[VEC3_SIZE];
+    int column[VEC2_SIZE] = {-1, -1};
+    int8_t* surface = NULL;
+    int8_t ground = 0;
+
+    for (int i = 0; i < span->length; ++i) {
+        graphics_span_voxel(span, i, coordinate);
+
+        if (coordinate[0] != column[0] || coordinate[1] != column[1]) {
+            // only look the height map up again when the span moves to another column
+            column[0] = coordinate[0];
+            column[1] = coordinate[1];
+            surface = &HEIGHT_MAP_OBJECT(coordinate[0], coordinate[1]);
+            ground = HEIGHT_MAP_TERRAIN(coordinate[0], coordinate[1]);
+
+            if ((uint8_t)ground < VOXELS_Z) {
+                volume[VOXEL_INDEX(coordinate[0], coordinate[1], ground)] = 0;
+            }
+        }
+
+        if (coordinate[2] > *surface) {
+            *surface = coordinate[2];
+        }
+
+        if (coordinate[2] > ground) {
+            volume[VOXEL_INDEX(coordinate[0], coordinate[1], coordinate[2])] = triangle->colour;
+        }
     }
+}
+
+static instance_cache_t* object_instances = NULL;
+static float object_instances_scale = 0;
+
+// the ground under the object is hollowed out, and only the part of the column above it is drawn
+static int draw_instance_column(pixel_t* volume, int x, int y, int top, void* context) {
+    int8_t* surface = &HEIGHT_MAP_OBJECT(x, y);
+    int8_t ground = HEIGHT_MAP_TERRAIN(x, y);
 
-    if (coordinate[2] > HEIGHT_MAP_TERRAIN(coordinate[0], coordinate[1])) {
-        volume[VOXEL_INDEX(coordinate[0], coordinate[1], coordinate[2])] = triangle->colour;
+    if ((uint8_t)ground < VOXELS_Z) {
+        volume[VOXEL_INDEX(x, y, ground)] = 0;
     }
-    if ((uint8_t)HEIGHT_MAP_TERRAIN(coordinate[0], coordinate[1]) < VOXELS_Z) {
-        volume[VOXEL_INDEX(coordinate[0], coordinate[1], HEIGHT_MAP_TERRAIN(coordinate[0], coordinate[1]))] = 0;
+    if (top > *surface) {
+        *surface = top;
     }
+
+    return ground + 1;
 }
 
 void objects_draw(pixel_t* volume) {
-    
+    if (!object_instances) {
+        object_instances = instance_cache_create();
+    }
+
+    // every instance was voxelised at the old scale. while the scale keeps changing
+    // they'd only be used once, so draw the models directly until it settles
+    bool cached = object_instances && world_scale == object_instances_scale;
+    if (object_instances && !cached) {
+        instance_cache_clear(object_instances);
+        object_instances_scale = world_scale;
+    }
+
     int tile0[VEC2_SIZE] = {
         (int)floorf((-(VOXELS_X-1)*0.5f) / world_scale + world_position.x),
         (int)floorf((-(VOXELS_Y-1)*0.5f) / world_scale + world_position.y)
     };
     int tiles = (int)ceilf((float)VOXELS_X / world_scale);
-    
-    graphics_triangle_shader_cb = draw_voxel;
 
     float world[MAT4_SIZE];
     mat4_identity(world);
@@ -407,12 +456,20 @@ void objects_draw(pixel_t* volume) {
                     mat4_multiply(matrix, world, (float[MAT4_SIZE]){1,0,0,0, 0,1,0,0, 0,0,1,0, position.x,position.y,position.z,1});
                     //mat4_rotation_z(rotation, (x*257+y*17)*11.03f);
                     //mat4_multiply(matrix, matrix, rotation);
-                    model_draw(volume, object_models[object].model, matrix);
+
+                    // the map is drawn a square at a time, the corners of it are off the display
+                    graphics_sphere_t bounds = graphics_sphere_transform(&object_models[object].bounds, matrix);
+                    if (graphics_cull_sphere(&bounds) != GRAPHICS_CULL_OUTSIDE) {
+                        if (cached && instance_supported(object_models[object].model)) {
+                            int origin[VEC3_SIZE];
+                            instance_t instance = instance_cache_get(object_instances, object_models[object].model, matrix, origin);
+                            instance_draw_columns(volume, &instance, origin, draw_instance_column, NULL);
+                        } else {
+                            model_draw_shaded(volume, object_models[object].model, matrix, draw_span);
+                        }
+                    }
                 }
             }
         }
     }
-
-    graphics_triangle_shader_cb = NULL;
-
 }
@@ -176,27 +176,42 @@ void ship_update(float dt) {
 }
 
 
-static void draw_voxel(pixel_t* volume, const int* coordinate, const float* barycentric, const triangle_state_t* triangle) {
-    int8_t surface = HEIGHT_MAP_OBJECT(coordinate[0], coordinate[1]);
-    int8_t ground = HEIGHT_MAP_TERRAIN(coordinate[0], coordinate[1]);
-
-    if (coordinate[2] <= surface) {
-        intersection.detected = true;
-        if (surface > ground) {
-            intersection.x = coordinate[0];
-            intersection.y = coordinate[1];
+static void draw_span(pixel_t* volume, const graphics_span_t* span, const triangle_state_t* triangle) {
+    pixel_t colour = debug_collision ? ~triangle->colour : triangle->colour;
+    int coordinate[VEC3_SIZE];
+    int column[VEC2_SIZE] = {-1, -1};
+    int8_t surface = 0;
+    int8_t ground = 0;
+
+    for (int i = 0; i < span->length; ++i) {
+        graphics_span_voxel(span, i, coordinate);
+
+        if (coordinate[0] != column[0] || coordinate[1] != column[1]) {
+            // only look the height map up again when the span moves to another column
+            column[0] = coordinate[0];
+            column[1] = coordinate[1];
+            surface = HEIGHT_MAP_OBJECT(coordinate[0], coordinate[1]);
+            ground = HEIGHT_MAP_TERRAIN(coordinate[0], coordinate[1]);
+        }
+
+        if (coordinate[2] <= surface) {
+            intersection.detected = true;
+            if (surface > ground) {
+                intersection.x = coordinate[0];
+                intersection.y = coordinate[1];
+            }
         }
-    }
 
-    if (coordinate[2] > ground) {
-        volume[VOXEL_INDEX(coordinate[0], coordinate[1], coordinate[2])] = debug_collision ? ~triangle->colour : triangle->colour;
+        if (coordinate[2] > ground) {
+            volume[VOXEL_INDEX(coordinate[0], coordinate[1], coordinate[2])] = colour;
 
-        // shadow
-        surface = max(0, surface);
-        if ((uint8_t)surface < VOXELS_Z) {
-            uint32_t idx = VOXEL_INDEX(coordinate[0], coordinate[1], surface);
-            if (volume[idx]&0b00100100) {
-                volume[idx] = ((volume[idx]&0b10010010)>>1) | ((coordinate[0]^coordinate[1])&1);
+            // shadow
+            int8_t shadow = max(0, surface);
+            if ((uint8_t)shadow < VOXELS_Z) {
+                uint32_t idx = VOXEL_INDEX(coordinate[0], coordinate[1], shadow);
+                if (volume[idx]&0b00100100) {
+                    volume[idx] = ((volume[idx]&0b10010010)>>1) | ((coordinate[0]^coordinate[1])&1);
+                }
             }
         }
     }
@@ -206,8 +221,6 @@ void ship_draw(pixel_t* volume) {
     float matrix[MAT4_SIZE];
     float position[VEC3_SIZE];
 
-    graphics_triangle_shader_cb = draw_voxel;
-
     vec3_subtract(position, ship_position.v, world_position.v);
 
     mat4_identity(matrix);
@@ -215,7 +228,5 @@ void ship_draw(pixel_t* volume) {
     mat4_apply_scale_f(matrix, world_scale);
     mat4_apply_translation(matrix, position);
     mat4_apply_rotation(matrix, ship_rotation.v);
-    model_draw(volume, &ship_model, matrix);
-
-    graphics_triangle_shader_cb = NULL;
+    model_draw_shaded(volume, &ship_model, matrix, draw_span);
 }
@@ -3,6 +3,7 @@
 #include "mathc.h"
 #include "rammel.h"
 #include "graphics.h"
+#include "primitives.h"
 #include "model.h"
 #include "zander.h"
 #include "zsintable.h"
@@ -172,9 +173,7 @@ void draw_ground(pixel_t* volume) {
                 zinf = max(0, zinf + 1);
                 zsup = min(VOXELS_Z-1, zsup - 1);
 
-                for (z = zinf; z <= zsup; ++z) {
-                    volume[VOXEL_INDEX(x, y, z)] = current_tile_colour;
-                }
+                graphics_fill_column(volume, x, y, zinf, zsup + 1, current_tile_colour);
             }
 #endif
 